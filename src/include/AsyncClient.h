@@ -18,6 +18,7 @@
 #include <stdexcept>
 #include <thread>
 #include <tuple>
+#include <utility>
 #include <future>
 #include <chrono>
 
@@ -25,15 +26,20 @@
 #include <cstring> //memmove
 #include <cerrno>
 #include <string>
-#include <map>
 #include <atomic>
 #include <memory>
+#include <functional>
 
 #include <zmq.h>
 
-#include "SyncQueue.h"
+#include "QueuePolicy.h"
 #include "utility.h"
 #include "Serialize.h"
+#include "Message.h"
+#include "PendingTable.h"
+#include "TimerWheel.h"
+#include "Reactor.h"
+#include "Stats.h"
 
 //Xlib confict
 #ifdef Status
@@ -42,165 +48,398 @@
 
 namespace zrf {
 
+//Reply to a request: the reply is received through either a pooled
+//Completion, as returned by AsyncClient, or a std::future; it can be
+//waited for, polled or passed to a callback
 template < typename AT >
 class Reply {
 public:
+    using Callback = std::function< void (Message&&) >;
+    using ErrorCallback = Completion< Message >::ErrorCallback;
     Reply() = delete;
     Reply(const Reply&) = delete;
     Reply(Reply&&) = default;
     Reply& operator=(const Reply&) = delete;
-    Reply(AT& sc, ReqId rid, std::future< ByteArray >&& rf);
+    explicit Reply(Completion< Message >&& c);
+    explicit Reply(std::future< Message >&& f);
+    ///False if the request was not sent because the client request window
+    ///was full, or after the reply has been retrieved
+    bool Valid() const {
+        return completion_.Valid() || future_.valid();
+    }
+    ///Request id, use to cancel the request; 0 for future based replies
+    ReqId Id() const {
+        return completion_.Id();
+    }
+    ///True if the reply has been received, does not block
+    bool Ready() const;
+    ///Blocks until the reply is received
+    void Wait() const;
+    ///Blocks until the reply is received or the timeout expires, returns
+    ///false on timeout
+    template < typename RepT, typename PeriodT >
+    bool WaitFor(const std::chrono::duration< RepT, PeriodT >& timeout)
+        const {
+        if(completion_.Valid()) return completion_.WaitFor(timeout);
+        return future_.wait_for(timeout) == std::future_status::ready;
+    }
+    ///Invokes callback with the received frame, from the client I/O
+    ///thread, without blocking; callbacks must not block or throw.
+    ///The error callback, if any, is invoked instead on timeout or
+    ///cancellation.
+    ///Future based replies invoke the callback from the calling thread
+    ///after the reply is received
+    void Then(Callback cb, ErrorCallback onError = ErrorCallback());
+    ///Blocks until the reply is received, then returns a copy of its
+    ///payload; throws TimeoutError or CancelledError if the request
+    ///timed out or was cancelled
     ByteArray Get() const;
+    ///Blocks until the reply is received, then returns the received frame:
+    ///no copy
+    Message GetMessage() const;
     template < typename T >
     operator T() const {
-        return srz::UnPack< T >(Get());
+        const Message rep = GetMessage();
+        srz::ByteView v = rep.View();
+        T d;
+        if(srz::UnPack(v, d) != srz::UNPACK_OK)
+            throw std::runtime_error("Malformed reply");
+        return d;
     }
 private:
-    AT& sc_;
-    ReqId rid_;
-    mutable std::future< ByteArray > repFuture_;
+    //replies destroyed before being retrieved release their request: the
+    //reply is dropped when received
+    mutable Completion< Message > completion_;
+    mutable std::future< Message > future_;
 };
 
-//0 is considered a NULL request id
-inline ReqId NewReqId() {
-    static std::atomic< ReqId > rid(ReqId(0));
-    ++rid;
-    //reached max size, restarting
-    int zero = 0;
-    std::atomic_compare_exchange_strong(&rid, &zero, 1);
-    assert(rid != ReqId(0));
-    return rid;
-}
-
-template < typename TransmissionPolicyT = NoSizeInfoTransmissionPolicy >
+//QueuePolicyT selects the queue used to pass requests to the I/O thread:
+//SyncQueuePolicy or RingQueuePolicy; with bounded queues Send blocks
+//when the queue is full
+//Requests sent with a timeout carry it to the server, which discards them
+//if not processed in time; the I/O thread fails the replies not received
+//in time with TimeoutError, tracking deadlines in a timer wheel
+//The request window limits the number of requests waiting for a reply and
+//the number of request bytes queued and not yet sent: when the window is
+//full Send blocks, throws or returns an invalid reply, depending on the
+//window mode
+template < typename TransmissionPolicyT = NoSizeInfoTransmissionPolicy,
+           typename QueuePolicyT = SyncQueuePolicy >
 class AsyncClient : TransmissionPolicyT {
 public:
     using TransmissionPolicy = TransmissionPolicyT;
-    using ReplyType = Reply< AsyncClient< TransmissionPolicy > >;
+    using QueuePolicy = QueuePolicyT;
+    using ReplyType = Reply< AsyncClient< TransmissionPolicy, QueuePolicy > >;
     enum Status {STARTED, STOPPED};
-    AsyncClient() : status_(STOPPED), stop_(false) {}
+    //behaviour of Send when the request window is full:
+    //BLOCK: wait until the window opens
+    //FAIL_FAST: throw std::runtime_error
+    //WOULD_BLOCK: return an invalid reply, false for SendNoReply; moved
+    //requests are left untouched
+    enum WindowMode {BLOCK, FAIL_FAST, WOULD_BLOCK};
+    //default maximum number of pending requests
+    static const size_t MAX_PENDING = 0x8000;
+    AsyncClient()
+        : pending_(MAX_PENDING), queuedBytes_(0),
+          maxQueuedBytes_(~size_t(0)), windowMode_(BLOCK),
+          status_(STOPPED), stop_(false) {
+        pending_.NotifyOnRelease(&window_);
+    }
     AsyncClient(const AsyncClient&) = delete;
     AsyncClient(AsyncClient&&) = default;
-    AsyncClient(const char* URI) : status_(STOPPED), stop_(false) {
+    AsyncClient(const char* URI) : AsyncClient() {
         Start(URI);
     }
-    void
-    SendNoReply(const ByteArray& req) {
-        ByteArray nb;
-        const ReqId rid(0);
-        nb = srz::Pack(rid, req);
-        requestQueue_.Push(nb);
+    ///Set request window, thread safe
+    ///@param maxInFlight maximum number of requests waiting for a reply,
+    ///       the pending request table capacity is used if larger
+    ///@param maxQueuedBytes maximum number of request bytes queued and not
+    ///       yet sent; a request larger than the limit is accepted when no
+    ///       other request is queued
+    ///@param mode behaviour of Send when the window is full
+    void SetWindow(size_t maxInFlight,
+                   size_t maxQueuedBytes = ~size_t(0),
+                   WindowMode mode = BLOCK) {
+        pending_.SetLimit(maxInFlight);
+        maxQueuedBytes_ = maxQueuedBytes;
+        windowMode_ = mode;
+        //waiting senders check the new window
+        window_.Wake(true);
+    }
+    ///Requests in flight, queued bytes and time spent waiting for the
+    ///window, thread safe
+    WindowStats Window() const {
+        return windowCounters_.Get(pending_.Size(), queuedBytes_.load());
+    }
+    //timeoutms is the time after which the server discards the request if
+    //not yet processed, -1 for no timeout
+    bool
+    SendNoReply(const ByteArray& req, int timeoutms = -1) {
+        return SendNoReply(ByteArray(req), timeoutms);
+    }
+    //moved requests are passed to the I/O thread and sent without copies
+    //returns false if the request window is full in WOULD_BLOCK mode
+    bool
+    SendNoReply(ByteArray&& req, int timeoutms = -1) {
+        if(!Admit(nullptr, req.size())) return false;
+        requestQueue_.Push(Req(ReqId(0), std::move(req),
+                               Deadline(timeoutms)));
+        reactor_.Notify();
+        return true;
+    }
+    //when the request window is full, blocks, throws std::runtime_error or
+    //returns an invalid reply depending on the window mode
+    //timeoutms is the time after which the reply fails with TimeoutError
+    //and the server discards the request if not yet processed, measured
+    //from the call, -1 for no timeout
+    ReplyType
+    Send(const ByteArray& req, int timeoutms = -1) {
+        return Send(ByteArray(req), timeoutms);
     }
     ReplyType
-    Send(const ByteArray& req,
-         ReqId rid = ReqId(0)) {
-        ByteArray nb;
-        rid = rid == ReqId(0) ? NewReqId() :  rid;
-        nb = srz::Pack(rid, req);
-        requestQueue_.Push(nb);
-        //put promise into waitlist
-        //promise::set_value is invoked when matching reply is received
-        std::promise< ByteArray > p;
-        std::lock_guard< std::mutex > lg(waitListMutex_);
-        waitList_[rid] = std::move(p);
-        return ReplyType(*this, rid, std::move(waitList_[rid].get_future()));
+    Send(ByteArray&& req, int timeoutms = -1) {
+        //reserve slot in pending request table, the request id encodes
+        //the slot: the reply is stored into the slot when received
+        //the slot records the deadline, matched by the request timer
+        const Clock::time_point deadline = Deadline(timeoutms);
+        Completion< Message > c;
+        if(!Admit(&c, req.size(), deadline)) return ReplyType(std::move(c));
+        //only push request after the slot is reserved: reply might
+        //be received before this function returns
+        requestQueue_.Push(Req(c.Id(), std::move(req), deadline));
+        reactor_.Notify();
+        return ReplyType(std::move(c));
     }
     template < typename...ArgsT >
-    Reply< AsyncClient< TransmissionPolicy > >
-    SendArgs(ArgsT...args) {
-        ByteArray buffer = srz::Pack(args...);
-        return Send(buffer);
+    ReplyType
+    SendArgs(ArgsT&&...args) {
+        return Send(srz::Pack(std::forward< ArgsT >(args)...));
+    }
+    template < typename...ArgsT >
+    ReplyType
+    SendArgsTimeout(int timeoutms, ArgsT&&...args) {
+        return Send(srz::Pack(std::forward< ArgsT >(args)...), timeoutms);
+    }
+    ///Fail pending request with CancelledError, requests not yet sent are
+    ///not sent; returns false if the request is not pending, e.g. already
+    ///replied to or timed out; thread safe
+    bool Cancel(ReqId rid) {
+        return pending_.Fail(rid, std::make_exception_ptr(
+                                      CancelledError("Request cancelled")));
     }
     template < typename...ArgsT >
-    void
-    SendArgsNoReply(ArgsT...args) {
-        ByteArray buffer = srz::Pack(args...);
-        SendNoReply(buffer);
+    bool
+    SendArgsNoReply(ArgsT&&...args) {
+        return SendNoReply(srz::Pack(std::forward< ArgsT >(args)...));
     }
     ///@param timeoutSeconds file stop request then wait until timeout before
     ///       returning
     bool Stop(int timeoutSeconds = 4) { //sync
         stop_ = true;
+        reactor_.Notify(); //wake up I/O thread
+        window_.Wake(true); //wake up senders waiting for the window
         const std::future_status fs =
             taskFuture_.wait_for(std::chrono::seconds(timeoutSeconds));
         const bool ok = fs == std::future_status::ready;
-        using M = std::map< ReqId, std::promise< ByteArray > >;
-        //unlock all futures waiting on promises
+        //unlock all clients waiting for replies and invoke callbacks with
+        //empty replies
         //or should we set an exception ?
-        if(ok)
-            for(M::iterator i = waitList_.begin();
-                i != waitList_.end();
-                ++i)
-                i->second.set_value(ByteArray());
+        if(ok) pending_.CompleteAll();
         return ok;
     }
     bool Started() const {
         return status_ == STARTED;
     }
+    //the buffer size parameter is ignored and kept for compatibility:
+    //replies are received into zmq owned messages, which do not impose a
+    //limit on the payload size
+    //timeoutms is the maximum time the I/O thread sleeps when idle, the
+    //default (-1) is to sleep until a reply is received or a request sent
+    //batchSize is the maximum number of replies received and of requests
+    //sent at each loop iteration
+    //maxPending is the maximum number of requests waiting for a reply,
+    //rounded up to a power of two; memory for the pending request table
+    //is reserved once, the table is resized only if no request is pending;
+    //use SetWindow to limit the number of requests in flight below the
+    //capacity of the table
     void Start(const char* URI,
-               size_t bufferSize = 0x10000, //64kB
-               int timeoutms = 1) { //1ms
+               size_t /*bufferSize*/ = 0x10000, //ignored
+               int timeoutms = -1, //no timeout
+               size_t batchSize = 64,
+               size_t maxPending = MAX_PENDING) {
         if(Started()) {
             if(!Stop(5)) {
                 throw std::runtime_error("Cannot restart");
             }
         }
+        if(PendingTable< Message >::RoundCapacity(maxPending)
+           != pending_.Capacity() && !pending_.Size())
+            pending_.Reset(maxPending);
         taskFuture_
             = std::async(std::launch::async, CreateWorker(),
-                         URI, bufferSize, timeoutms);
+                         URI, timeoutms, batchSize);
     }
     ~AsyncClient() {
         Stop();
     }
+    ///Receive and send batch sizes, thread safe
+    BatchStats Stats() const {
+        return batchCounters_.Get();
+    }
 private:
-    friend class Reply< AsyncClient< TransmissionPolicy > >;
-    void Remove(ReqId rid) {
-        //in case of requests not needing a reply this function is
-        //invoked with ReqId = 0
-        if(rid == ReqId(0)) return;
-        std::lock_guard< std::mutex > lg(waitListMutex_);
-        if(waitList_.find(rid) == waitList_.end())
-            throw std::logic_error("Request id " + std::to_string(rid) +
-                                   " not found");
-        waitList_.erase(rid);
-    }
-    std::function< void (const char*, size_t, int) > CreateWorker() {
-        //- buffer size is the initial size of the send/recv buffer
-        //but it's up to the used transmission policy base class to decide
-        //when/if to resize
-        //- timeoutms is the poll timeout passed to zmq (and most likely
-        //to select() underneath)
-        return [this](const char* URI, size_t bufferSize, int timeoutms ) {
-            this->Execute(URI, bufferSize, timeoutms);
+    using Clock = std::chrono::steady_clock;
+    static Clock::time_point Deadline(int timeoutms) {
+        return timeoutms < 0
+               ? Clock::time_point()
+               : Clock::now() + std::chrono::milliseconds(timeoutms);
+    }
+    //reserve request window for a request of size bytes, and a pending
+    //request slot acquired with deadline if c is not null; waits, throws
+    //or returns false when the window is full, depending on the window mode
+    bool Admit(Completion< Message >* c, size_t size,
+               Clock::time_point deadline = Clock::time_point()) {
+        if(TryAdmit(c, size, deadline)) return true;
+        switch(windowMode_.load(std::memory_order_relaxed)) {
+        case FAIL_FAST:
+            windowCounters_.AddRejected();
+            throw std::runtime_error("Request window full");
+        case WOULD_BLOCK:
+            windowCounters_.AddRejected();
+            return false;
+        default:
+            break;
+        }
+        using namespace std::chrono;
+        const steady_clock::time_point start = steady_clock::now();
+        bool admitted = false;
+        window_.Wait([this, c, size, deadline, &admitted]() {
+            admitted = TryAdmit(c, size, deadline);
+            return admitted || stop_;
+        });
+        windowCounters_.AddBlocked(
+            duration_cast< nanoseconds >(steady_clock::now() - start)
+            .count());
+        if(!admitted) throw std::runtime_error("Client stopped");
+        return true;
+    }
+    bool TryAdmit(Completion< Message >* c, size_t size,
+                  Clock::time_point deadline) {
+        size_t q = queuedBytes_.load(std::memory_order_relaxed);
+        do {
+            if(q && q + size > maxQueuedBytes_.load(
+                                       std::memory_order_relaxed))
+                return false;
+        } while(!queuedBytes_.compare_exchange_weak(
+                    q, q + size, std::memory_order_relaxed));
+        if(!c) return true;
+        *c = pending_.Acquire(deadline);
+        if(c->Valid()) return true;
+        //no need to wake up other senders: they are woken up when a
+        //request is released
+        queuedBytes_.fetch_sub(size, std::memory_order_relaxed);
+        return false;
+    }
+    //request bytes removed from the queue
+    void SentBytes(size_t size) {
+        queuedBytes_.fetch_sub(size, std::memory_order_relaxed);
+        window_.Wake(true);
+    }
+    std::function< void (const char*, int, size_t) > CreateWorker() {
+        //- timeoutms is the maximum time spent waiting for activity on
+        //the socket or the request queue
+        //- batchSize is the maximum number of messages received and sent
+        //at each iteration
+        return [this](const char* URI, int timeoutms, size_t batchSize) {
+            this->Execute(URI, timeoutms, batchSize);
         };
     }
 
     //Envelope received from router:
     //| 0 bytes|
+    //| request id |
+    //| message bytes|
+    //requests are sent as:
+    //| request id |
     //| message bytes|
-    void Execute(const char* URI, size_t bufferSize, int timeoutms) {
+    void Execute(const char* URI, int timeoutms, size_t batchSize) {
         void* ctx = nullptr;
         void* s = nullptr;
         std::tie(ctx, s) = CreateZMQContextAndSocket(URI);
         status_ = STARTED;
-        zmq_pollitem_t items[] = { { s, 0, ZMQ_POLLIN, 0 } };
-        ByteArray recvBuffer(bufferSize);
+        ReqId rid;
+        bool pending = false;
+        //ids and deadlines of sent requests
+        TimerWheel< Timer > timers;
+        const std::exception_ptr timeout =
+            std::make_exception_ptr(TimeoutError("Request timed out"));
         while(!stop_) {
-            ZCheck(zmq_poll(items, 1, timeoutms)); //poll with 100ms timeout
-            if(items[0].revents & ZMQ_POLLIN) {
-                ZCheck(zmq_recv(s, 0, 0, 0));
+            //sleep until a reply is received, a request is queued or a
+            //request times out; do not wait if requests are still queued
+            int waitms = pending ? 0 : timeoutms;
+            if(!timers.Empty()) {
+                const int t = timers.NextTimeout(Clock::now());
+                if(waitms < 0 || t < waitms) waitms = t;
+            }
+            const int ev = reactor_.Wait(s, waitms);
+            size_t n = 0;
+            //receive all available replies, up to batchSize
+            for(; (ev & Reactor::READABLE) && n != batchSize; ++n) {
+                const int rc = zmq_recv(s, 0, 0, ZMQ_DONTWAIT);
+                if(rc < 0 && errno == EAGAIN) break;
+                ZCheck(rc);
+                //rest of multipart message is already available
+                if(!ReceiveReqId(s, rid)) continue;
                 const bool blockOption = true;
-                TransmissionPolicy::ReceiveBuffer(s, recvBuffer, blockOption);
-                auto di = srz::UnPackTuple< ReqId, ByteArray >(recvBuffer);
-                if(!std::get< 0 >(di)) continue;
-                waitList_[std::get< 0 >(di)].set_value(std::get< 1 >(di));
+                //zmq owned message: replies are not limited in size
+                Message rep;
+                TransmissionPolicy::ReceiveMessage(s, rep.Get(), blockOption);
+                //frame moved into the pending request slot or passed to
+                //its callback, not copied; replies to released requests
+                //are dropped
+                if(rid) pending_.Complete(rid, std::move(rep));
             }
-            //here it is required because in the loop we are both inserting
-            //and receiving data inot two separate queue, and we need to
-            //check if there is data to send
-            if(requestQueue_.Empty()) continue;
-            ByteArray buffer(requestQueue_.Pop());
-            TransmissionPolicy::SendBuffer(s, buffer);
+            batchCounters_.AddRecv(n);
+            //fail requests not replied to in time; timers of requests
+            //already completed or released are ignored, also when their
+            //slot is reused by a request with the same id after the
+            //generation wraps around: the deadline does not match
+            if(!timers.Empty())
+                timers.Advance(Clock::now(), [this, &timeout](
+                                   const Timer& t) {
+                    pending_.Expire(t.first, t.second, timeout);
+                });
+            //send all queued requests, up to batchSize
+            size_t sentBytes = 0;
+            for(n = 0; n != batchSize && !requestQueue_.Empty(); ++n) {
+                Req req(requestQueue_.Pop());
+                sentBytes += std::get< 1 >(req).size();
+                const ReqId r = std::get< 0 >(req);
+                //do not send requests cancelled or abandoned
+                if(r && !pending_.Pending(r)) continue;
+                int ms = 0;
+                const Clock::time_point deadline = std::get< 2 >(req);
+                if(deadline != Clock::time_point()) {
+                    const Clock::time_point now = Clock::now();
+                    //expired while queued: do not send
+                    if(now >= deadline) {
+                        if(r) pending_.Fail(r, timeout);
+                        continue;
+                    }
+                    //remaining time, rounded up
+                    using namespace std::chrono;
+                    ms = int(duration_cast< milliseconds >(
+                                 deadline - now + milliseconds(1)
+                                 - nanoseconds(1)).count());
+                    if(r) timers.Add(Timer(r, deadline), deadline);
+                }
+                SendReqId(s, r, ms);
+                //payload moved into the zmq message, not copied
+                TransmissionPolicy::SendBuffer(s,
+                                               std::move(std::get< 1 >(req)));
+            }
+            batchCounters_.AddSend(n);
+            if(n) SentBytes(sentBytes);
+            pending = !requestQueue_.Empty();
         }
         CleanupZMQResources(ctx, s);
         status_ = STOPPED;
@@ -232,23 +471,69 @@ private:
         return std::make_tuple(nullptr, nullptr);
     };
 private:
-    SyncQueue< ByteArray > requestQueue_;
-    std::map< ReqId, std::promise< ByteArray > > waitList_;
-    std::mutex waitListMutex_;
+    //request id, payload and deadline, Clock::time_point() if none
+    using Req = std::tuple< ReqId, ByteArray, Clock::time_point >;
+    //request id and deadline
+    using Timer = std::pair< ReqId, Clock::time_point >;
+    typename QueuePolicy::template MPSCQueue< Req > requestQueue_;
+    PendingTable< Message > pending_;
+    //request window
+    WaitWord window_;
+    std::atomic< size_t > queuedBytes_;
+    std::atomic< size_t > maxQueuedBytes_;
+    std::atomic< WindowMode > windowMode_;
+    WindowCounters windowCounters_;
     std::future< void > taskFuture_;
+    Reactor reactor_;
+    BatchCounters batchCounters_;
     Status status_;
     bool stop_;
 };
 
 template < typename AT >
-Reply< AT >::Reply(AT& sc, ReqId rid, std::future< ByteArray >&& rf)
-    : sc_(sc), rid_(rid), repFuture_(std::move(rf)) {}
+Reply< AT >::Reply(Completion< Message >&& c) : completion_(std::move(c)) {}
+
+template < typename AT >
+Reply< AT >::Reply(std::future< Message >&& f) : future_(std::move(f)) {}
+
+template < typename AT >
+bool Reply< AT >::Ready() const {
+    if(completion_.Valid()) return completion_.Poll();
+    return future_.wait_for(std::chrono::seconds(0))
+           == std::future_status::ready;
+}
+
+template < typename AT >
+void Reply< AT >::Wait() const {
+    if(completion_.Valid()) completion_.Wait();
+    else future_.wait();
+}
+
+template < typename AT >
+void Reply< AT >::Then(Callback cb, ErrorCallback onError) {
+    if(completion_.Valid()) {
+        completion_.Then(std::move(cb), std::move(onError));
+        return;
+    }
+    Message rep;
+    try {
+        rep = future_.get();
+    } catch(...) {
+        if(onError) onError(std::current_exception());
+        return;
+    }
+    cb(std::move(rep));
+}
 
 template < typename AT >
 ByteArray Reply< AT >::Get() const {
-    ByteArray rep = repFuture_.get();
-    sc_.Remove(rid_);
-    return rep;
+    return GetMessage().ToByteArray();
 }
 
-}
\ No newline at end of file
+template < typename AT >
+Message Reply< AT >::GetMessage() const {
+    if(completion_.Valid()) return completion_.Get();
+    return future_.get();
+}
+
+}
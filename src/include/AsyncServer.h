@@ -28,12 +28,18 @@
 #include <map>
 #include <atomic>
 #include <memory>
+#include <deque>
+#include <cstdint>
 
 #include <zmq.h>
 
-#include "SyncQueue.h"
+#include "QueuePolicy.h"
 #include "utility.h"
 #include "Serialize.h"
+#include "Message.h"
+#include "Reactor.h"
+#include "Stats.h"
+#include "WorkStealingQueue.h"
 
 //Xlib confict
 #ifdef Status
@@ -42,26 +48,67 @@
 
 namespace zrf {
 
-template < typename TransmissionPolicyT = NoSizeInfoTransmissionPolicy >
+//! Compile time check: true if service functor accepts a \c Message, in which
+//! case the received frame is moved into the service without being copied.
+template < typename ServiceT >
+struct AcceptsMessage {
+    template < typename S,
+               typename = decltype(std::declval< const S& >()(
+                   std::declval< Message >())) >
+    static std::true_type Test(int);
+    template < typename S >
+    static std::false_type Test(...);
+    static const bool value = decltype(Test< ServiceT >(0))::value;
+};
+
+//QueuePolicyT selects the queues used to dispatch requests to workers and
+//to collect replies: SyncQueuePolicy or RingQueuePolicy; with bounded
+//queues the per-worker queues of the other scheduling modes are bounded
+//to the same capacity, and requests stay queued in zmq when they are full
+template < typename TransmissionPolicyT = NoSizeInfoTransmissionPolicy,
+           typename QueuePolicyT = SyncQueuePolicy >
 class AsyncServer : TransmissionPolicyT {
     using SocketId = std::vector< char >;
+    using Clock = std::chrono::steady_clock;
+    //requests hold the received frame and the time after which the client
+    //is not waiting for the reply anymore, Clock::time_point() if none;
+    //replies hold the serialized result
+    using ReqRep = std::tuple< SocketId, ReqId, Message, Clock::time_point >;
+    using Rep = std::tuple< SocketId, ReqId, ByteArray >;
 public:
     using TransmissionPolicy = TransmissionPolicyT;
+    using QueuePolicy = QueuePolicyT;
     enum Status {STARTED, STOPPED};
-    AsyncServer() : status_(STOPPED), stop_(false) {}
+    //How requests are distributed to workers:
+    //- SHARED_QUEUE: all workers pop from a single queue
+    //- ROUND_ROBIN: per-worker queues filled in turn, idle workers steal
+    //- CLIENT_AFFINITY: per-worker queues selected by client id, idle
+    //  workers steal
+    //- CLIENT_ORDERED: per-worker queues selected by client id, no
+    //  stealing: requests from the same client are processed in order
+    enum Scheduling {SHARED_QUEUE, ROUND_ROBIN, CLIENT_AFFINITY,
+                     CLIENT_ORDERED};
+    AsyncServer() : status_(STOPPED), stop_(false),
+                    scheduling_(SHARED_QUEUE), expired_(0) {}
     AsyncServer(const AsyncServer&) = delete;
     AsyncServer(AsyncServer&&) = default;
     template < typename ServiceT >
-    AsyncServer(const char* URI, const ServiceT& s) : status_(STOPPED),
-                                                      stop_(false) {
+    AsyncServer(const char* URI, const ServiceT& s)
+        : status_(STOPPED), stop_(false), scheduling_(SHARED_QUEUE),
+          expired_(0) {
         Start(URI, s);
     }
     ///@param timeoutSeconds file stop request then wait until timeout before
     ///       returning
     bool Stop(int timeoutSeconds = 4) { //sync
         stop_ = true; // request termination
-        requestQueue_.PushFront(ReqRep()); //add data into queue to unlock
-                                         //wait condition in Pop
+        reactor_.Notify(); //wake up I/O thread
+        //add one element per worker into queue to unlock wait condition
+        //in Pop
+        if(scheduling_ == SHARED_QUEUE) {
+            for(size_t i = 0; i != taskFutures_.size(); ++i)
+                requestQueue_.Push(ReqRep());
+        } else workQueue_.Stop();
         std::vector< std::future_status > status;
         using It = std::vector< std::future< void > >::iterator;
         for(It f = taskFutures_.begin(); f != taskFutures_.end(); ++f)
@@ -77,29 +124,51 @@ public:
     bool Started() const {
         return status_ == STARTED;
     }
+    //Services accepting a Message receive the zmq frame itself, all others
+    //receive a ByteArray copy of the request payload.
+    //the buffer size parameter is ignored and kept for compatibility:
+    //requests are received into zmq owned messages, which do not impose a
+    //limit on the payload size
+    //timeoutms is the maximum time the I/O thread sleeps when idle, the
+    //default (-1) is to sleep until a request or a reply is available
+    //batchSize is the maximum number of requests received and of replies
+    //sent at each loop iteration
+    //scheduling selects how requests are distributed to the workers, see
+    //Scheduling
     template < typename ServiceT >
     void Start(const char* URI,
                const ServiceT& s,
-               size_t bufferSize = 0x100000, //1 MB
-               int timeoutms = 2, //1 ms
-               int numThreads = 1) {
+               size_t /*bufferSize*/ = 0x100000, //ignored
+               int timeoutms = -1, //no timeout
+               int numThreads = 1,
+               size_t batchSize = 64,
+               Scheduling scheduling = SHARED_QUEUE) {
         if(Started()) {
             if(!Stop()) {
                 throw std::runtime_error("Cannot restart");
             }
         }
         taskFutures_.clear();
-        using BT = typename
-            BoolToType< std::is_void< decltype(s(ByteArray())) >::value >::Type;
+        //Recv/SyncRecv read from the shared queue when there are no workers
+        scheduling_ = numThreads > 0 ? scheduling : SHARED_QUEUE;
+        //per-worker queues are bounded like the shared queue, so that
+        //bounded queue policies apply backpressure with any scheduling
+        if(scheduling_ != SHARED_QUEUE)
+            workQueue_.Reset(numThreads, scheduling_ != CLIENT_ORDERED,
+                             QueuePolicy::Capacity(requestQueue_));
+        using Arg = typename std::conditional<
+            AcceptsMessage< ServiceT >::value, Message, ByteArray >::type;
+        using BT = typename BoolToType< std::is_void<
+            decltype(s(std::declval< Arg >())) >::value >::Type;
         for(int i = 0; i != numThreads; ++i) {
             taskFutures_.push_back(std::async(std::launch::async,
-               CreateWorker(s, BT())));
+               CreateWorker(s, BT(), i)));
         }
         //sync call: starts loop which polls socket then:
         // - forwards received requests to running service instances in
         //  separate threads
         // - sends replied back to connected clients
-        Execute(URI, bufferSize, timeoutms);
+        Execute(URI, timeoutms, batchSize);
     }
 #if 0 //UV XXX: Check!!!
     //start without re-creating workers, useful when restarting
@@ -119,96 +188,232 @@ public:
     ~AsyncServer() {
         Stop();
     }
+    ///Receive and send batch sizes, thread safe
+    BatchStats Stats() const {
+        return batchCounters_.Get();
+    }
+    ///Number of requests discarded because their deadline expired before
+    ///a worker could process them, thread safe
+    std::uint64_t ExpiredRequests() const {
+        return expired_.load(std::memory_order_relaxed);
+    }
 private:
+    //true if the client is not waiting for the reply anymore: the request
+    //is discarded without invoking the service and without replying
+    bool Expired(const ReqRep& d) {
+        const Clock::time_point& deadline = std::get< 3 >(d);
+        if(deadline == Clock::time_point() || Clock::now() <= deadline)
+            return false;
+        expired_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    //invoke service: pass received frame
+    template < typename ServiceT >
+    static auto Invoke(const ServiceT& service, Message&& req, TRUE_TYPE)
+    -> decltype(service(std::move(req))) {
+        return service(std::move(req));
+    }
+    //invoke service: pass copy of received payload
+    template < typename ServiceT >
+    static auto Invoke(const ServiceT& service, Message&& req, FALSE_TYPE)
+    -> decltype(service(req.ToByteArray())) {
+        return service(req.ToByteArray());
+    }
     //create worker: non void return type case
     template < typename ServiceT >
     std::function< void () > CreateWorker(const ServiceT& service,
-                                          FALSE_TYPE nonVoidReturnType) {
-        return [this, service]() {
-            while(true) {
-                SocketId id;
-                ReqId rid;
-                ByteArray req;
-                std::tuple< SocketId, ReqId, ByteArray > d
-                    = this->requestQueue_.Pop();
-                if(stop_) break;
-                std::tie(id, rid, req) = d;
+                                          FALSE_TYPE nonVoidReturnType,
+                                          size_t worker) {
+        using MT = typename
+            BoolToType< AcceptsMessage< ServiceT >::value >::Type;
+        return [this, service, worker]() {
+            ReqRep d;
+            while(this->NextRequest(worker, d)) {
+                if(this->Expired(d)) continue;
+                const ReqId rid = std::get< 1 >(d);
                 //if request id != 0 add reply into queue, if not just
                 //invoke the service functor
-                if(rid != ReqId(0))
+                if(rid != ReqId(0)) {
                     this->replyQueue_.Push(
-                        std::make_tuple(id, rid, service(req)));
-                else
-                    service(req);
+                        Rep(std::move(std::get< 0 >(d)), rid,
+                            Invoke(service, std::move(std::get< 2 >(d)),
+                                   MT())));
+                    this->reactor_.Notify();
+                } else
+                    Invoke(service, std::move(std::get< 2 >(d)), MT());
             }
         };
     }
     //create worker: void return type case
     template < typename ServiceT >
     std::function< void () > CreateWorker(const ServiceT& service,
-                                          TRUE_TYPE voidReturnType) {
-        return [this, service]() {
-            while(true) {
-                SocketId id;
-                ReqId rid;
-                ByteArray req;
-                std::tuple< SocketId, ReqId, ByteArray > d
-                    = this->requestQueue_.Pop();
-                if(stop_) break;
-                std::tie(id, rid, req) = d;
-                service(req);
+                                          TRUE_TYPE voidReturnType,
+                                          size_t worker) {
+        using MT = typename
+            BoolToType< AcceptsMessage< ServiceT >::value >::Type;
+        return [this, service, worker]() {
+            ReqRep d;
+            while(this->NextRequest(worker, d)) {
+                if(this->Expired(d)) continue;
+                const ReqId rid = std::get< 1 >(d);
+                Invoke(service, std::move(std::get< 2 >(d)), MT());
                 //since return type is void do return an empty reply if
                 //a reply is requested; note that it is correct to request
                 //a reply as an ack that the request has been processed
-                if(rid == ReqId(0)) replyQueue_.Push(
-                        std::make_tuple(id, rid, ByteArray()));
+                if(rid != ReqId(0)) {
+                    replyQueue_.Push(
+                        Rep(std::move(std::get< 0 >(d)), rid, ByteArray()));
+                    reactor_.Notify();
+                }
             }
         };
     }
+    //blocks until a request is available to worker, false when stopped
+    bool NextRequest(size_t worker, ReqRep& d) {
+        if(scheduling_ != SHARED_QUEUE) return workQueue_.Pop(worker, d);
+        d = requestQueue_.Pop();
+        return !stop_;
+    }
+    //true if the queue the next request is forwarded to might be full;
+    //with per-worker queues, true if any of them is full since the worker
+    //is only known after the request is received
+    bool Full() const {
+        return scheduling_ == SHARED_QUEUE
+               ? QueuePolicy::Full(requestQueue_) : workQueue_.Full();
+    }
+    //forward request to workers, called from the I/O thread
+    void Schedule(ReqRep&& d) {
+        switch(scheduling_) {
+        case SHARED_QUEUE:
+            requestQueue_.Push(std::move(d));
+            break;
+        case ROUND_ROBIN:
+            workQueue_.Push(workQueue_.Next(), std::move(d));
+            break;
+        default:
+            const size_t w = Hash(std::get< 0 >(d))
+                             % workQueue_.NumWorkers();
+            workQueue_.Push(w, std::move(d));
+        }
+    }
+    //FNV-1a
+    static size_t Hash(const SocketId& id) {
+        std::uint64_t h = 14695981039346656037ULL;
+        for(SocketId::const_iterator i = id.begin(); i != id.end(); ++i)
+            h = (h ^ std::uint8_t(*i)) * 1099511628211ULL;
+        return size_t(h);
+    }
     //envelope from DEALER:
-    //| ID      |
-    //| MESSAGE |
+    //| ID         |
+    //| REQUEST ID [TIMEOUT] |
+    //| MESSAGE    |
     //enveloper from ROUTER:
     //| ID |
     //| 0 bytes |
+    //| request id |
     //| message |
-    void Execute(const char* URI, size_t bufferSize, int timeoutms) {
+    void Execute(const char* URI, int timeoutms, size_t batchSize) {
         void* ctx = nullptr;
         void* s = nullptr;
         std::tie(ctx, s) = CreateZMQContextAndSocket(URI);
         status_ = STARTED;
-        zmq_pollitem_t items[] = { { s, 0, ZMQ_POLLIN, 0 } };
-        ByteArray recvBuffer(bufferSize);
-        SocketId id(0x100);
+        SocketId id;
         ReqId rid;
-        ByteArray req;
-        ByteArray rep;
+        int reqTimeoutms = 0;
+        //replies not accepted by the socket because the client is not
+        //reading fast enough, sent again at the next iterations
+        std::deque< Rep > stalled;
+        const int retryms = 1;
+        bool pending = false;
         while(!stop_) {
-            ZCheck(zmq_poll(items, 1, timeoutms)); //poll with 100ms timeout
-            if(items[0].revents & ZMQ_POLLIN) {
-                size_t len = 0;
-                const int irc = ZCheck(zmq_recv(s, &id[0], id.size(), 0));
-                id.resize(irc);
+            //sleep until a request is received or a worker pushes a reply;
+            //do not wait if replies are still queued. When the request
+            //queue is full the socket is not polled: it stays readable
+            //while requests are queued in zmq and the thread would spin;
+            //sleep until a worker pushes a reply or retryms elapses instead
+            const bool full = Full();
+            const int ev = reactor_.Wait(full ? nullptr : s,
+                                         pending ? 0
+                                         : full || !stalled.empty() ? retryms
+                                         : timeoutms);
+            size_t n = 0;
+            //receive all available requests, up to batchSize; stop when
+            //the request queue is full, requests stay queued in zmq
+            for(; (ev & Reactor::READABLE) && n != batchSize
+                  && !Full(); ++n) {
+                id.resize(0x100);
+                const int irc = zmq_recv(s, &id[0], id.size(), ZMQ_DONTWAIT);
+                if(irc < 0 && errno == EAGAIN) break;
+                id.resize(ZCheck(irc));
+                //rest of multipart message is already available
+                if(!ReceiveReqId(s, rid, reqTimeoutms)) {
+                    Log("server>> malformed request discarded");
+                    continue;
+                }
                 const bool blockOption = true;
-                TransmissionPolicy::ReceiveBuffer(s, recvBuffer, blockOption);
-                std::tie(rid, req) =
-                    srz::UnPackTuple< ReqId, ByteArray >(recvBuffer);
-                requestQueue_.Push(std::make_tuple(id, rid, req));
+                Message req;
+                TransmissionPolicy::ReceiveMessage(s, req.Get(), blockOption);
+                //deadline measured from reception: no clock
+                //synchronization with the client required
+                const Clock::time_point deadline = reqTimeoutms > 0
+                    ? Clock::now() + std::chrono::milliseconds(reqTimeoutms)
+                    : Clock::time_point();
+                //frame ownership is passed to the worker, no copy
+                Schedule(ReqRep(id, rid, std::move(req), deadline));
+            }
+            batchCounters_.AddRecv(n);
+            //send all queued replies, up to batchSize
+            n = 0;
+            for(std::deque< Rep >::iterator i = stalled.begin();
+                i != stalled.end() && n != batchSize;) {
+                if(SendReply(s, *i)) {
+                    i = stalled.erase(i);
+                    ++n;
+                } else ++i;
             }
-            //here we need to check if there is any data available to send
-            //so a call to Empty() is required if not the loop will stall
-            //which would also prevent data from being received
-            if(replyQueue_.Empty()) continue;
-            std::tie(id, rid, rep) = replyQueue_.Pop();
-            //no reply on request id 0
-            if(!rid) continue;
-            ZCheck(zmq_send(s, id.data(), id.size(), ZMQ_SNDMORE));
-            ZCheck(zmq_send(s, nullptr, 0, ZMQ_SNDMORE));
-            TransmissionPolicy::SendBuffer(s, srz::PackArgs(rid, rep));
+            for(size_t b = n; b != batchSize && !replyQueue_.Empty(); ++b) {
+                Rep r = replyQueue_.Pop();
+                if(SendReply(s, r)) ++n;
+                else stalled.push_back(std::move(r));
+            }
+            batchCounters_.AddSend(n);
+            pending = !replyQueue_.Empty();
         }
+        DiscardReplies();
         CleanupZMQResources(ctx, s);
         status_ = STOPPED;
     }
+    //workers blocked on a full reply queue would never consume the
+    //termination requests pushed by Stop(): discard replies until all
+    //workers have exited
+    void DiscardReplies() {
+        using It = std::vector< std::future< void > >::iterator;
+        for(It f = taskFutures_.begin(); f != taskFutures_.end(); ++f) {
+            do {
+                while(!replyQueue_.Empty()) replyQueue_.Pop();
+            } while(f->wait_for(std::chrono::milliseconds(1))
+                    != std::future_status::ready);
+        }
+    }
+    //returns false if the reply could not be queued because the
+    //client's high water mark was reached; replies to disconnected
+    //clients are discarded; the reply payload is moved into the sent
+    //message, not copied
+    static bool SendReply(void* s, Rep& r) {
+        const SocketId& id = std::get< 0 >(r);
+        const ReqId rid = std::get< 1 >(r);
+        //no reply on request id 0
+        if(!rid) return true;
+        if(zmq_send(s, id.data(), id.size(), ZMQ_SNDMORE | ZMQ_DONTWAIT) < 0) {
+            if(errno == EAGAIN) return false;
+            if(errno == EHOSTUNREACH) return true;
+            ZCheck(-1);
+        }
+        ZCheck(zmq_send(s, nullptr, 0, ZMQ_SNDMORE));
+        SendReqId(s, rid);
+        TransmissionPolicy::SendBuffer(s, std::move(std::get< 2 >(r)));
+        return true;
+    }
 public:
     struct Msg {
         SocketId sid;
@@ -219,11 +424,9 @@ public:
     Msg SyncRecv() { //blocks until data is available
         if(!Started())
             throw std::logic_error("Not started");
-        SocketId sid;
-        ReqId rid;
-        ByteArray data;
-        std::tie(sid, rid, data) = requestQueue_.Pop();
-        return {sid, rid, data};
+        ReqRep d = requestQueue_.Pop();
+        return {std::move(std::get< 0 >(d)), std::get< 1 >(d),
+                std::get< 2 >(d).ToByteArray()};
     }
     //use in loop to check if any message has been received
     Msg Recv(Msg&& emptyMessage = Msg()) {
@@ -231,14 +434,16 @@ public:
             throw std::logic_error("Not started");
         //ok to call empty: called to check if message available
         //while already in a loop
-        if(requestQueue_.Empty()) return emptyMessage;
-        return requestQueue_.Pop();
+        if(requestQueue_.Empty()) return std::move(emptyMessage);
+        ReqRep d = requestQueue_.Pop();
+        return {std::move(std::get< 0 >(d)), std::get< 1 >(d),
+                std::get< 2 >(d).ToByteArray()};
     }
     void Send(const Msg& msg) {
         if(!Started())
             throw std::logic_error("Not started");
-        auto d = std::make_tuple(msg.sid, msg.rid, msg.data);
-        replyQueue_.Push(d);
+        replyQueue_.Push(Rep(msg.sid, msg.id, msg.data));
+        reactor_.Notify();
     }
 private:
     void CleanupZMQResources(void* ctx, void* s) {
@@ -257,6 +462,11 @@ private:
             s = zmq_socket(ctx, ZMQ_ROUTER);
             if(!s)
                 throw std::runtime_error("Cannot create ZMQ ROUTER socket");
+            //report full client queues instead of silently dropping replies
+            const int mandatory = 1;
+            if(zmq_setsockopt(s, ZMQ_ROUTER_MANDATORY, &mandatory,
+                              sizeof(mandatory)))
+                throw std::runtime_error("Cannot set ZMQ_ROUTER_MANDATORY");
             if(zmq_bind(s, URI))
                 throw std::runtime_error("Cannot bind ZMQ socket");
             return std::make_tuple(ctx, s);
@@ -267,16 +477,20 @@ private:
         return std::make_tuple(nullptr, nullptr);
     };
 private:
-    using ReqRep = std::tuple< SocketId, ReqId, ByteArray >;
-    SyncQueue< ReqRep > requestQueue_;
-    SyncQueue< ReqRep > replyQueue_;
+    typename QueuePolicy::template MPMCQueue< ReqRep > requestQueue_;
+    typename QueuePolicy::template MPSCQueue< Rep > replyQueue_;
+    WorkStealingQueue< ReqRep > workQueue_;
+    Reactor reactor_;
+    BatchCounters batchCounters_;
     std::vector< std::future< void > > taskFutures_;
     Status status_;
     bool stop_;
+    Scheduling scheduling_;
+    std::atomic< std::uint64_t > expired_;
 };
 
-template < typename TP >
-inline bool Valid(const typename AsyncServer< TP >::Msg& msg) {
+template < typename TP, typename QP >
+inline bool Valid(const typename AsyncServer< TP, QP >::Msg& msg) {
     return !msg.data.empty();
 }
 
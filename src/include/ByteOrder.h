@@ -0,0 +1,203 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//! \file ByteOrder.h
+//! \brief Conversion of arrays of 2, 4 and 8 byte elements between host and
+//! little-endian byte order.
+//!
+//! The byte swapping kernel is selected at compile time from the target
+//! instruction set: AVX2, SSSE3, SSE2 or NEON, with a scalar loop for the
+//! remaining elements and for other targets; e.g. build with \c -mavx2 to
+//! enable the AVX2 kernel.
+//! On little-endian hosts conversion is a plain \c memcpy.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace srz {
+namespace detail {
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool HOST_LITTLE_ENDIAN = false;
+#else
+constexpr bool HOST_LITTLE_ENDIAN = true;
+#endif
+
+//! Name of the instruction set used by \c ByteSwapKernel.
+inline const char* ByteSwapISA() {
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSSE3__)
+    return "SSSE3";
+#elif defined(__SSE2__)
+    return "SSE2";
+#elif defined(__ARM_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+//! Scalar byte swap, compiled to a single instruction by most compilers.
+inline std::uint16_t ByteSwap(std::uint16_t x) {
+    return std::uint16_t((x >> 8) | (x << 8));
+}
+
+inline std::uint32_t ByteSwap(std::uint32_t x) {
+    return (x >> 24) | ((x >> 8) & 0xFF00u) | ((x << 8) & 0xFF0000u)
+           | (x << 24);
+}
+
+inline std::uint64_t ByteSwap(std::uint64_t x) {
+    return (std::uint64_t(ByteSwap(std::uint32_t(x))) << 32)
+           | ByteSwap(std::uint32_t(x >> 32));
+}
+
+//! Reverse the byte order of arrays of \c N byte elements.
+template< size_t N >
+struct ByteSwapKernel {
+    static_assert(N == 2 || N == 4 || N == 8, "Unsupported element size");
+    using UInt = typename std::conditional< N == 2, std::uint16_t,
+                 typename std::conditional< N == 4, std::uint32_t,
+                                            std::uint64_t >::type >::type;
+    //! Copy \c n elements from \c src to \c dst reversing their byte order;
+    //! buffers need not be aligned and can be the same buffer
+    static void Copy(void* dst, const void* src, size_t n) {
+        unsigned char* d = static_cast< unsigned char* >(dst);
+        const unsigned char* s = static_cast< const unsigned char* >(src);
+        const size_t bytes = N * n;
+        const size_t i = Bulk(d, s, bytes);
+        CopyScalar(d + i, s + i, (bytes - i) / N);
+    }
+    //! Same as \c Copy, one element at a time
+    static void CopyScalar(void* dst, const void* src, size_t n) {
+        unsigned char* d = static_cast< unsigned char* >(dst);
+        const unsigned char* s = static_cast< const unsigned char* >(src);
+        for(size_t i = 0; i != n; ++i, d += N, s += N) {
+            UInt x;
+            memcpy(&x, s, N);
+            x = ByteSwap(x);
+            memcpy(d, &x, N);
+        }
+    }
+private:
+    //process data in blocks of vector register size, return number of
+    //bytes processed
+    static size_t Bulk(unsigned char* d, const unsigned char* s,
+                       size_t bytes) {
+        size_t i = 0;
+#if defined(__SSSE3__)
+        //shuffle mask: reverse bytes of each element in each 128 bit lane
+        alignas(32) char mask[32];
+        for(int k = 0; k != 32; ++k)
+            mask[k] = char(k % 16 - k % N + N - 1 - k % N);
+#if defined(__AVX2__)
+        const __m256i m256 =
+            _mm256_load_si256(reinterpret_cast< const __m256i* >(mask));
+        for(; i + 32 <= bytes; i += 32) {
+            const __m256i x =
+                _mm256_loadu_si256(reinterpret_cast< const __m256i* >(s + i));
+            _mm256_storeu_si256(reinterpret_cast< __m256i* >(d + i),
+                                _mm256_shuffle_epi8(x, m256));
+        }
+#endif
+        const __m128i m128 =
+            _mm_load_si128(reinterpret_cast< const __m128i* >(mask));
+        for(; i + 16 <= bytes; i += 16) {
+            const __m128i x =
+                _mm_loadu_si128(reinterpret_cast< const __m128i* >(s + i));
+            _mm_storeu_si128(reinterpret_cast< __m128i* >(d + i),
+                             _mm_shuffle_epi8(x, m128));
+        }
+#elif defined(__SSE2__)
+        for(; i + 16 <= bytes; i += 16) {
+            const __m128i x =
+                _mm_loadu_si128(reinterpret_cast< const __m128i* >(s + i));
+            _mm_storeu_si128(reinterpret_cast< __m128i* >(d + i),
+                             Swap(x, std::integral_constant< size_t, N >()));
+        }
+#elif defined(__ARM_NEON)
+        for(; i + 16 <= bytes; i += 16)
+            vst1q_u8(d + i, Swap(vld1q_u8(s + i),
+                                 std::integral_constant< size_t, N >()));
+#endif
+        return i;
+    }
+#if defined(__SSE2__) && !defined(__SSSE3__)
+    //no byte shuffle: swap bytes in 16 bit words, then reorder the words
+    static __m128i Swap(__m128i x, std::integral_constant< size_t, 2 >) {
+        return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    }
+    static __m128i Swap(__m128i x, std::integral_constant< size_t, 4 >) {
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        return Swap(x, std::integral_constant< size_t, 2 >());
+    }
+    static __m128i Swap(__m128i x, std::integral_constant< size_t, 8 >) {
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        return Swap(x, std::integral_constant< size_t, 2 >());
+    }
+#elif defined(__ARM_NEON) && !defined(__SSSE3__)
+    static uint8x16_t Swap(uint8x16_t x,
+                           std::integral_constant< size_t, 2 >) {
+        return vrev16q_u8(x);
+    }
+    static uint8x16_t Swap(uint8x16_t x,
+                           std::integral_constant< size_t, 4 >) {
+        return vrev32q_u8(x);
+    }
+    static uint8x16_t Swap(uint8x16_t x,
+                           std::integral_constant< size_t, 8 >) {
+        return vrev64q_u8(x);
+    }
+#endif
+};
+
+//copy as is: single byte elements or little-endian host
+template< size_t N >
+void CopyLittleEndian(void* dst, const void* src, size_t n,
+                      std::true_type) {
+    if(n) memmove(dst, src, N * n);
+}
+
+template< size_t N >
+void CopyLittleEndian(void* dst, const void* src, size_t n,
+                      std::false_type) {
+    ByteSwapKernel< N >::Copy(dst, src, n);
+}
+
+//! Copy \c n elements of \c N bytes converting between host and
+//! little-endian byte order; same operation in both directions.
+template< size_t N >
+void CopyLittleEndian(void* dst, const void* src, size_t n) {
+    CopyLittleEndian< N >(dst, src, n,
+        std::integral_constant< bool, N == 1 || HOST_LITTLE_ENDIAN >());
+}
+
+}
+}
@@ -0,0 +1,150 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstddef>
+#include <stdexcept>
+
+#include <zmq.h>
+
+#include "utility.h"
+#include "Serialize.h"
+
+namespace zrf {
+
+//==============================================================================
+//Message:
+// move-only owner of a zmq frame; data is received straight into memory
+// owned by zmq and accessed in place, no copy into a ByteArray is required
+// and there is no upper limit on the received size
+//usage:
+//Message msg;
+//if(TransmissionPolicy::ReceiveMessage(socket, msg.Get(), true)) {
+//  msg.Consume(headerSize); //skip header
+//  Process(msg.Data(), msg.Size());
+//}
+class Message {
+public:
+    Message() : offset_(0) {
+        zmq_msg_init(&msg_);
+    }
+    Message(const Message&) = delete;
+    Message& operator=(const Message&) = delete;
+    Message(Message&& m) : offset_(m.offset_) {
+        zmq_msg_init(&msg_);
+        zmq_msg_move(&msg_, &m.msg_);
+        m.offset_ = 0;
+    }
+    Message& operator=(Message&& m) {
+        if(this == &m) return *this;
+        zmq_msg_move(&msg_, &m.msg_); //releases current content
+        offset_ = m.offset_;
+        m.offset_ = 0;
+        return *this;
+    }
+    ~Message() {
+        zmq_msg_close(&msg_);
+    }
+    ///Pointer to first non-consumed byte
+    const Byte* Data() const {
+        return static_cast< const Byte* >(
+            zmq_msg_data(const_cast< zmq_msg_t* >(&msg_))) + offset_;
+    }
+    ///Number of non-consumed bytes
+    size_t Size() const {
+        return zmq_msg_size(&msg_) - offset_;
+    }
+    bool Empty() const {
+        return Size() == 0;
+    }
+    ///Remove bytes from the front of the message view, used to skip headers
+    void Consume(size_t n) {
+        if(n > Size())
+            throw std::out_of_range("Message: consuming past end of frame");
+        offset_ += n;
+    }
+    ///View over non-consumed bytes, use for checked unpacking in place
+    srz::ByteView View() const {
+        return srz::ByteView(Data(), Size());
+    }
+    ///Copy non-consumed bytes into new ByteArray
+    ByteArray ToByteArray() const {
+        return ByteArray(Data(), Data() + Size());
+    }
+    ///Access to underlying zmq message: use to receive data; resets the view
+    zmq_msg_t* Get() {
+        offset_ = 0;
+        return &msg_;
+    }
+private:
+    zmq_msg_t msg_;
+    size_t offset_;
+};
+
+//Layout of messages exchanged by AsyncClient and AsyncServer:
+//| request id [timeout] | payload |
+//the request id is sent in its own frame, so that payloads are sent as
+//they are, without being copied after a header; requests can add to the
+//request id frame the time in milliseconds the client is still waiting
+//for the reply, servers discard requests not processed in time
+
+//true if more frames of a multipart message are available
+inline bool MoreFrames(void* s) {
+    int more = 0;
+    size_t moreSize = sizeof(more);
+    ZCheck(zmq_getsockopt(s, ZMQ_RCVMORE, &more, &moreSize));
+    return more != 0;
+}
+
+//discard the remaining frames of a multipart message
+inline void DiscardFrames(void* s) {
+    while(MoreFrames(s)) ZCheck(zmq_recv(s, nullptr, 0, 0));
+}
+
+//send request id frame, followed by the payload frames; the timeout is
+//only sent if positive
+inline void SendReqId(void* s, ReqId rid, int timeoutms = 0) {
+    const int header[2] = {rid, timeoutms};
+    ZCheck(zmq_send(s, header, timeoutms > 0 ? sizeof(header) : sizeof(rid),
+                    ZMQ_SNDMORE));
+}
+
+//receive request id frame; returns false if the frame is malformed or not
+//followed by a payload, in which case the rest of the multipart message
+//is discarded
+inline bool ReceiveReqId(void* s, ReqId& rid) {
+    const int rc = ZCheck(zmq_recv(s, &rid, sizeof(rid), 0));
+    if(rc == int(sizeof(rid)) && MoreFrames(s)) return true;
+    DiscardFrames(s);
+    return false;
+}
+
+//receive request id frame with optional timeout, set to zero if not
+//present; returns false if the frame is malformed or not followed by a
+//payload, in which case the rest of the multipart message is discarded
+inline bool ReceiveReqId(void* s, ReqId& rid, int& timeoutms) {
+    int header[2] = {0, 0};
+    const int rc = ZCheck(zmq_recv(s, header, sizeof(header), 0));
+    rid = header[0];
+    timeoutms = header[1];
+    const bool valid = rc == int(sizeof(rid))
+                       || (rc == int(sizeof(header)) && timeoutms > 0);
+    if(valid && MoreFrames(s)) return true;
+    DiscardFrames(s);
+    return false;
+}
+
+}
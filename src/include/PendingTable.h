@@ -0,0 +1,520 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+
+#include <zmq.h>
+
+#include "utility.h"
+#include "WaitWord.h"
+
+namespace zrf {
+
+template < typename T >
+class PendingTable;
+
+//==============================================================================
+//Completion:
+// handle to the reply of a request in a PendingTable; the reply is stored
+// in the table slot reserved for the request, which is recycled when the
+// reply is retrieved: no memory is allocated per request.
+// The reply can be waited for, polled, or passed to a callback invoked by
+// the thread which receives it.
+// Requests can fail instead, e.g. on timeout: Get() rethrows the error,
+// error callbacks receive it.
+// Completions destroyed before the reply is retrieved abandon the request:
+// the reply is dropped when received.
+//usage:
+//Completion< T > c = table.Acquire();
+//...
+//if(c.WaitFor(std::chrono::seconds(1))) Use(c.Get());
+//or:
+//c.Then([](T&& reply) { Use(reply); });
+template < typename T >
+class Completion {
+public:
+    using Callback = std::function< void (T&&) >;
+    using ErrorCallback = std::function< void (std::exception_ptr) >;
+    Completion() : table_(nullptr), rid_(0) {}
+    Completion(const Completion&) = delete;
+    Completion& operator=(const Completion&) = delete;
+    Completion(Completion&& c) : table_(c.table_), rid_(c.rid_) {
+        c.rid_ = ReqId(0);
+    }
+    Completion& operator=(Completion&& c) {
+        if(this == &c) return *this;
+        Reset();
+        table_ = c.table_;
+        rid_ = c.rid_;
+        c.rid_ = ReqId(0);
+        return *this;
+    }
+    ~Completion() {
+        Reset();
+    }
+    ///False if the table was full, or after the reply is retrieved or
+    ///passed to a callback
+    bool Valid() const {
+        return rid_ != ReqId(0);
+    }
+    ///Request id
+    ReqId Id() const {
+        return rid_;
+    }
+    ///True if the reply has been received or the request failed, does not
+    ///block
+    bool Poll() const {
+        Check();
+        return table_->Ready(rid_);
+    }
+    ///Block until the reply is received
+    void Wait() const {
+        Check();
+        table_->Wait(rid_);
+    }
+    ///Block until the reply is received or the timeout expires; returns
+    ///false on timeout
+    template < typename RepT, typename PeriodT >
+    bool WaitFor(const std::chrono::duration< RepT, PeriodT >& timeout)
+        const {
+        Check();
+        return table_->WaitFor(rid_, timeout);
+    }
+    ///Block until the reply is received then return it and release the
+    ///request; throws the error of failed requests
+    T Get() {
+        Check();
+        const ReqId rid = rid_;
+        rid_ = ReqId(0);
+        return table_->Take(rid);
+    }
+    ///Invoke callback with the reply: in the thread which completes the
+    ///request, or in the calling thread if the reply has already been
+    ///received; callbacks must not throw, and the request is released
+    ///before the callback is invoked, so that callbacks can send new
+    ///requests. The error callback, if any, is invoked instead when the
+    ///request fails
+    void Then(Callback cb, ErrorCallback onError = ErrorCallback()) {
+        Check();
+        const ReqId rid = rid_;
+        rid_ = ReqId(0);
+        table_->Then(rid, std::move(cb), std::move(onError));
+    }
+    ///Abandon request
+    void Reset() {
+        if(rid_ != ReqId(0)) table_->Release(rid_);
+        rid_ = ReqId(0);
+    }
+private:
+    friend class PendingTable< T >;
+    Completion(PendingTable< T >* table, ReqId rid)
+        : table_(table), rid_(rid) {}
+    void Check() const {
+        if(!Valid()) throw std::logic_error("Invalid completion");
+    }
+private:
+    PendingTable< T >* table_;
+    ReqId rid_;
+};
+
+//==============================================================================
+//PendingTable:
+// fixed capacity table of requests waiting for a reply, indexed by request
+// id: the id encodes the slot index in the low bits and the slot generation
+// in the high bits, so that lookups are O(1) and lock-free, and replies to
+// requests already released, e.g. abandoned by the client, are detected by
+// a generation mismatch and dropped.
+// Free slots are kept in a lock-free stack; memory is reserved once.
+// The number of pending requests can be further limited below the
+// capacity, threads waiting for free slots are notified through a WaitWord.
+//usage:
+//client thread:
+//Completion< T > c = table.Acquire(); //invalid if full
+//Send(c.Id(), request);
+//T rep = c.Get(); //releases request
+//I/O thread:
+//table.Complete(rid, std::move(reply)); //false if stale
+template < typename T >
+class PendingTable {
+    //slot life cycle: FREE -> PENDING -> COMPLETING -> DONE -> FREE;
+    //FAILED replaces DONE when the request fails;
+    //PENDING -> CONTINUATION -> COMPLETING -> FREE when a callback is set;
+    //PENDING -> FREE when released before the reply is received
+    enum Phase {FREE = 0, PENDING, CONTINUATION, COMPLETING, DONE, FAILED};
+    using Callback = typename Completion< T >::Callback;
+    using ErrorCallback = typename Completion< T >::ErrorCallback;
+    using Error = std::exception_ptr;
+    using TimePoint = std::chrono::steady_clock::time_point;
+    static const size_t VALUE_SIZE =
+        sizeof(T) > sizeof(Error) ? sizeof(T) : sizeof(Error);
+    static const size_t VALUE_ALIGN =
+        alignof(T) > alignof(Error) ? alignof(T) : alignof(Error);
+    struct Slot {
+        //generation << 3 | phase
+        std::atomic< std::uint32_t > state;
+        //next free slot
+        std::atomic< std::uint32_t > next;
+        //deadline of the request, set before the slot enters the PENDING
+        //phase
+        std::atomic< TimePoint::rep > deadline;
+        //woken up when the reply is stored
+        WaitWord done;
+        //set before the slot enters the CONTINUATION phase
+        Callback callback;
+        ErrorCallback onError;
+        //reply, constructed only in the DONE phase, or error in the FAILED
+        //phase
+        typename std::aligned_storage< VALUE_SIZE, VALUE_ALIGN >::type value;
+    };
+    static const std::uint32_t NIL = ~std::uint32_t(0);
+    static const size_t MAX_CAPACITY = size_t(1) << 24;
+    static const std::uint32_t MIN_SLOT_BITS = 2;
+public:
+    PendingTable()
+        : slotBits_(0), mask_(0), free_(Head(NIL, 0)), size_(0),
+          limit_(~size_t(0)), releaseNotify_(nullptr) {}
+    PendingTable(const PendingTable&) = delete;
+    PendingTable& operator=(const PendingTable&) = delete;
+    ///@param capacity maximum number of pending requests, rounded up to a
+    ///       power of two
+    explicit PendingTable(size_t capacity) : PendingTable() {
+        Reset(capacity);
+    }
+    ~PendingTable() {
+        Clear();
+    }
+    ///Reallocate table, not thread safe: all requests must have been
+    ///released
+    void Reset(size_t capacity) {
+        if(capacity > MAX_CAPACITY)
+            throw std::invalid_argument("PendingTable: capacity too large");
+        Clear();
+        slotBits_ = MIN_SLOT_BITS;
+        while((size_t(1) << slotBits_) < capacity) ++slotBits_;
+        mask_ = (std::uint32_t(1) << slotBits_) - 1;
+        slots_.reset(new Slot[size_t(mask_) + 1]);
+        for(std::uint32_t i = 0; i <= mask_; ++i) {
+            slots_[i].state.store(State(1, FREE), std::memory_order_relaxed);
+            slots_[i].next.store(i == mask_ ? NIL : i + 1,
+                                 std::memory_order_relaxed);
+        }
+        free_.store(Head(0, 0));
+        size_.store(0);
+    }
+    size_t Capacity() const {
+        return slots_ ? size_t(mask_) + 1 : 0;
+    }
+    ///Capacity of table created with \c Reset(capacity)
+    static size_t RoundCapacity(size_t capacity) {
+        size_t c = size_t(1) << MIN_SLOT_BITS;
+        while(c < capacity) c *= 2;
+        return c;
+    }
+    ///Number of pending requests, approximate while other threads modify
+    ///the table
+    size_t Size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+    ///Maximum number of pending requests, the capacity is used if larger;
+    ///thread safe
+    void SetLimit(size_t limit) {
+        limit_.store(limit, std::memory_order_relaxed);
+    }
+    size_t Limit() const {
+        return limit_.load(std::memory_order_relaxed);
+    }
+    ///Wake up threads waiting on \c w every time a slot is released; not
+    ///thread safe
+    void NotifyOnRelease(WaitWord* w) {
+        releaseNotify_ = w;
+    }
+    ///Reserve slot and return the completion receiving the reply, the
+    ///completion is invalid if the table is full or the limit is reached;
+    ///the deadline is only used to match timers in \c Expire; thread safe
+    Completion< T > Acquire(TimePoint deadline = TimePoint()) {
+        //reserve before popping a slot: the size never exceeds the limit
+        size_t n = size_.load(std::memory_order_relaxed);
+        do {
+            if(n >= limit_.load(std::memory_order_relaxed))
+                return Completion< T >();
+        } while(!size_.compare_exchange_weak(n, n + 1,
+                                             std::memory_order_relaxed));
+        const std::uint32_t i = Pop();
+        if(i == NIL) {
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            return Completion< T >();
+        }
+        Slot& s = slots_[i];
+        const std::uint32_t gen =
+            s.state.load(std::memory_order_relaxed) >> 3;
+        s.deadline.store(deadline.time_since_epoch().count(),
+                         std::memory_order_relaxed);
+        //release: threads which see the new generation see its deadline
+        s.state.store(State(gen, PENDING), std::memory_order_release);
+        return Completion< T >(this, ReqId((gen << slotBits_) | i));
+    }
+    ///Set reply of pending request, or invoke its callback; returns false
+    ///if the id is not the one of a pending request, e.g. released or never
+    ///acquired
+    bool Complete(ReqId rid, T&& v) {
+        return Finish(rid, &v, Error());
+    }
+    ///Fail pending request: the error is thrown by Completion::Get or passed
+    ///to the error callback; returns false if the id is not the one of a
+    ///pending request
+    bool Fail(ReqId rid, Error e) {
+        return Finish(rid, nullptr, e);
+    }
+    ///Fail pending request on timeout: as \c Fail, but only if the request
+    ///was acquired with this deadline; generations wrap around, a timer
+    ///left over by a request released long ago can match the id of a
+    ///request reusing its slot, but not its deadline
+    bool Expire(ReqId rid, TimePoint deadline, Error e) {
+        return Finish(rid, nullptr, e, &deadline);
+    }
+    ///True if the request is waiting for its reply
+    bool Pending(ReqId rid) const {
+        const Slot* s = Find(rid);
+        if(!s) return false;
+        const std::uint32_t st = s->state.load(std::memory_order_relaxed);
+        return st >> 3 == Generation(rid)
+               && ((st & 7) == PENDING || (st & 7) == CONTINUATION);
+    }
+    ///Set reply of all pending requests to T(), used to unblock clients
+    ///when stopping
+    void CompleteAll() {
+        for(std::uint32_t i = 0; slots_ && i <= mask_; ++i) {
+            const std::uint32_t st =
+                slots_[i].state.load(std::memory_order_acquire);
+            if((st & 7) == PENDING || (st & 7) == CONTINUATION)
+                Complete(ReqId(((st >> 3) << slotBits_) | i), T());
+        }
+    }
+private:
+    friend class Completion< T >;
+    //store reply if v is not null, error otherwise; if deadline is not
+    //null the request must have been acquired with the same deadline
+    bool Finish(ReqId rid, T* v, const Error& e,
+                const TimePoint* deadline = nullptr) {
+        Slot* s = Find(rid);
+        if(!s) return false;
+        const std::uint32_t gen = Generation(rid);
+        std::uint32_t st = s->state.load(std::memory_order_acquire);
+        do {
+            if(st >> 3 != gen
+               || ((st & 7) != PENDING && (st & 7) != CONTINUATION))
+                return false;
+            if(deadline && s->deadline.load(std::memory_order_relaxed)
+                           != deadline->time_since_epoch().count())
+                return false;
+        } while(!s->state.compare_exchange_weak(st, State(gen, COMPLETING),
+                                                std::memory_order_acquire));
+        if((st & 7) == CONTINUATION) {
+            Callback cb(std::move(s->callback));
+            ErrorCallback onError(std::move(s->onError));
+            s->callback = nullptr;
+            s->onError = nullptr;
+            Free(*s, gen, SlotIndex(rid));
+            if(v) cb(std::move(*v));
+            else if(onError) onError(e);
+            return true;
+        }
+        if(v) new (&s->value) T(std::move(*v));
+        else new (&s->value) Error(e);
+        s->state.store(State(gen, v ? DONE : FAILED),
+                       std::memory_order_release);
+        s->done.Wake();
+        return true;
+    }
+    //Completion interface
+    bool Ready(ReqId rid) const {
+        const std::uint32_t phase = slots_[SlotIndex(rid)].state.load(
+            std::memory_order_acquire) & 7;
+        return phase == DONE || phase == FAILED;
+    }
+    void Wait(ReqId rid) const {
+        Slot& s = slots_[SlotIndex(rid)];
+        s.done.Wait([this, rid]() { return Ready(rid); });
+    }
+    template < typename RepT, typename PeriodT >
+    bool WaitFor(ReqId rid,
+                 const std::chrono::duration< RepT, PeriodT >& timeout)
+        const {
+        Slot& s = slots_[SlotIndex(rid)];
+        return s.done.WaitFor([this, rid]() { return Ready(rid); },
+                              timeout);
+    }
+    T Take(ReqId rid) {
+        Wait(rid);
+        Slot& s = slots_[SlotIndex(rid)];
+        if((s.state.load(std::memory_order_relaxed) & 7) == FAILED) {
+            const Error e = GetError(s);
+            Release(rid);
+            std::rethrow_exception(e);
+        }
+        T v(std::move(GetValue(s)));
+        Release(rid);
+        return v;
+    }
+    void Then(ReqId rid, Callback&& cb, ErrorCallback&& onError) {
+        Slot& s = slots_[SlotIndex(rid)];
+        const std::uint32_t gen = Generation(rid);
+        //the completing thread reads the callbacks only after it sees the
+        //CONTINUATION phase
+        s.callback = std::move(cb);
+        s.onError = std::move(onError);
+        std::uint32_t st = State(gen, PENDING);
+        if(s.state.compare_exchange_strong(st, State(gen, CONTINUATION),
+                                           std::memory_order_release))
+            return;
+        //reply already received or being stored
+        Wait(rid);
+        Callback c(std::move(s.callback));
+        ErrorCallback ec(std::move(s.onError));
+        s.callback = nullptr;
+        s.onError = nullptr;
+        if((s.state.load(std::memory_order_relaxed) & 7) == FAILED) {
+            const Error e = GetError(s);
+            Release(rid);
+            if(ec) ec(e);
+            return;
+        }
+        T v(std::move(GetValue(s)));
+        Release(rid);
+        c(std::move(v));
+    }
+    //release slot after its reply has been retrieved, or to abandon the
+    //request: a reply received later is dropped
+    void Release(ReqId rid) {
+        Slot* s = Find(rid);
+        if(!s) return;
+        const std::uint32_t gen = Generation(rid);
+        std::uint32_t st = s->state.load(std::memory_order_acquire);
+        while(true) {
+            if(st >> 3 != gen) return; //not pending
+            const std::uint32_t phase = st & 7;
+            if(phase == FREE || phase == CONTINUATION) return;
+            if(phase == DONE || phase == FAILED) {
+                Destroy(*s, phase);
+                break;
+            }
+            if(phase == COMPLETING) {
+                //reply being stored
+                std::this_thread::yield();
+                st = s->state.load(std::memory_order_acquire);
+                continue;
+            }
+            //pending: replies received later are dropped
+            if(s->state.compare_exchange_weak(st, State(gen, COMPLETING),
+                                              std::memory_order_acquire))
+                break;
+        }
+        Free(*s, gen, SlotIndex(rid));
+    }
+private:
+    static std::uint32_t State(std::uint32_t gen, Phase phase) {
+        return (gen << 3) | phase;
+    }
+    std::uint32_t Generation(ReqId rid) const {
+        return std::uint32_t(rid) >> slotBits_;
+    }
+    std::uint32_t SlotIndex(ReqId rid) const {
+        return std::uint32_t(rid) & mask_;
+    }
+    //generations fill the bits of positive ids above the slot index,
+    //zero is skipped so that request ids are never 0
+    std::uint32_t NextGeneration(std::uint32_t gen) const {
+        const std::uint32_t next =
+            (gen + 1) & ((std::uint32_t(1) << (31 - slotBits_)) - 1);
+        return next ? next : 1;
+    }
+    //slot of request id received from the network
+    Slot* Find(ReqId rid) const {
+        if(rid <= 0 || !slots_) return nullptr;
+        return &slots_[SlotIndex(rid)];
+    }
+    static T& GetValue(Slot& s) {
+        return *reinterpret_cast< T* >(&s.value);
+    }
+    static Error& GetError(Slot& s) {
+        return *reinterpret_cast< Error* >(&s.value);
+    }
+    //destroy reply or error
+    static void Destroy(Slot& s, std::uint32_t phase) {
+        if(phase == DONE) GetValue(s).~T();
+        else if(phase == FAILED) GetError(s).~Error();
+    }
+    //return slot to the free stack with the next generation, then make it
+    //available to Acquire
+    void Free(Slot& s, std::uint32_t gen, std::uint32_t i) {
+        s.state.store(State(NextGeneration(gen), FREE),
+                      std::memory_order_relaxed);
+        Push(i);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        if(releaseNotify_) releaseNotify_->Wake(true);
+    }
+    //free slot stack: head is index | tag << 32, the tag changes at each
+    //update to prevent ABA
+    static std::uint64_t Head(std::uint32_t index, std::uint32_t tag) {
+        return std::uint64_t(index) | (std::uint64_t(tag) << 32);
+    }
+    std::uint32_t Pop() {
+        std::uint64_t h = free_.load(std::memory_order_acquire);
+        while(true) {
+            const std::uint32_t i = std::uint32_t(h);
+            if(i == NIL) return NIL;
+            const std::uint32_t next =
+                slots_[i].next.load(std::memory_order_relaxed);
+            if(free_.compare_exchange_weak(
+                   h, Head(next, std::uint32_t(h >> 32) + 1),
+                   std::memory_order_acquire))
+                return i;
+        }
+    }
+    void Push(std::uint32_t i) {
+        std::uint64_t h = free_.load(std::memory_order_relaxed);
+        do {
+            slots_[i].next.store(std::uint32_t(h), std::memory_order_relaxed);
+        } while(!free_.compare_exchange_weak(
+                    h, Head(i, std::uint32_t(h >> 32) + 1),
+                    std::memory_order_release));
+    }
+    //destroy replies and errors not retrieved
+    void Clear() {
+        for(std::uint32_t i = 0; slots_ && i <= mask_; ++i)
+            Destroy(slots_[i], slots_[i].state.load() & 7);
+        slots_.reset();
+    }
+private:
+    std::unique_ptr< Slot[] > slots_;
+    std::uint32_t slotBits_;
+    std::uint32_t mask_;
+    std::atomic< std::uint64_t > free_;
+    std::atomic< size_t > size_;
+    std::atomic< size_t > limit_;
+    WaitWord* releaseNotify_;
+};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "SyncQueue.h"
+#include "RingQueue.h"
+
+namespace zrf {
+
+//Queue policies: select the queues used to exchange data between I/O
+//threads and workers or client threads.
+//MPMCQueue: multiple producers, multiple consumers
+//MPSCQueue: multiple producers, single consumer
+//Full(queue) returns true if a push would block; the I/O threads stop
+//receiving from the socket instead of blocking on a full queue, leaving
+//the messages queued in zmq.
+//Capacity(queue) returns the maximum number of queued elements, 0 if
+//unbounded; used to bound other queues fed by the same I/O thread.
+
+//mutex + condition variable, unbounded
+struct SyncQueuePolicy {
+    template < typename T >
+    using MPMCQueue = SyncQueue< T >;
+    template < typename T >
+    using MPSCQueue = SyncQueue< T >;
+    template < typename QueueT >
+    static bool Full(const QueueT&) {
+        return false;
+    }
+    template < typename QueueT >
+    static size_t Capacity(const QueueT&) {
+        return 0;
+    }
+};
+
+//lock-free bounded rings, push blocks when full
+struct RingQueuePolicy {
+    template < typename T >
+    using MPMCQueue = MPMCRingQueue< T >;
+    template < typename T >
+    using MPSCQueue = MPSCRingQueue< T >;
+    template < typename QueueT >
+    static bool Full(const QueueT& q) {
+        return q.Full();
+    }
+    template < typename QueueT >
+    static size_t Capacity(const QueueT& q) {
+        return q.Capacity();
+    }
+};
+
+}
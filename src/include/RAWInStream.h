@@ -26,7 +26,7 @@
 
 #include <zmq.h>
 
-#include "SyncQueue.h"
+#include "QueuePolicy.h"
 #include "Serialize.h"
 #include "utility.h"
 
@@ -78,11 +78,21 @@ struct SizeInfoReceivePolicy {
 };
 
 
-template < typename ReceivePolicyT = NoSizeInfoReceivePolicy >
+//QueuePolicyT selects the queue between the I/O thread and the thread
+//running Loop: SyncQueuePolicy or RingQueuePolicy; with bounded queues
+//the I/O thread waits for Loop to catch up when the queue is full
+//EncodingT is the wire encoding of data unpacked by LoopArgs, it must match
+//the encoding of the sending RAWOutStream: messages with the header of
+//another encoding, or without header if not raw, are discarded
+template < typename ReceivePolicyT = NoSizeInfoReceivePolicy,
+           typename QueuePolicyT = SyncQueuePolicy,
+           typename EncodingT = srz::RawEncoding >
 class RAWInStream {
 public:
     enum Status {STARTED = 0x1, STOPPED=0x2, TIMED_OUT = 0x4};
     using ReceivePolicy = ReceivePolicyT;
+    using QueuePolicy = QueuePolicyT;
+    using Encoding = EncodingT;
     RAWInStream() : stop_(false), status_(STOPPED) {}
     RAWInStream(const RAWInStream&) = delete;
     RAWInStream(RAWInStream&&) = default;
@@ -104,11 +114,21 @@ public:
     bool LoopArgs(const CallbackT& cback) {
         while(!stop_) {
             ByteArray buf(queue_.Pop());
-            std::tuple< ArgsT... > args = srz::UnPackTuple< ArgsT... >(buf);
-            if(!stop_) {
-                if(!CallF< bool >(cback, args))
-                    break;
+            if(stop_) break;
+            srz::ByteView v(buf);
+            std::tuple< ArgsT... > args;
+            const srz::UnPackStatus st =
+                srz::UnPackMessageTupleWith< Encoding >(v, args);
+            if(st == srz::UNPACK_FORMAT_MISMATCH) {
+                Log("instream>> data with another encoding discarded");
+                continue;
             }
+            if(st != srz::UNPACK_OK) {
+                Log("instream>> malformed data discarded");
+                continue;
+            }
+            if(!CallF< bool >(cback, args))
+                break;
         }
         return !TimedOut();
     }
@@ -231,7 +251,7 @@ private:
     }
 private:
     enum {URI = 0, BUFSIZE = 1, TIMEOUT = 2};
-    SyncQueue< ByteArray > queue_;
+    typename QueuePolicy::template MPSCQueue< ByteArray > queue_;
     std::future< void > taskFuture_;
     bool stop_ = false;
     int status_;
@@ -28,7 +28,7 @@
 
 #include <zmq.h>
 
-#include "SyncQueue.h"
+#include "QueuePolicy.h"
 #include "utility.h"
 #include "Serialize.h"
 
@@ -56,10 +56,23 @@ struct SizeInfoSendPolicy {
     }
 };
 
-template< typename SendPolicyT = NoSizeInfoSendPolicy >
+//QueuePolicyT selects the queue between sending threads and the I/O
+//thread: SyncQueuePolicy or RingQueuePolicy; with bounded queues Send
+//blocks when the queue is full
+//EncodingT is the wire encoding of data sent through SendArgs, e.g.
+//srz::CompactEncoding to shrink small messages; the receiving RAWInStream
+//must use the same encoding, messages other than raw start with a header
+//identifying it, see srz::PackMessageWith; with srz::TaggedEncoding fields
+//can be added to ZRF_SERIALIZABLE message types without upgrading all
+//subscribers
+template< typename SendPolicyT = NoSizeInfoSendPolicy,
+          typename QueuePolicyT = SyncQueuePolicy,
+          typename EncodingT = srz::RawEncoding >
 class RAWOutStream : SendPolicyT {
 public:
     using SendPolicy = SendPolicyT;
+    using QueuePolicy = QueuePolicyT;
+    using Encoding = EncodingT;
     enum Status { STARTED, STOPPED };
     RAWOutStream() : status_(STOPPED), stop_(false) {}
     RAWOutStream(const RAWOutStream&) = delete;
@@ -72,7 +85,7 @@ public:
     }
     template< typename...ArgsT >
     void SendArgs(const ArgsT& ...args) {
-        Send(srz::PackArgs(args...));
+        Send(srz::PackMessageWith< Encoding >(args...));
     }
     template< typename FwdT >
     void Buffer(FwdT begin, FwdT end) {
@@ -151,7 +164,7 @@ private:
         return std::make_tuple(nullptr, nullptr);
     };
 private:
-    SyncQueue< ByteArray > queue_;
+    typename QueuePolicy::template MPSCQueue< ByteArray > queue_;
     std::future< void > taskFuture_;
     Status status_;
     bool stop_;
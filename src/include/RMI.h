@@ -20,15 +20,27 @@
 #include <iterator>
 #include <vector>
 #include <map>
+#include <deque>
+#include <algorithm>
 #include <future>
 #include <thread>
+#include <chrono>
+#include <exception>
 #include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <atomic>
 #include <zmq.h>
 #include <functional>
+#include <type_traits>
+#include <new>
 
 #include "Serialize.h"
 #include "SyncQueue.h"
 #include "utility.h"
+#include "Reactor.h"
+#include "Message.h"
+#include "TimerWheel.h"
 
 //Xlib confict
 #ifdef Status
@@ -47,6 +59,11 @@ using ByteArray = srz::ByteArray;
 //! Method:
 struct IMethod {
     virtual ByteArray Invoke(const ByteArray& args) = 0;
+    //invoked by Service with a view over the received frame; the default
+    //implementation copies the arguments into a ByteArray
+    virtual ByteArray Invoke(srz::ByteView args) {
+        return Invoke(ByteArray(args.Data(), args.Data() + args.Size()));
+    }
     virtual IMethod* Clone() const = 0;
     //vector< string > Signature() const = 0; todo add signature
     //string Description() const = 0; todo add description
@@ -54,6 +71,7 @@ struct IMethod {
 };
 
 struct EmptyMethod : IMethod {
+    using IMethod::Invoke;
     ByteArray Invoke(const ByteArray& ) {
         throw std::invalid_argument("Method not implemented");
         return ByteArray();
@@ -70,10 +88,12 @@ public:
     Method(const Method&) = default;
     Method* Clone() const { return new Method< R, ArgsT... >(*this); }
     ByteArray Invoke(const ByteArray& args) {
-        //std::tuple< typename RemoveAll< ArgsT >::Type... > params =
-        std::tuple< ArgsT... >
-        params = srz::UnPack< std::tuple
-            < typename RemoveAll< ArgsT >::Type... > >(begin(args));
+        return Invoke(srz::ByteView(args));
+    }
+    ByteArray Invoke(srz::ByteView args) {
+        std::tuple< ArgsT... > params;
+        if(srz::UnPack(args, params) != srz::UNPACK_OK)
+            throw std::invalid_argument("Malformed method arguments");
         R ret = MoveCall(f_, std::move(params));
         return srz::Pack(ret);
     }
@@ -89,11 +109,12 @@ public:
     Method(const Method&) = default;
     Method* Clone() const { return new Method< void, ArgsT... >(*this); }
     ByteArray Invoke(const ByteArray& args) {
-        //std::tuple< typename RemoveAll< ArgsT >::Type... > params =
-        std::tuple< ArgsT... >
-            params = srz::UnPack< std::tuple
-                                 < typename
-                                   RemoveAll< ArgsT >::Type... > >(begin(args));
+        return Invoke(srz::ByteView(args));
+    }
+    ByteArray Invoke(srz::ByteView args) {
+        std::tuple< ArgsT... > params;
+        if(srz::UnPack(args, params) != srz::UNPACK_OK)
+            throw std::invalid_argument("Malformed method arguments");
         MoveCall(f_, std::move(params));
         return ByteArray();
     }
@@ -109,6 +130,7 @@ public:
     Method(const std::function< R () >& f) : f_(f) {}
     Method(const Method&) = default;
     Method* Clone() const { return new Method< R >(*this); }
+    using IMethod::Invoke;
     ByteArray Invoke(const ByteArray&) {
         R ret = f_();
         return srz::Pack(ret);
@@ -124,6 +146,7 @@ public:
     Method(const std::function< void () >& f) : f_(f) {}
     Method(const Method&) = default;
     Method* Clone() const { return new Method< void >(*this); }
+    using IMethod::Invoke;
     ByteArray Invoke(const ByteArray&) {
         f_();
         return ByteArray();
@@ -132,29 +155,193 @@ private:
     std::function< void () > f_;
 };
 
-class MethodImpl {
+//type erased method: callable receiving a view over the packed arguments
+//and returning the packed result; callables up to BUFFER_SIZE bytes, such
+//as lambdas with a few captures or std::function objects, are stored in
+//place, and copying an Invoker copies the callable without allocating
+class Invoker {
 public:
-    MethodImpl() : method_(new EmptyMethod) {}
-    MethodImpl(IMethod* pm) : method_(pm) {}
-    MethodImpl(const MethodImpl& mi) :
-        method_(mi.method_ ? mi.method_->Clone() : nullptr) {}
-    MethodImpl& operator=(const MethodImpl& mi) {
-        method_.reset(mi.method_->Clone());
+    enum {BUFFER_SIZE = 4 * sizeof(void*)};
+    Invoker() = default;
+    template < typename F,
+               typename = typename std::enable_if< !std::is_same<
+                   typename RemoveAll< F >::Type, Invoker >::value >::type >
+    explicit Invoker(F&& f) {
+        Init< typename RemoveAll< F >::Type >(std::forward< F >(f));
+    }
+    Invoker(const Invoker& i) {
+        if(i.ops_) i.ops_->copy(i, *this);
+    }
+    Invoker& operator=(const Invoker& i) {
+        if(this == &i) return *this;
+        Reset();
+        if(i.ops_) i.ops_->copy(i, *this);
         return *this;
     }
+    ~Invoker() {
+        Reset();
+    }
+    explicit operator bool() const { return ops_ != nullptr; }
+    ///Single indirect call into the stored callable
+    ByteArray operator()(srz::ByteView args) const {
+        return invoke_(object_, args);
+    }
+private:
+    struct Ops {
+        void (*copy)(const Invoker&, Invoker&);
+        void (*destroy)(Invoker&);
+    };
+    //callables stored in the buffer
+    template < typename F >
+    struct Local {
+        static ByteArray Invoke(void* f, srz::ByteView args) {
+            return (*static_cast< F* >(f))(args);
+        }
+        static void Copy(const Invoker& from, Invoker& to) {
+            to.object_ = new (&to.buffer_) F(*static_cast< F* >(from.object_));
+            to.invoke_ = from.invoke_;
+            to.ops_ = from.ops_;
+        }
+        static void Destroy(Invoker& i) {
+            static_cast< F* >(i.object_)->~F();
+        }
+        static const Ops* Get() {
+            static const Ops ops = {&Copy, &Destroy};
+            return &ops;
+        }
+    };
+    //larger or over-aligned callables, allocated on the heap
+    template < typename F >
+    struct Remote {
+        static void Copy(const Invoker& from, Invoker& to) {
+            to.object_ = new F(*static_cast< F* >(from.object_));
+            to.invoke_ = from.invoke_;
+            to.ops_ = from.ops_;
+        }
+        static void Destroy(Invoker& i) {
+            delete static_cast< F* >(i.object_);
+        }
+        static const Ops* Get() {
+            static const Ops ops = {&Copy, &Destroy};
+            return &ops;
+        }
+    };
+    template < typename F, typename FwdF >
+    void Init(FwdF&& f) {
+        using Storage = typename std::aligned_storage< BUFFER_SIZE >::type;
+        const bool local = sizeof(F) <= sizeof(Storage)
+                           && alignof(Storage) % alignof(F) == 0;
+        if(local) {
+            object_ = new (&buffer_) F(std::forward< FwdF >(f));
+            ops_ = Local< F >::Get();
+        } else {
+            object_ = new F(std::forward< FwdF >(f));
+            ops_ = Remote< F >::Get();
+        }
+        invoke_ = &Local< F >::Invoke;
+    }
+    void Reset() {
+        if(ops_) ops_->destroy(*this);
+        ops_ = nullptr;
+        object_ = nullptr;
+    }
+    static ByteArray Empty(void*, srz::ByteView) {
+        throw std::invalid_argument("Method not implemented");
+    }
+    ByteArray (*invoke_)(void*, srz::ByteView) = &Empty;
+    void* object_ = nullptr;
+    const Ops* ops_ = nullptr;
+    typename std::aligned_storage< BUFFER_SIZE >::type buffer_;
+};
+
+//unpacks the arguments, calls f and packs the returned value
+template < typename F, typename R, typename ArgsTupleT >
+struct TypedMethod;
+
+template < typename F, typename R, typename...ArgsT >
+struct TypedMethod< F, R, std::tuple< ArgsT... > > {
+    F f;
+    ByteArray operator()(srz::ByteView args) {
+        std::tuple< ArgsT... > params;
+        if(srz::UnPack(args, params) != srz::UNPACK_OK)
+            throw std::invalid_argument("Malformed method arguments");
+        return srz::Pack(MoveCallF< R >(f, std::move(params)));
+    }
+};
+
+template < typename F, typename...ArgsT >
+struct TypedMethod< F, void, std::tuple< ArgsT... > > {
+    F f;
+    ByteArray operator()(srz::ByteView args) {
+        std::tuple< ArgsT... > params;
+        if(srz::UnPack(args, params) != srz::UNPACK_OK)
+            throw std::invalid_argument("Malformed method arguments");
+        MoveCallF< void >(f, std::move(params));
+        return ByteArray();
+    }
+};
+
+//no arguments: received data is ignored
+template < typename F, typename R >
+struct TypedMethod< F, R, std::tuple<> > {
+    F f;
+    ByteArray operator()(srz::ByteView) {
+        return srz::Pack(f());
+    }
+};
+
+template < typename F >
+struct TypedMethod< F, void, std::tuple<> > {
+    F f;
+    ByteArray operator()(srz::ByteView) {
+        f();
+        return ByteArray();
+    }
+};
+
+//IMethod instances, cloned when copied
+class IMethodPtr {
+public:
+    IMethodPtr(IMethod* pm) : method_(pm) {}
+    IMethodPtr(const IMethodPtr& p) :
+        method_(p.method_ ? p.method_->Clone() : nullptr) {}
+    ByteArray operator()(srz::ByteView args) {
+        if(!method_) throw std::invalid_argument("Method not implemented");
+        return method_->Invoke(args);
+    }
+private:
+    std::unique_ptr< IMethod > method_;
+};
+
+class MethodImpl {
+public:
+    MethodImpl() = default;
+    MethodImpl(IMethod* pm) : invoker_(IMethodPtr(pm)) {}
     template < typename R, typename...ArgsT >
     MethodImpl(const Method< R, ArgsT... >& m)
-        : method_(new Method< R, ArgsT... >(m)) {}
+        : MethodImpl(new Method< R, ArgsT... >(m)) {}
     template < typename R, typename...ArgsT >
     MethodImpl(const std::function< R (ArgsT...) >& f)
-        : MethodImpl(Method< R, typename RemoveAll< ArgsT >::Type...>(f))
+        : invoker_(TypedMethod< std::function< R (ArgsT...) >, R,
+                   std::tuple< typename RemoveAll< ArgsT >::Type... > >{f})
     {};
-
-    ByteArray Invoke(const ByteArray& args) {
-        return method_->Invoke(args);
+    ///Statically typed method: f is called directly, with the signature
+    ///deduced from its operator() or function type
+    template < typename F >
+    static MethodImpl Bind(F f) {
+        using Traits = CallableTraits< F >;
+        return MethodImpl(Invoker(TypedMethod< F, typename Traits::Return,
+                                  typename Traits::Args >{std::move(f)}));
+    }
+    ByteArray Invoke(const ByteArray& args) const {
+        return invoker_(srz::ByteView(args));
+    }
+    ByteArray Invoke(srz::ByteView args) const {
+        return invoker_(args);
     }
 private:
-    std::unique_ptr< IMethod > method_;
+    explicit MethodImpl(Invoker&& i) : invoker_(std::move(i)) {}
+    Invoker invoker_;
 };
 
 //==============================================================================
@@ -164,88 +351,490 @@ private:
 //! \todo remove ServiceImpl and move methods into Service
 ////Actual service implementation
 
+//Method table: frozen copy of the methods registered with a service, built
+//when the service starts. Method ids are usually small dense enums and are
+//used as indices into a flat array; sparse or negative ids are looked up
+//in an open addressing hash table. Lookups never allocate.
+class MethodTable {
+public:
+    struct Entry {
+        int id;
+        MethodImpl* method;
+        int maxConcurrency;
+    };
+    ///Build table; methods must not be added to or removed from the map
+    ///while the table is in use
+    void Build(std::map< int, MethodImpl >& methods,
+               const std::map< int, int >& concurrency) {
+        entries_.clear();
+        for(auto& m: methods) {
+            std::map< int, int >::const_iterator c = concurrency.find(m.first);
+            entries_.push_back(
+                {m.first, &m.second, c == concurrency.end() ? 0 : c->second});
+        }
+        //ids are sorted: dense if all the ids fit into a small array
+        const int maxId = entries_.empty() ? -1 : entries_.back().id;
+        dense_ = entries_.empty() || (entries_.front().id >= 0
+            && size_t(maxId) < std::max(size_t(64), 4 * entries_.size()));
+        size_t size = dense_ ? size_t(maxId + 1) : 2 * entries_.size();
+        if(!dense_) {
+            size_t s = 1;
+            while(s < size) s <<= 1;
+            size = s;
+        }
+        index_.assign(size, -1);
+        mask_ = size - 1;
+        for(size_t e = 0; e != entries_.size(); ++e) {
+            size_t i = dense_ ? size_t(entries_[e].id)
+                              : Hash(entries_[e].id) & mask_;
+            while(index_[i] >= 0) i = (i + 1) & mask_;
+            index_[i] = int(e);
+        }
+    }
+    ///Index of method in table, -1 if not found
+    int Find(int id) const {
+        if(dense_)
+            return unsigned(id) < index_.size() ? index_[unsigned(id)] : -1;
+        for(size_t i = Hash(id) & mask_;; i = (i + 1) & mask_) {
+            const int e = index_[i];
+            if(e < 0 || entries_[e].id == id) return e;
+        }
+    }
+    const Entry& operator[](int i) const { return entries_[i]; }
+    size_t Size() const { return entries_.size(); }
+private:
+    static size_t Hash(int id) {
+        const std::uint32_t h = std::uint32_t(id) * 0x9E3779B1u;
+        return size_t(h ^ (h >> 16));
+    }
+    std::vector< Entry > entries_;
+    std::vector< int > index_;
+    bool dense_ = true;
+    size_t mask_ = 0;
+};
+
 //Service
-enum {SERVICE_ERROR = -1, SERVICE_NO_ERROR = 0};
+//Layout of messages exchanged by ServiceProxy and Service:
+//request: | method id [call id [timeout]] | [arguments] |
+//reply:   | status [call id] | result or error message |
+//clients sending more than one request at a time add a call id to the
+//method id frame, services echo it in the reply status frame; clients
+//with a single outstanding request, like REQ sockets, need no call id
+//batch request: | BATCH_REQUEST call id flags [timeout] | method id |
+//               | arguments |...
+//batch reply:   | status [call id] | status | result or error message |...
+//calls in a batch are executed in order, one at a time, unless the
+//BATCH_PARALLEL flag is set
+//timeout is the time in milliseconds the client waits for the reply, only
+//sent if positive; services turn it into a deadline when the request is
+//received and drop calls not started before the deadline, without
+//replying: the client is not waiting anymore
+enum {SERVICE_ERROR = -1, SERVICE_NO_ERROR = 0, NO_CALL_ID = -1};
+enum {BATCH_REQUEST = INT_MIN, BATCH_PARALLEL = 0x1};
 class Service {
+    using Clock = std::chrono::steady_clock;
 public:
     enum Status {STOPPED, STARTED};
+    //maximum number of concurrent invocations of a method when requests are
+    //dispatched to worker threads, methods which are not thread safe must
+    //be SERIALIZED
+    enum Concurrency {UNLIMITED = 0, SERIALIZED = 1};
 public:
     Service() = default;
-    Service(const std::string& URI)
-        : status_(STOPPED), uri_(URI) {}
+    //numThreads is the number of worker threads invoking methods; with zero
+    //methods are invoked in the thread receiving the requests
+    Service(const std::string& URI, int numThreads = 0)
+        : status_(STOPPED), uri_(URI), numThreads_(numThreads) {}
+    //each instance owns its own reactor, queues and method table: not
+    //copied
+    Service(const Service& s)
+        : uri_(s.uri_), status_(s.status_), methods_(s.methods_),
+          concurrency_(s.concurrency_), numThreads_(s.numThreads_) {}
+    Service& operator=(const Service& s) {
+        uri_ = s.uri_;
+        status_ = s.status_;
+        methods_ = s.methods_;
+        concurrency_ = s.concurrency_;
+        numThreads_ = s.numThreads_;
+        return *this;
+    }
     Status GetStatus() const  { return status_; }
     std::string GetURI() const {
         return uri_;
     }
-    void Add(int id, const MethodImpl& mi) {
+    ///Number of worker threads used by the next call to Start()
+    void SetNumThreads(int numThreads) {
+        numThreads_ = numThreads;
+    }
+    int GetNumThreads() const { return numThreads_; }
+    ///maxConcurrency: UNLIMITED, SERIALIZED or any positive number, only
+    ///used when running worker threads
+    void Add(int id, const MethodImpl& mi, int maxConcurrency = UNLIMITED) {
         methods_[id] = mi;
+        concurrency_[id] = maxConcurrency;
     }
     template < typename R, typename...ArgsT >
-    void Add(int id, const std::function< R (ArgsT...) >& f) {
-        Add(id, MethodImpl(f));
+    void Add(int id, const std::function< R (ArgsT...) >& f,
+             int maxConcurrency = UNLIMITED) {
+        Add(id, MethodImpl(f), maxConcurrency);
     };
+    ///Statically typed registration, the signature is deduced from the
+    ///callable: Add(SUM, [](int i1, int i2) { return i1 + i2; })
+    template < typename F, typename = typename std::enable_if<
+                   !std::is_convertible< F, MethodImpl >::value >::type >
+    void Add(int id, F f, int maxConcurrency = UNLIMITED) {
+        Add(id, MethodImpl::Bind(std::move(f)), maxConcurrency);
+    }
+    void SetConcurrency(int id, int maxConcurrency) {
+        concurrency_[id] = maxConcurrency;
+    }
+    //direct invocation, requests received by Start() are dispatched through
+    //the method table
     ByteArray Invoke(int reqid, const ByteArray& args) {
-        return methods_[reqid].Invoke(args);
+        return Find(reqid).Invoke(args);
     }
-    void Start(size_t bufferSize = 0x100000, int timeoutms = 2) {
+    //timeoutms is the maximum time spent waiting for requests, the default
+    //(-1) is to sleep until a request is received or Stop() is called;
+    //with worker threads replies are sent as soon as methods return, not in
+    //the order requests are received; the buffer size parameter is ignored
+    //and kept for compatibility
+    void Start(size_t /*bufferSize*/ = 0x100000, int timeoutms = -1) {
         void* ctx = ZCheck(zmq_ctx_new());
         void* r = ZCheck(zmq_socket(ctx, ZMQ_ROUTER));
         ZCheck(zmq_bind(r, uri_.c_str()));
-        zmq_pollitem_t items[] = { { r, 0, ZMQ_POLLIN, 0 } };
-        int reqid = -1;
-        ByteArray args(bufferSize); ///@todo configurable buffer size
-        ByteArray rep;
-        std::vector< char > id(10, char(0));
+        //arguments are unpacked in place from the received frame, no
+        //buffer is allocated; methods taking srz::ArrayView or
+        //srz::StringView arguments access the frame data directly, views
+        //are valid until the method returns
+        table_.Build(methods_, concurrency_);
+        slots_ = std::vector< Slot >(table_.Size());
+        //error reply for unknown methods, sent without allocating
+        notImplemented_ = srz::Pack(std::string("Method not implemented"));
+        Call call;
+        Result result;
+        Batch batch;
+        std::vector< std::future< void > > workers;
+        for(int i = 0; i < numThreads_; ++i)
+            workers.push_back(
+                std::async(std::launch::async, &Service::Work, this));
         status_ = STARTED;
         while(status_ != STOPPED) {
-            ZCheck(zmq_poll(items, 1, timeoutms)); //poll with 20ms timeout
-            if(items[0].revents & ZMQ_POLLIN) {
-                const int irc = ZCheck(zmq_recv(r, &id[0], id.size(), 0));
-                ZCheck(zmq_recv(r, 0, 0, 0));
-                int rc = ZCheck(zmq_recv(r, &reqid, sizeof(int), 0));
-                Log("service>> request id: " + std::to_string(reqid));
-                int64_t more = 0;
-                size_t moreSize = sizeof(more);
-                rc = ZCheck(zmq_getsockopt(r, ZMQ_RCVMORE, &more, &moreSize));
-                try {
-                    if(!more) rep = methods_[reqid].Invoke(ByteArray());
-                    else {
-                        rc = ZCheck(zmq_recv(r, args.data(), args.size(), 0));
-                        Log("service>> request data received");
-                        rep = methods_[reqid].Invoke(args);
-                        Log("service>> request executed");
-                    }
-                    ZCheck(zmq_send(r, &id[0], size_t(irc), ZMQ_SNDMORE));
-                    ZCheck(zmq_send(r, 0, 0, ZMQ_SNDMORE));
-                    int okStatus = SERVICE_NO_ERROR;
-                    ZCheck(zmq_send(r, &okStatus, sizeof(okStatus),
-                                    ZMQ_SNDMORE));
-                    ZCheck(zmq_send(r, rep.data(), rep.size(), 0));
-                    Log("service>> reply sent");
-                } catch(const std::exception& e) {
-                    const std::string msg = e.what();
-                    Log("service>> exception: " + std::string(e.what()));
-                    ZCheck(zmq_send(r, &id[0], size_t(irc), ZMQ_SNDMORE));
-                    ZCheck(zmq_send(r, 0, 0, ZMQ_SNDMORE));
-                    int errorStatus = SERVICE_ERROR;
-                    ZCheck(zmq_send(r, &errorStatus, sizeof(errorStatus),
-                                    ZMQ_SNDMORE));
-                    rep = srz::Pack(msg);
-                    ZCheck(zmq_send(r, rep.data(), rep.size(), 0));
-                }
+            if(reactor_.Wait(r, timeoutms) & Reactor::READABLE) {
+                if(Receive(r, call, batch)) {
+                    if(workers.empty()) ExecuteBatch(r, batch);
+                    else ScheduleBatch(r, std::move(batch));
+                } else if(call.method < 0) {
+                    SendReply(r, call.id, call.callId, SERVICE_ERROR,
+                              notImplemented_);
+                } else if(workers.empty()) {
+                    Execute(call, result);
+                    if(!result.expired)
+                        SendReply(r, call.id, call.callId, result.status,
+                                  result.rep);
+                } else Schedule(std::move(call));
+            }
+            while(!results_.Empty()) {
+                Result res = results_.Pop();
+                Release(res.method);
+                if(res.batch >= 0) Complete(r, std::move(res));
+                else if(!res.expired)
+                    SendReply(r, res.id, res.callId, res.status, res.rep);
             }
         }
+        //requests not yet executed and replies not yet sent are discarded
+        while(!calls_.Empty()) calls_.Pop();
+        for(size_t i = 0; i != workers.size(); ++i) calls_.Push(Call());
+        for(auto& w: workers) w.get();
+        while(!results_.Empty()) results_.Pop();
+        slots_.clear();
+        batches_.clear();
         ZCleanup(ctx, r);
         Log("service>> " + uri_ + " stopped");
     }
-    void Stop() { status_ = STOPPED; } //invoke from separate thread
+    void Stop() { //invoke from separate thread
+        status_ = STOPPED;
+        reactor_.Notify();
+    }
+    ///Number of calls dropped because their deadline expired before they
+    ///were started, thread safe
+    std::uint64_t ExpiredCalls() const {
+        return expired_.load(std::memory_order_relaxed);
+    }
+private:
+    //request received from client identified by id, method is the index in
+    //the method table or -1 if not found; calls in a batch store the batch
+    //key and their position in the batch; a call without a method stops
+    //the worker receiving it; deadline is Clock::time_point() if the
+    //client sent no timeout
+    struct Call {
+        std::vector< char > id;
+        int method = -1;
+        int callId = NO_CALL_ID;
+        Message args;
+        int batch = -1;
+        int position = 0;
+        Clock::time_point deadline;
+    };
+    //expired results are not sent
+    struct Result {
+        std::vector< char > id;
+        int method = -1;
+        int callId = NO_CALL_ID;
+        int status = SERVICE_NO_ERROR;
+        ByteArray rep;
+        int batch = -1;
+        int position = 0;
+        bool expired = false;
+    };
+    //calls received in a single request, replied to with a single reply
+    //when all of them are completed; once a call expires the calls not
+    //yet started are dropped and no reply is sent
+    struct Batch {
+        std::vector< char > id;
+        int callId = NO_CALL_ID;
+        bool parallel = false;
+        Clock::time_point deadline;
+        bool expired = false;
+        std::vector< Call > calls;
+        std::vector< Result > results;
+        size_t next = 0; //next call to execute
+        size_t remaining = 0; //calls not completed
+    };
+    //calls being executed and calls waiting for a method to be available,
+    //accessed by the thread receiving the requests only
+    struct Slot {
+        int running = 0;
+        std::deque< Call > backlog;
+    };
 private:
+    //receive client id, empty frame, method id with optional call id and
+    //timeout and optional arguments; returns true if a batch is received
+    //into b
+    bool Receive(void* r, Call& c, Batch& b) {
+        char id[10];
+        const int irc = ZCheck(zmq_recv(r, id, sizeof(id), 0));
+        c.id.assign(id, id + std::min(irc, int(sizeof(id))));
+        ZCheck(zmq_recv(r, 0, 0, 0));
+        int header[4] = {-1, NO_CALL_ID, 0, 0};
+        const int rc = ZCheck(zmq_recv(r, header, sizeof(header), 0));
+        Log("service>> request id: " + std::to_string(header[0]));
+        if(header[0] == BATCH_REQUEST
+           && (rc == 3 * sizeof(int)
+               || (rc == sizeof(header) && header[3] > 0))) {
+            b.id = c.id;
+            b.callId = header[1];
+            b.parallel = (header[2] & BATCH_PARALLEL) != 0;
+            b.deadline = Deadline(rc == sizeof(header) ? header[3] : 0);
+            ReceiveBatch(r, b);
+            return true;
+        }
+        const bool valid = rc == sizeof(int) || rc == 2 * sizeof(int)
+                           || (rc == 3 * sizeof(int) && header[2] > 0);
+        c.method = valid ? table_.Find(header[0]) : -1;
+        c.callId = valid && rc > int(sizeof(int)) ? header[1]
+                                                   : int(NO_CALL_ID);
+        c.deadline = Deadline(rc == 3 * sizeof(int) ? header[2] : 0);
+        if(MoreFrames(r)) {
+            ZCheck(zmq_msg_recv(c.args.Get(), r, 0));
+            Log("service>> request data received");
+        } else c.args = Message();
+        DiscardFrames(r);
+        return false;
+    }
+    //deadline measured from reception: no clock synchronization with the
+    //client required
+    static Clock::time_point Deadline(int timeoutms) {
+        return timeoutms > 0
+               ? Clock::now() + std::chrono::milliseconds(timeoutms)
+               : Clock::time_point();
+    }
+    //receive method id and arguments frame pairs
+    void ReceiveBatch(void* r, Batch& b) {
+        b.calls.clear();
+        b.results.clear();
+        b.expired = false;
+        while(MoreFrames(r)) {
+            Call c;
+            c.deadline = b.deadline;
+            int method = -1;
+            const int rc = ZCheck(zmq_recv(r, &method, sizeof(method), 0));
+            c.method = rc == sizeof(method) ? table_.Find(method) : -1;
+            if(MoreFrames(r)) ZCheck(zmq_msg_recv(c.args.Get(), r, 0));
+            c.position = int(b.calls.size());
+            b.calls.push_back(std::move(c));
+        }
+        b.results.resize(b.calls.size());
+        b.next = 0;
+        b.remaining = b.calls.size();
+        Log("service>> batch of " + std::to_string(b.calls.size())
+            + " calls received");
+    }
+    //exceptions thrown by methods are returned to the client as an error
+    //status followed by the error message; calls past their deadline are
+    //not executed
+    void Execute(const Call& c, Result& res) {
+        res.method = c.method;
+        res.callId = c.callId;
+        res.batch = c.batch;
+        res.position = c.position;
+        res.expired = c.deadline != Clock::time_point()
+                      && Clock::now() > c.deadline;
+        if(res.expired) {
+            expired_.fetch_add(1, std::memory_order_relaxed);
+            Log("service>> expired call dropped");
+            return;
+        }
+        if(c.method < 0) {
+            res.status = SERVICE_ERROR;
+            res.rep = notImplemented_;
+            return;
+        }
+        try {
+            res.rep = table_[c.method].method->Invoke(c.args.View());
+            res.status = SERVICE_NO_ERROR;
+            Log("service>> request executed");
+        } catch(const std::exception& e) {
+            Log("service>> exception: " + std::string(e.what()));
+            res.status = SERVICE_ERROR;
+            res.rep = srz::Pack(std::string(e.what()));
+        }
+    }
+    //call ids are echoed after the status, if sent by the client
+    static void SendHeader(void* r, const std::vector< char >& id,
+                           int callId, int status, bool more) {
+        ZCheck(zmq_send(r, id.data(), id.size(), ZMQ_SNDMORE));
+        ZCheck(zmq_send(r, 0, 0, ZMQ_SNDMORE));
+        const int header[2] = {status, callId};
+        ZCheck(zmq_send(r, header, callId == NO_CALL_ID ? sizeof(status)
+                                                        : sizeof(header),
+                        more ? ZMQ_SNDMORE : 0));
+    }
+    static void SendReply(void* r, const std::vector< char >& id, int callId,
+                          int status, const ByteArray& rep) {
+        SendHeader(r, id, callId, status, true);
+        ZCheck(zmq_send(r, rep.data(), rep.size(), 0));
+        Log("service>> reply sent");
+    }
+    //status and result of each call
+    static void SendBatchReply(void* r, const Batch& b) {
+        SendHeader(r, b.id, b.callId, SERVICE_NO_ERROR, !b.results.empty());
+        for(size_t i = 0; i != b.results.size(); ++i) {
+            const Result& res = b.results[i];
+            ZCheck(zmq_send(r, &res.status, sizeof(res.status),
+                            ZMQ_SNDMORE));
+            ZCheck(zmq_send(r, res.rep.data(), res.rep.size(),
+                            i + 1 == b.results.size() ? 0 : ZMQ_SNDMORE));
+        }
+        Log("service>> batch reply sent");
+    }
+    void ExecuteBatch(void* r, Batch& b) {
+        for(size_t i = 0; i != b.calls.size(); ++i) {
+            Execute(b.calls[i], b.results[i]);
+            if(!b.results[i].expired) continue;
+            expired_.fetch_add(b.calls.size() - i - 1,
+                               std::memory_order_relaxed);
+            return;
+        }
+        SendBatchReply(r, b);
+    }
+    void ScheduleBatch(void* r, Batch&& b) {
+        const int key = nextBatch_;
+        nextBatch_ = (nextBatch_ + 1) & 0x7fffffff;
+        for(auto& c: b.calls) c.batch = key;
+        Advance(r, batches_.insert(std::make_pair(key, std::move(b))).first);
+    }
+    //store result of batch call and schedule the next calls
+    void Complete(void* r, Result&& res) {
+        std::map< int, Batch >::iterator i = batches_.find(res.batch);
+        if(i == batches_.end()) return;
+        --i->second.remaining;
+        i->second.expired = i->second.expired || res.expired;
+        i->second.results[res.position] = std::move(res);
+        Advance(r, i);
+    }
+    //hand calls to workers, one at a time unless the batch is parallel;
+    //unknown methods are completed immediately; the reply is sent when
+    //all the calls are completed, calls of expired batches not yet started
+    //are dropped
+    void Advance(void* r, std::map< int, Batch >::iterator i) {
+        Batch& b = i->second;
+        while(b.next != b.calls.size() && !b.expired) {
+            Call& c = b.calls[b.next++];
+            if(c.method < 0) {
+                Execute(c, b.results[c.position]);
+                b.expired = b.results[c.position].expired;
+                --b.remaining;
+                continue;
+            }
+            Schedule(std::move(c));
+            if(!b.parallel) break;
+        }
+        if(b.expired && b.next != b.calls.size()) {
+            const size_t dropped = b.calls.size() - b.next;
+            expired_.fetch_add(dropped, std::memory_order_relaxed);
+            b.remaining -= dropped;
+            b.next = b.calls.size();
+        }
+        if(b.remaining) return;
+        if(!b.expired) SendBatchReply(r, b);
+        batches_.erase(i);
+    }
+    //worker thread
+    void Work() {
+        while(true) {
+            Call c = calls_.Pop();
+            if(c.method < 0) break;
+            Result res;
+            Execute(c, res);
+            res.id = std::move(c.id);
+            results_.Push(std::move(res));
+            reactor_.Notify();
+        }
+    }
+    //hand call to workers or put it in the method backlog if the maximum
+    //number of concurrent invocations is reached
+    void Schedule(Call&& c) {
+        Slot& s = slots_[c.method];
+        const int limit = table_[c.method].maxConcurrency;
+        if(limit > 0 && s.running >= limit) {
+            s.backlog.push_back(std::move(c));
+            return;
+        }
+        ++s.running;
+        calls_.Push(std::move(c));
+    }
+    //invoked when a call completes, dispatches the next call in the backlog
+    void Release(int method) {
+        Slot& s = slots_[method];
+        --s.running;
+        if(s.backlog.empty()) return;
+        ++s.running;
+        calls_.Push(std::move(s.backlog.front()));
+        s.backlog.pop_front();
+    }
+    //do not add entries for unknown ids received from clients
+    MethodImpl& Find(int reqid) {
+        std::map< int, MethodImpl >::iterator i = methods_.find(reqid);
+        if(i == methods_.end())
+            throw std::invalid_argument("Method not implemented");
+        return i->second;
+    }
     std::string uri_;
     Status status_ = STOPPED;
     std::map< int, MethodImpl > methods_;
+    std::map< int, int > concurrency_;
+    int numThreads_ = 0;
+    Reactor reactor_;
+    SyncQueue< Call > calls_;
+    SyncQueue< Result > results_;
+    MethodTable table_;
+    std::vector< Slot > slots_;
+    std::map< int, Batch > batches_;
+    int nextBatch_ = 0;
+    ByteArray notImplemented_;
+    std::atomic< std::uint64_t > expired_{0};
 };
 
-
 //==============================================================================
 //SERVICE MANAGER
 //==============================================================================
@@ -272,28 +861,32 @@ public:
     }
     void Stop() {
         stop_ = true;
+        reactor_.Notify();
     }
     ~ServiceManager() {
         Stop();
     }
-    void Start(const char* URI, size_t bufferSize = 0x100000,
-               int timeoutms = 2) {
+    //timeoutms is the maximum time spent waiting for requests, the default
+    //(-1) is to sleep until a request is received or Stop() is called;
+    //the buffer size parameter is ignored and kept for compatibility
+    void Start(const char* URI, size_t /*bufferSize*/ = 0x100000,
+               int timeoutms = -1) {
         stop_ = false;
         void* ctx = ZCheck(zmq_ctx_new());
         void* r = ZCheck(zmq_socket(ctx, ZMQ_ROUTER));
         ZCheck(zmq_bind(r, URI));
-        zmq_pollitem_t items[] = { { r, 0, ZMQ_POLLIN, 0 } };
         std::vector< char > id(10, char(0));
-        ByteArray buffer(bufferSize);
+        //requests are unpacked in place from the received frame
+        Message buffer;
+        std::string serviceName;
         while(!stop_) {
-            ZCheck(zmq_poll(items, 1, timeoutms)); //poll with 100ms timeout
-            if(items[0].revents & ZMQ_POLLIN) {
+            if(reactor_.Wait(r, timeoutms) & Reactor::READABLE) {
                 const int irc = ZCheck(zmq_recv(r, &id[0], id.size(), 0));
                 ZCheck(zmq_recv(r, 0, 0, 0));
-                const int rc =
-                    ZCheck(zmq_recv(r, &buffer[0], buffer.size(), 0));
-                const std::string serviceName
-                    = srz::UnPack< std::string >(begin(buffer));
+                ZCheck(zmq_msg_recv(buffer.Get(), r, 0));
+                srz::ByteView v = buffer.View();
+                if(srz::UnPack(v, serviceName) != srz::UNPACK_OK)
+                    serviceName.clear();
                 Log("server>> " + serviceName + " requested");
                 if(!Exists(serviceName)) {
                     const std::string error =
@@ -342,6 +935,7 @@ private:
     bool stop_;
     std::map< std::string, Service > services_;
     std::map< std::string, std::future< void > > serviceFutures_;
+    Reactor reactor_;
 };
 
 ///=============================================================================
@@ -363,16 +957,46 @@ private:
 };
 
 
+//Proxies send requests through a DEALER socket: any number of calls can be
+//in flight, replies are matched to requests through call ids. Replies are
+//received by the thread waiting for a reply or calling Poll(), which also
+//invokes the callbacks of completed calls; proxies are not thread safe.
+//Calls sent with a timeout carry it to the service, which drops them if
+//not started in time; calls not replied to in time fail with TimeoutError,
+//calls cancelled with CancelledError.
+//usage:
+//ServiceProxy sp("ipc://service-manager", "file service");
+//int sum = sp[SUM](5, 4); //synchronous
+//std::vector< ServiceProxy::AsyncReply< int > > replies;
+//for(int i = 0; i != n; ++i)
+//    replies.push_back(sp.AsyncRequest< int >(SUM, i, i)); //pipelined
+//for(auto& r: replies) Use(r.Get());
+//sp.AsyncRequest< double >(PI).Then([](double&& pi) { Use(pi); });
+//auto r = sp.AsyncRequestTimeout< int >(100, SUM, 5, 4); //100 ms
+//if(!r.Ready()) r.Cancel();
+//sp.WaitAll();
+//callback receiving the value returned by a remote method
+template < typename R >
+struct ReplyCallback {
+    using Type = std::function< void (R&&) >;
+};
+
+template <>
+struct ReplyCallback< void > {
+    using Type = std::function< void () >;
+};
+
 class ServiceProxy {
 private:
-    struct ByteArrayWrapper {
-        ByteArrayWrapper(const ByteArray& ba) : ba_(std::cref(ba)) {}
-        ByteArrayWrapper(const ByteArrayWrapper&) = default;
+    //converts received reply to requested type
+    struct ReplyWrapper {
+        ReplyWrapper(srz::ByteView v) : v_(v) {}
+        ReplyWrapper(const ReplyWrapper&) = default;
         template < typename T >
         operator T() const {
-            return srz::To< T >(ba_);
+            return UnPackReply< T >(v_);
         }
-        std::reference_wrapper< const ByteArray > ba_;
+        srz::ByteView v_;
     };
 
     class RemoteInvoker {
@@ -381,30 +1005,177 @@ private:
             sp_(sp), reqid_(reqid) { }
 
         template<typename...ArgsT>
-        const ByteArrayWrapper operator()(ArgsT...args) {
+        const ReplyWrapper operator()(ArgsT...args) {
             sp_->sendBuf_.resize(0);
-            sp_->sendBuf_ = srz::Pack(std::make_tuple(args...),
-                                 std::move(sp_->sendBuf_));
+            //reuse send buffer capacity
+            sp_->sendBuf_ = srz::Pack(std::move(sp_->sendBuf_),
+                                      std::make_tuple(args...));
             sp_->Send(reqid_);
-            return ByteArrayWrapper(sp_->recvBuf_);
+            return ReplyWrapper(sp_->recvMsg_.View());
         }
-        const ByteArrayWrapper operator()() {
+        const ReplyWrapper operator()() {
             sp_->sendBuf_.resize(0);
             sp_->Send(reqid_);
-            return ByteArrayWrapper(sp_->recvBuf_);
+            return ReplyWrapper(sp_->recvMsg_.View());
         }
     private:
         ServiceProxy* sp_;
         int reqid_;
     };
     friend class RemoteInvoker;
+    //outstanding call: the reply is stored until retrieved, or passed to
+    //the callback; batch replies store the status and result frames of
+    //each call; calls timed out or cancelled are received with a
+    //SERVICE_TIMEOUT or SERVICE_CANCELLED status
+    struct PendingCall {
+        bool received = false;
+        bool batch = false;
+        std::chrono::steady_clock::time_point deadline;
+        int status = SERVICE_NO_ERROR;
+        Message reply;
+        std::vector< Message > results;
+        std::function< void (PendingCall&&) > callback;
+    };
+public:
+    ///Calls sent to a service in a single request and replied to with a
+    ///single BatchReply; unless parallel, calls are executed in order, one
+    ///at a time; parallel calls are executed concurrently by services
+    ///running worker threads
+    class Batch {
+    public:
+        explicit Batch(bool parallel = false) : parallel_(parallel) {}
+        ///Add call, returns the position of its result in the reply
+        template < typename...ArgsT >
+        size_t Add(int reqid, ArgsT...args) {
+            methods_.push_back(reqid);
+            args_.push_back(srz::Pack(std::make_tuple(args...)));
+            return methods_.size() - 1;
+        }
+        size_t Add(int reqid) {
+            methods_.push_back(reqid);
+            args_.push_back(ByteArray());
+            return methods_.size() - 1;
+        }
+        size_t Size() const { return methods_.size(); }
+        bool Parallel() const { return parallel_; }
+        void Clear() {
+            methods_.clear();
+            args_.clear();
+        }
+    private:
+        friend class ServiceProxy;
+        std::vector< int > methods_;
+        std::vector< ByteArray > args_;
+        bool parallel_;
+    };
+    ///Status and result of each call in a batch, in the order calls were
+    ///added; failed calls do not affect the other calls
+    class BatchReply {
+    public:
+        BatchReply() = default;
+        BatchReply(std::vector< Message >&& frames)
+            : frames_(std::move(frames)) {}
+        size_t Size() const { return frames_.size() / 2; }
+        int Status(size_t i) const {
+            int status = SERVICE_ERROR;
+            const Message& m = frames_.at(2 * i);
+            if(m.Size() == sizeof(status))
+                std::memcpy(&status, m.Data(), sizeof(status));
+            return status;
+        }
+        bool Failed(size_t i) const { return ServiceError(Status(i)); }
+        ///Result of call i; throws RemoteServiceException if the call
+        ///failed
+        template < typename R >
+        R Get(size_t i) const {
+            Check(i);
+            return UnPackReply< R >(frames_[2 * i + 1].View());
+        }
+        ///Throws RemoteServiceException if call i failed
+        void Check(size_t i) const {
+            CheckStatus(Status(i), frames_.at(2 * i + 1));
+        }
+    private:
+        std::vector< Message > frames_;
+    };
+    using ErrorCallback = std::function< void (std::exception_ptr) >;
+    ///Handle to the reply of an asynchronous call, valid while the proxy
+    ///that created it exists; move only. Destroying a handle before
+    ///retrieving the reply abandons the call.
+    template < typename R >
+    class AsyncReply {
+    public:
+        using Callback = typename ReplyCallback< R >::Type;
+        AsyncReply() = default;
+        AsyncReply(ServiceProxy* sp, int callId) : sp_(sp), id_(callId) {}
+        AsyncReply(const AsyncReply&) = delete;
+        AsyncReply& operator=(const AsyncReply&) = delete;
+        AsyncReply(AsyncReply&& r) : sp_(r.sp_), id_(r.id_) {
+            r.sp_ = nullptr;
+        }
+        AsyncReply& operator=(AsyncReply&& r) {
+            if(this == &r) return *this;
+            Reset();
+            sp_ = r.sp_;
+            id_ = r.id_;
+            r.sp_ = nullptr;
+            return *this;
+        }
+        ~AsyncReply() {
+            Reset();
+        }
+        bool Valid() const { return sp_ != nullptr; }
+        int Id() const { return id_; }
+        ///Receive available replies without blocking, true if the reply
+        ///to this call was received
+        bool Ready() {
+            sp_->Poll();
+            return sp_->Received(id_);
+        }
+        ///Wait for reply and convert it to R; throws RemoteServiceException
+        ///if the method failed, TimeoutError if no reply is received in
+        ///time; invalidates the handle
+        R Get() {
+            ServiceProxy* sp = sp_;
+            sp_ = nullptr;
+            PendingCall c;
+            sp->WaitReply(id_, c);
+            return ServiceProxy::Convert< R >(c);
+        }
+        ///Pass the reply to cb when received, errors to onError; callbacks
+        ///are invoked by the thread receiving the reply; invalidates the
+        ///handle
+        void Then(Callback cb, ErrorCallback onError = ErrorCallback()) {
+            ServiceProxy* sp = sp_;
+            sp_ = nullptr;
+            sp->SetCallback(id_,
+                [cb, onError](PendingCall&& c) {
+                    ServiceProxy::Dispatch(c, cb, onError);
+                });
+        }
+        ///Fail the call with CancelledError, returned by Get(); false if
+        ///the reply was already received
+        bool Cancel() {
+            return sp_->Cancel(id_);
+        }
+    private:
+        void Reset() {
+            if(sp_) sp_->Abandon(id_);
+            sp_ = nullptr;
+        }
+        ServiceProxy* sp_ = nullptr;
+        int id_ = NO_CALL_ID;
+    };
 public:
     ServiceProxy() = delete;
     ServiceProxy(const ServiceProxy&) = delete;
     ServiceProxy(ServiceProxy&&) = default;
     ServiceProxy& operator=(const ServiceProxy&) = delete;
-    ServiceProxy(const char* serviceManagerURI, const char* serviceName) :
-        recvBuf_(0x1000) {
+    ///@param timeoutms timeout of each call, measured from the time the
+    ///       request is sent, -1 for no timeout; on timeout requests throw
+    ///       TimeoutError, the reply of the timed out request is dropped
+    ServiceProxy(const char* serviceManagerURI, const char* serviceName,
+                 int timeoutms = -1) : timeoutms_(timeoutms) {
         Connect(GetServiceURI(serviceManagerURI, serviceName));
     }
     RemoteInvoker operator[](int id) {
@@ -412,12 +1183,81 @@ public:
     }
     template < typename R, typename...ArgsT >
     R Request(int reqid, ArgsT...args) {
-        sendBuf_.resize(0);
-        sendBuf_ = srz::Pack(std::make_tuple(args...), std::move(sendBuf_));
-        Send(reqid);
-        return srz::UnPack< R >(begin(recvBuf_));
-
+        return AsyncRequest< R >(reqid, args...).Get();
     };
+    ///Send request and return without waiting for the reply
+    template < typename R, typename...ArgsT >
+    AsyncReply< R > AsyncRequest(int reqid, ArgsT...args) {
+        sendBuf_.resize(0);
+        sendBuf_ = srz::Pack(std::move(sendBuf_), std::make_tuple(args...));
+        return AsyncReply< R >(this, SendRequest(reqid));
+    }
+    template < typename R >
+    AsyncReply< R > AsyncRequest(int reqid) {
+        sendBuf_.resize(0);
+        return AsyncReply< R >(this, SendRequest(reqid));
+    }
+    ///Send request with its own timeout instead of the proxy's, -1 for
+    ///no timeout
+    template < typename R, typename...ArgsT >
+    AsyncReply< R > AsyncRequestTimeout(int timeoutms, int reqid,
+                                        ArgsT...args) {
+        sendBuf_.resize(0);
+        sendBuf_ = srz::Pack(std::move(sendBuf_), std::make_tuple(args...));
+        return AsyncReply< R >(this, SendRequest(reqid, timeoutms));
+    }
+    template < typename R >
+    AsyncReply< R > AsyncRequestTimeout(int timeoutms, int reqid) {
+        sendBuf_.resize(0);
+        return AsyncReply< R >(this, SendRequest(reqid, timeoutms));
+    }
+    ///Send all the calls in one request and wait for the results: one
+    ///round trip instead of one per call
+    BatchReply Request(const Batch& batch) {
+        return AsyncRequest(batch).Get();
+    }
+    AsyncReply< BatchReply > AsyncRequest(const Batch& batch) {
+        return AsyncReply< BatchReply >(this, SendBatch(batch));
+    }
+    ///Number of calls whose reply was not yet retrieved or passed to
+    ///their callback
+    size_t Pending() const { return pending_.size(); }
+    ///Maximum number of requests sent and not replied to: when reached,
+    ///requests wait for replies before being sent. Services drop replies
+    ///when the high water mark of their socket (default 1000) is reached;
+    ///zmq only learns about consumed messages in batches of about half the
+    ///high water mark, keep the window well below it
+    void SetWindow(int maxInFlight) {
+        maxInFlight_ = std::max(maxInFlight, 1);
+    }
+    int Window() const { return maxInFlight_; }
+    ///Receive replies, waiting at most timeoutms for the first one, and
+    ///invoke callbacks, also of timed out calls; returns the number of
+    ///replies received
+    int Poll(int timeoutms = 0) {
+        int n = 0;
+        if(WaitReadable(timeoutms)) {
+            do {
+                ReceiveReply();
+                ++n;
+            } while(WaitReadable(0));
+        }
+        Expire();
+        return n;
+    }
+    ///Wait until all the outstanding calls are replied to, time out or are
+    ///cancelled; callbacks receive the errors
+    void WaitAll() {
+        while(inFlight_) WaitEvent();
+    }
+    ///Fail call with CancelledError, its reply is discarded; false if the
+    ///call is unknown or was already replied to
+    bool Cancel(int callId) {
+        std::map< int, PendingCall >::iterator i = pending_.find(callId);
+        if(i == pending_.end() || i->second.received) return false;
+        Fail(i, SERVICE_CANCELLED);
+        return true;
+    }
     ~ServiceProxy() {
         ZCleanup(ctx_, serviceSocket_);
     }
@@ -426,55 +1266,295 @@ private:
                               const char* serviceName) {
         void* tmpCtx = ZCheck(zmq_ctx_new());
         void* tmpSocket = ZCheck(zmq_socket(tmpCtx, ZMQ_REQ));
+        SetTimeout(tmpSocket);
         ZCheck(zmq_connect(tmpSocket, serviceManagerURI));
         ByteArray req = srz::Pack(std::string(serviceName));
         ZCheck(zmq_send(tmpSocket, req.data(), req.size(), 0));
-        ByteArray rep(0x10000);
-        int rc = ZCheck(zmq_recv(tmpSocket, rep.data(), rep.size(), 0));
+        Message rep;
+        if(zmq_msg_recv(rep.Get(), tmpSocket, 0) < 0) {
+            const int err = errno;
+            ZCleanup(tmpCtx, tmpSocket);
+            if(err == EAGAIN)
+                throw TimeoutError("Service manager request timed out");
+            errno = err;
+            ZCheck(-1);
+        }
         ZCleanup(tmpCtx, tmpSocket);
-        return srz::To< std::string >(rep);
+        return UnPackReply< std::string >(rep.View());
     }
     void Connect(const std::string& serviceURI) {
+        serviceURI_ = serviceURI;
         ctx_ = ZCheck(zmq_ctx_new());
-        serviceSocket_ = ZCheck(zmq_socket(ctx_, ZMQ_REQ));
+        serviceSocket_ = ZCheck(zmq_socket(ctx_, ZMQ_DEALER));
+        SetTimeout(serviceSocket_);
         ZCheck(zmq_connect(serviceSocket_, serviceURI.c_str()));
         Log("client>> connected to " + serviceURI);
     }
+    //receive timeout; pending messages are discarded when closing the
+    //socket, or the context could not be destroyed
+    void SetTimeout(void* s) const {
+        if(timeoutms_ < 0) return;
+        ZCheck(zmq_setsockopt(s, ZMQ_RCVTIMEO, &timeoutms_,
+                              sizeof(timeoutms_)));
+        const int linger = 0;
+        ZCheck(zmq_setsockopt(s, ZMQ_LINGER, &linger, sizeof(linger)));
+    }
 private:
+    //synchronous call: the reply is received into recvMsg_
     void Send(int reqid) {
-        if(!sendBuf_.empty()) {
-            ZCheck(zmq_send(serviceSocket_, &reqid, sizeof(reqid),
-                            ZMQ_SNDMORE));
+        PendingCall c;
+        WaitReply(SendRequest(reqid), c);
+        CheckStatus(c.status, c.reply);
+        recvMsg_ = std::move(c.reply);
+        Log("client>> received data");
+    }
+    //send method id, call id, timeout if any and packed arguments if any,
+    //after the empty delimiter expected by the service ROUTER socket
+    int SendRequest(int reqid) {
+        return SendRequest(reqid, timeoutms_);
+    }
+    int SendRequest(int reqid, int timeoutms) {
+        const int callId = NextCallId();
+        const int header[3] = {reqid, callId, timeoutms};
+        ZCheck(zmq_send(serviceSocket_, 0, 0, ZMQ_SNDMORE));
+        ZCheck(zmq_send(serviceSocket_, header,
+                        timeoutms > 0 ? sizeof(header) : 2 * sizeof(int),
+                        sendBuf_.empty() ? 0 : ZMQ_SNDMORE));
+        if(!sendBuf_.empty())
             ZCheck(zmq_send(serviceSocket_, sendBuf_.data(), sendBuf_.size(),
                             0));
-        } else {
-            ZCheck(zmq_send(serviceSocket_, &reqid, sizeof(reqid),
-                            0));
-        }
+        Track(callId, false, timeoutms);
         Log("client>> sent data");
-        int status = -1;
-        ZCheck(zmq_recv(serviceSocket_, &status, sizeof(status), 0));
-        int64_t more = 0;
-        size_t moreSize = sizeof(more);
-        ZCheck(zmq_getsockopt(serviceSocket_, ZMQ_RCVMORE, &more, &moreSize));
-        if(more) {
-            ZCheck(zmq_recv(serviceSocket_, recvBuf_.data(),
-                            recvBuf_.size(), 0));
+        return callId;
+    }
+    //batch header with flags and timeout if any, followed by method id and
+    //arguments of each call
+    int SendBatch(const Batch& b) {
+        const int callId = NextCallId();
+        const int header[4] = {BATCH_REQUEST, callId,
+                               b.parallel_ ? int(BATCH_PARALLEL) : 0,
+                               timeoutms_};
+        ZCheck(zmq_send(serviceSocket_, 0, 0, ZMQ_SNDMORE));
+        ZCheck(zmq_send(serviceSocket_, header,
+                        timeoutms_ > 0 ? sizeof(header) : 3 * sizeof(int),
+                        b.Size() ? ZMQ_SNDMORE : 0));
+        for(size_t i = 0; i != b.Size(); ++i) {
+            ZCheck(zmq_send(serviceSocket_, &b.methods_[i], sizeof(int),
+                            ZMQ_SNDMORE));
+            ZCheck(zmq_send(serviceSocket_, b.args_[i].data(),
+                            b.args_[i].size(),
+                            i + 1 == b.Size() ? 0 : ZMQ_SNDMORE));
+        }
+        Track(callId, true, timeoutms_);
+        Log("client>> sent batch");
+        return callId;
+    }
+    //wait for replies or timeouts if the window is full, then return a new
+    //call id
+    int NextCallId() {
+        while(inFlight_ >= maxInFlight_) WaitEvent();
+        const int callId = nextCallId_;
+        nextCallId_ = (nextCallId_ + 1) & 0x7fffffff;
+        return callId;
+    }
+    void Track(int callId, bool batch, int timeoutms) {
+        PendingCall& c = pending_[callId];
+        c = PendingCall();
+        c.batch = batch;
+        if(timeoutms >= 0) {
+            c.deadline = std::chrono::steady_clock::now()
+                         + std::chrono::milliseconds(timeoutms);
+            timers_.Add(callId, c.deadline);
+        }
+        ++inFlight_;
+    }
+    bool WaitReadable(int timeoutms) {
+        zmq_pollitem_t items[] = {{serviceSocket_, 0, ZMQ_POLLIN, 0}};
+        return ZCheck(zmq_poll(items, 1, timeoutms)) > 0;
+    }
+    //wait until a reply is received or the next call times out
+    void WaitEvent() {
+        if(WaitReadable(timers_.NextTimeout(std::chrono::steady_clock::now())))
+            ReceiveReply();
+        Expire();
+    }
+    //fail calls not replied to in time; timers of calls already completed
+    //are ignored, call ids are not reused before timers expire. Callbacks
+    //are invoked after the timer wheel is updated: they can send requests
+    void Expire() {
+        if(timers_.Empty()) return;
+        const std::chrono::steady_clock::time_point now =
+            std::chrono::steady_clock::now();
+        std::vector< int > expired;
+        timers_.Advance(now, [&expired](int callId) {
+            expired.push_back(callId);
+        });
+        for(auto callId: expired) {
+            std::map< int, PendingCall >::iterator i = pending_.find(callId);
+            if(i == pending_.end() || i->second.received
+               || i->second.deadline > now)
+                continue;
+            Fail(i, SERVICE_TIMEOUT);
+        }
+    }
+    //complete call without a reply: late replies are discarded
+    void Fail(std::map< int, PendingCall >::iterator i, int status) {
+        i->second.status = status;
+        --inFlight_;
+        Completed(i);
+    }
+    //receive one reply: empty delimiter, status and call id, payload;
+    //replies to unknown calls, abandoned, timed out or cancelled, are
+    //discarded
+    void ReceiveReply() {
+        ZCheck(zmq_recv(serviceSocket_, 0, 0, 0));
+        int header[2] = {SERVICE_ERROR, NO_CALL_ID};
+        const int rc = ZCheck(zmq_recv(serviceSocket_, header,
+                                       sizeof(header), 0));
+        std::map< int, PendingCall >::iterator i = pending_.end();
+        if(rc == sizeof(header)) i = pending_.find(header[1]);
+        if(i == pending_.end() || i->second.received) {
+            DiscardFrames(serviceSocket_);
+            return;
+        }
+        --inFlight_;
+        PendingCall& c = i->second;
+        c.status = header[0];
+        if(c.batch) {
+            while(MoreFrames(serviceSocket_)) {
+                c.results.push_back(Message());
+                ZCheck(zmq_msg_recv(c.results.back().Get(), serviceSocket_,
+                                    0));
+            }
+        } else if(MoreFrames(serviceSocket_)) {
+            ZCheck(zmq_msg_recv(c.reply.Get(), serviceSocket_, 0));
+            DiscardFrames(serviceSocket_);
         }
+        Completed(i);
+    }
+    //the call is kept until retrieved through its handle or passed to its
+    //callback
+    void Completed(std::map< int, PendingCall >::iterator i) {
+        i->second.received = true;
+        if(!i->second.callback) return;
+        PendingCall completed(std::move(i->second));
+        pending_.erase(i);
+        std::function< void (PendingCall&&) > cb(
+            std::move(completed.callback));
+        cb(std::move(completed));
+    }
+    bool Received(int callId) const {
+        std::map< int, PendingCall >::const_iterator i =
+            pending_.find(callId);
+        return i != pending_.end() && i->second.received;
+    }
+    //wait for reply, timeout or cancellation and remove call
+    void WaitReply(int callId, PendingCall& reply) {
+        std::map< int, PendingCall >::iterator i = pending_.find(callId);
+        if(i == pending_.end())
+            throw std::logic_error("Unknown call id");
+        while(!i->second.received) WaitEvent();
+        reply = std::move(i->second);
+        pending_.erase(i);
+    }
+    void SetCallback(int callId, std::function< void (PendingCall&&) > cb) {
+        std::map< int, PendingCall >::iterator i = pending_.find(callId);
+        if(i == pending_.end())
+            throw std::logic_error("Unknown call id");
+        if(!i->second.received) {
+            i->second.callback = std::move(cb);
+            return;
+        }
+        PendingCall completed(std::move(i->second));
+        pending_.erase(i);
+        cb(std::move(completed));
+    }
+    //the call is forgotten at once and its window slot released: its
+    //reply, if any, is discarded as the reply to an unknown call; waiting
+    //for it would leak the slot if the service drops the reply
+    void Abandon(int callId) {
+        std::map< int, PendingCall >::iterator i = pending_.find(callId);
+        if(i == pending_.end()) return;
+        if(!i->second.received) --inFlight_;
+        pending_.erase(i);
+    }
+    static void CheckStatus(int status, const Message& reply) {
+        if(status == SERVICE_TIMEOUT)
+            throw TimeoutError("Service request timed out");
+        if(status == SERVICE_CANCELLED)
+            throw CancelledError("Service request cancelled");
         if(ServiceError(status)) {
             std::string errorMsg = "Service Error";
-            if(more) {
-                errorMsg += ": " + srz::To< std::string >(recvBuf_);
-                throw RemoteServiceException(errorMsg);
-            }
+            if(!reply.Empty())
+                errorMsg += ": " + UnPackReply< std::string >(reply.View());
+            throw RemoteServiceException(errorMsg);
         }
-        Log("client>> received data");
+    }
+    //convert reply to R, overloads selected through the type of the
+    //second argument
+    template < typename R >
+    static R Convert(PendingCall& c) {
+        return Convert(c, static_cast< R* >(nullptr));
+    }
+    template < typename R >
+    static R Convert(PendingCall& c, R*) {
+        CheckStatus(c.status, c.reply);
+        return UnPackReply< R >(c.reply.View());
+    }
+    static void Convert(PendingCall& c, void*) {
+        CheckStatus(c.status, c.reply);
+    }
+    static BatchReply Convert(PendingCall& c, BatchReply*) {
+        CheckStatus(c.status, c.reply);
+        return BatchReply(std::move(c.results));
+    }
+    template < typename R >
+    static void Dispatch(PendingCall& c,
+                         const std::function< void (R&&) >& cb,
+                         const ErrorCallback& onError) {
+        R r;
+        try {
+            r = Convert< R >(c);
+        } catch(...) {
+            if(onError) onError(std::current_exception());
+            return;
+        }
+        cb(std::move(r));
+    }
+    static void Dispatch(PendingCall& c,
+                         const std::function< void () >& cb,
+                         const ErrorCallback& onError) {
+        try {
+            CheckStatus(c.status, c.reply);
+        } catch(...) {
+            if(onError) onError(std::current_exception());
+            return;
+        }
+        cb();
+    }
+    template < typename T >
+    static T UnPackReply(srz::ByteView v) {
+        typename std::remove_cv< T >::type d;
+        if(srz::UnPack(v, d) != srz::UNPACK_OK)
+            throw RemoteServiceException("Malformed reply");
+        return d;
     }
 private:
+    //status of calls timed out or cancelled, never sent by services
+    enum {SERVICE_TIMEOUT = -2, SERVICE_CANCELLED = -3};
     ByteArray sendBuf_;
-    ByteArray recvBuf_;
+    Message recvMsg_;
     void* ctx_;
     void* serviceSocket_;
+    std::string serviceURI_;
+    int timeoutms_;
+    int nextCallId_ = 0;
+    //requests sent and not replied to
+    int inFlight_ = 0;
+    int maxInFlight_ = 500;
+    std::map< int, PendingCall > pending_;
+    //deadlines of calls sent with a timeout
+    TimerWheel< int > timers_;
 };
 
-}
\ No newline at end of file
+}
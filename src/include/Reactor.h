@@ -0,0 +1,109 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <zmq.h>
+
+#include "utility.h"
+
+namespace zrf {
+
+//==============================================================================
+//Reactor:
+// blocks the I/O thread until either the zmq socket is readable or another
+// thread signals that data is available for sending (e.g. after pushing
+// into a reply queue); the wait does not time out by default so idle
+// endpoints do not consume any CPU time.
+// Notifications are delivered through an eventfd (a pipe on non-Linux
+// systems) polled together with the zmq socket; multiple notifications
+// issued before the I/O thread wakes up are coalesced into a single write.
+//usage:
+//I/O thread:
+//while(!stop) {
+//  const int ev = reactor.Wait(socket, -1);
+//  if(ev & Reactor::READABLE) Receive(socket);
+//  while(!queue.Empty()) Send(socket, queue.Pop());
+//}
+//other threads:
+//queue.Push(data);
+//reactor.Notify();
+class Reactor {
+public:
+    enum Event {NONE = 0x0, READABLE = 0x1, NOTIFIED = 0x2};
+    Reactor() : pending_(false) {
+#ifdef __linux__
+        fd_[0] = fd_[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(fd_[0] < 0)
+            throw std::runtime_error("Cannot create eventfd");
+#else
+        if(pipe(fd_))
+            throw std::runtime_error("Cannot create pipe");
+        fcntl(fd_[0], F_SETFL, O_NONBLOCK);
+        fcntl(fd_[1], F_SETFL, O_NONBLOCK);
+#endif
+    }
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+    ~Reactor() {
+        close(fd_[0]);
+        if(fd_[1] != fd_[0]) close(fd_[1]);
+    }
+    ///Wake up thread waiting in Wait(), thread safe
+    void Notify() {
+        //only the first notification after a wake up writes to the fd
+        if(pending_.exchange(true)) return;
+        const std::uint64_t one = 1;
+        //if write fails the counter is already non-zero: ok to ignore
+        const ssize_t rc = write(fd_[1], &one, sizeof(one));
+        (void) rc;
+    }
+    ///Wait until socket is readable or Notify() is called
+    ///@param socket zmq socket, can be NULL
+    ///@param timeoutms maximum wait time, -1 == no timeout
+    ///@return combination of Event flags
+    int Wait(void* socket, long timeoutms = -1) {
+        zmq_pollitem_t items[] = {{nullptr, fd_[0], ZMQ_POLLIN, 0},
+                                  {socket, 0, ZMQ_POLLIN, 0}};
+        ZCheck(zmq_poll(items, socket ? 2 : 1, timeoutms));
+        int ev = NONE;
+        if(items[0].revents & ZMQ_POLLIN) {
+            //reset flag before draining the fd: any notification issued
+            //from now on will trigger a new wake up
+            pending_ = false;
+            std::uint64_t count;
+            while(read(fd_[0], &count, sizeof(count)) > 0);
+            ev |= NOTIFIED;
+        }
+        if(socket && (items[1].revents & ZMQ_POLLIN))
+            ev |= READABLE;
+        return ev;
+    }
+private:
+    int fd_[2]; //read, write: same eventfd on Linux
+    std::atomic< bool > pending_;
+};
+
+}
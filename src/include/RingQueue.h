@@ -0,0 +1,207 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <thread>
+
+#include "WaitWord.h"
+
+namespace zrf {
+
+//==============================================================================
+//BasicRingQueue:
+// bounded lock-free queue, same interface as SyncQueue plus non-blocking
+// TryPush/TryPop; each slot carries a sequence number which tells producers
+// and consumers whether the slot is free or holds data, as described in
+// Dmitry Vyukov's bounded MPMC queue.
+// Producers always claim slots with a compare-and-swap; with SINGLE_CONSUMER
+// set to true the consumer side does not require atomic read-modify-write
+// operations.
+// Push blocks when the queue is full, Pop blocks when the queue is empty;
+// blocked threads sleep on a futex and are only woken up when required.
+//usage:
+//MPMCRingQueue< int > q(1024);
+//producers:
+//q.Push(1);
+//consumers:
+//const int i = q.Pop();
+template < typename T, bool SINGLE_CONSUMER >
+class BasicRingQueue {
+public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+    ///@param capacity maximum number of elements, rounded up to the next
+    ///       power of two
+    explicit BasicRingQueue(size_t capacity = DEFAULT_CAPACITY)
+        : mask_(RoundUp(capacity) - 1), cells_(new Cell[mask_ + 1]),
+          enqueuePos_(0), dequeuePos_(0) {
+        for(size_t i = 0; i != mask_ + 1; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    BasicRingQueue(const BasicRingQueue&) = delete;
+    BasicRingQueue& operator=(const BasicRingQueue&) = delete;
+    ~BasicRingQueue() {
+        T d;
+        while(TryPop(d));
+    }
+    ///Non-blocking push, returns false if queue is full
+    bool TryPush(T&& e) {
+        return Emplace(std::move(e));
+    }
+    bool TryPush(const T& e) {
+        return Emplace(e);
+    }
+    ///Non-blocking pop, returns false if queue is empty
+    bool TryPop(T& e) {
+        Cell* c = nullptr;
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        while(true) {
+            c = &cells_[pos & mask_];
+            const size_t seq = c->seq.load(std::memory_order_acquire);
+            const std::intptr_t dif =
+                std::intptr_t(seq) - std::intptr_t(pos + 1);
+            if(dif == 0) {
+                if(SINGLE_CONSUMER) {
+                    dequeuePos_.store(pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+                if(dequeuePos_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(dif < 0) return false;
+            else pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+        T* p = reinterpret_cast< T* >(&c->storage);
+        e = std::move(*p);
+        p->~T();
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        //wake up blocked producers in bulk once half of the queue is free
+        //instead of switching context at each pop
+        if(Size() <= (mask_ + 1) / 2) notFull_.Wake(true);
+        return true;
+    }
+    void Push(T&& e) {
+        if(Spin([this, &e]() { return TryPush(std::move(e)); })) return;
+        notFull_.Wait([this, &e]() { return TryPush(std::move(e)); });
+    }
+    void Push(const T& e) {
+        if(Spin([this, &e]() { return TryPush(e); })) return;
+        notFull_.Wait([this, &e]() { return TryPush(e); });
+    }
+    ///No priority in a ring: same as Push
+    void PushFront(const T& e) {
+        Push(e);
+    }
+    template < typename FwdT >
+    void Buffer(FwdT begin, FwdT end) {
+        while(begin != end) Push(*begin++);
+    }
+    T Pop() {
+        T e;
+        if(Spin([this, &e]() { return TryPop(e); })) return e;
+        notEmpty_.Wait([this, &e]() { return TryPop(e); });
+        return e;
+    }
+    ///Only exact when called from a consumer thread with no concurrent
+    ///push in progress
+    bool Empty() const {
+        return Size() == 0;
+    }
+    ///Only exact when called from a producer thread with no concurrent
+    ///pop in progress
+    bool Full() const {
+        return Size() > mask_;
+    }
+    size_t Size() const {
+        const size_t d = dequeuePos_.load(std::memory_order_relaxed);
+        const size_t e = enqueuePos_.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+    size_t Capacity() const {
+        return mask_ + 1;
+    }
+private:
+    template < typename U >
+    bool Emplace(U&& e) {
+        Cell* c = nullptr;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        while(true) {
+            c = &cells_[pos & mask_];
+            const size_t seq = c->seq.load(std::memory_order_acquire);
+            const std::intptr_t dif = std::intptr_t(seq) - std::intptr_t(pos);
+            if(dif == 0) {
+                if(enqueuePos_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(dif < 0) return false;
+            else pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+        new (&c->storage) T(std::forward< U >(e));
+        c->seq.store(pos + 1, std::memory_order_release);
+        notEmpty_.Wake();
+        return true;
+    }
+    //retry a few times yielding the CPU before going to sleep: the other
+    //side is usually only a few instructions away from completing
+    template < typename F >
+    static bool Spin(const F& f) {
+        for(int i = 0; i != SPIN_COUNT; ++i) {
+            if(f()) return true;
+            std::this_thread::yield();
+        }
+        return false;
+    }
+    static size_t RoundUp(size_t n) {
+        size_t c = 2;
+        while(c < n) c <<= 1;
+        return c;
+    }
+private:
+    struct Cell {
+        std::atomic< size_t > seq;
+        typename std::aligned_storage< sizeof(T),
+                                       std::alignment_of< T >::value >::type
+            storage;
+    };
+    //keep positions written by producers and consumers on separate
+    //cache lines
+    enum {CACHE_LINE_SIZE = 64, SPIN_COUNT = 16};
+    using Pad = char[CACHE_LINE_SIZE];
+    const size_t mask_;
+    std::unique_ptr< Cell[] > cells_;
+    Pad pad0_;
+    std::atomic< size_t > enqueuePos_;
+    Pad pad1_;
+    std::atomic< size_t > dequeuePos_;
+    Pad pad2_;
+    WaitWord notEmpty_;
+    WaitWord notFull_;
+};
+
+//multiple producers, multiple consumers: requests dispatched to workers
+template < typename T >
+using MPMCRingQueue = BasicRingQueue< T, false >;
+//multiple producers, single consumer: replies collected by the I/O thread
+template < typename T >
+using MPSCRingQueue = BasicRingQueue< T, true >;
+
+}
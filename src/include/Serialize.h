@@ -23,14 +23,28 @@
 //! \code
 //! GetSerializer< T >::Type
 //! \endcode
+//! or, to select a wire encoding other than the default \c RawEncoding,
+//! \code
+//! GetSerializer< T, CompactEncoding >::Type
+//! \endcode
 //!
 //! Do specialize \c GetSerialize as needed.
 //! All serializers expose the inteface:
 //! \code
+//! static size_t Size(const T& d)
 //! static ByteArray Pack(const T &d, ByteArray buf = ByteArray())
-//! static ByteIterator Pack(const T &d, ByteIterator i)
+//! static Byte* Pack(const T &d, Byte* p)
 //! static ConstByteIterator UnPack(ConstByteIterator i, T& d)
+//! static UnPackStatus UnPack(ByteView& v, T& d)
 //! \endcode
+//! \c Size returns the exact number of bytes written by \c Pack, which
+//! writes data at the position pointed by \c p and returns the position
+//! following the last written byte; buffers are allocated once and filled
+//! in place.
+//! \c UnPack from a \c ByteView checks sizes against the available data
+//! and reports errors through the returned status, use it to read data
+//! received from the network; in case of error the content of \c v and
+//! \c d is unspecified.
 //!
 //! The preferred way of serializing/deserializing data is through the
 //! \c Pack, \c UnPack and \c UnPackTuple functions.
@@ -41,6 +55,23 @@
 #include <string>
 #include <type_traits>
 #include <map>
+#include <unordered_map>
+#include <set>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <tuple>
+#include <iterator>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include "ByteOrder.h"
 
 //! Serialization framework
 namespace srz {
@@ -55,7 +86,389 @@ using ByteArray = std::vector< Byte >;
 using ByteIterator = ByteArray::iterator;
 using ConstByteIterator = ByteArray::const_iterator;
 
+//! Result of checked unpacking from a \c ByteView.
+enum UnPackStatus {
+    UNPACK_OK = 0,
+    UNPACK_TRUNCATED, //!< data requires more bytes than available
+    UNPACK_INVALID, //!< malformed encoding, e.g. varint overflow
+    UNPACK_FORMAT_MISMATCH //!< message written with another encoding
+};
+
+//! Non-owning view over serialized data, e.g. a \c ByteArray or the data
+//! of a zmq message; checked unpacking consumes bytes from the front of
+//! the view and never reads past its end.
+class ByteView {
+public:
+    ByteView() : data_(nullptr), size_(0) {}
+    ByteView(const void* data, size_t size)
+        : data_(static_cast< const Byte* >(data)), size_(size) {}
+    ByteView(const ByteArray& ba) : data_(ba.data()), size_(ba.size()) {}
+    const Byte* Data() const {
+        return data_;
+    }
+    size_t Size() const {
+        return size_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    //! Remove \c n bytes from the front, false if less than \c n available
+    bool Consume(size_t n) {
+        if(n > size_) return false;
+        data_ += n;
+        size_ -= n;
+        return true;
+    }
+    //! Copy \c n bytes into \c out and consume them, false if less than
+    //! \c n available
+    bool Read(void* out, size_t n) {
+        if(n > size_) return false;
+        if(n) memcpy(out, data_, n);
+        return Consume(n);
+    }
+private:
+    const Byte* data_;
+    size_t size_;
+};
+
+//! Non-owning view over an array of POD elements stored in serialized data,
+//! as returned by \c UnPackView< std::vector< T > >: elements are not copied
+//! and are valid as long as the underlying buffer (e.g. the received zmq
+//! message) is.
+//! Serialized data is not aligned: elements are read through \c memcpy,
+//! \c Get returns a typed pointer only when data happens to be aligned.
 template< typename T >
+class ArrayView {
+    static_assert(std::is_pod< T >::value, "ArrayView of non-POD type");
+public:
+    //! Input iterator returning elements by value.
+    class ConstIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = T;
+        ConstIterator(const Byte* p = nullptr) : p_(p) {}
+        T operator*() const {
+            T d;
+            memcpy(&d, p_, sizeof(T));
+            return d;
+        }
+        ConstIterator& operator++() {
+            p_ += sizeof(T);
+            return *this;
+        }
+        ConstIterator operator++(int) {
+            ConstIterator i(*this);
+            ++*this;
+            return i;
+        }
+        bool operator==(const ConstIterator& i) const { return p_ == i.p_; }
+        bool operator!=(const ConstIterator& i) const { return p_ != i.p_; }
+    private:
+        const Byte* p_;
+    };
+public:
+    ArrayView() : data_(nullptr), size_(0) {}
+    //! \c size is the number of elements
+    ArrayView(const void* data, size_t size)
+        : data_(static_cast< const Byte* >(data)), size_(size) {}
+    ArrayView(const std::vector< T >& v)
+        : data_(reinterpret_cast< const Byte* >(v.data())), size_(v.size())
+    {}
+    size_t Size() const {
+        return size_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    T operator[](size_t i) const {
+        return *ConstIterator(data_ + sizeof(T) * i);
+    }
+    //! Raw bytes
+    const Byte* Data() const {
+        return data_;
+    }
+    bool Aligned() const {
+        return reinterpret_cast< std::uintptr_t >(data_) % alignof(T) == 0;
+    }
+    //! Typed pointer to elements, \c nullptr if not \c Aligned()
+    const T* Get() const {
+        return Aligned() ? reinterpret_cast< const T* >(data_) : nullptr;
+    }
+    //! Copy elements into \c out, which must have room for \c Size()
+    //! elements
+    void CopyTo(T* out) const {
+        if(size_) memcpy(out, data_, sizeof(T) * size_);
+    }
+    std::vector< T > ToVector() const {
+        std::vector< T > v(size_);
+        CopyTo(v.data());
+        return v;
+    }
+    ConstIterator begin() const {
+        return ConstIterator(data_);
+    }
+    ConstIterator end() const {
+        return ConstIterator(data_ + sizeof(T) * size_);
+    }
+private:
+    const Byte* data_;
+    size_t size_;
+};
+
+//! Non-owning view over characters stored in serialized data, as returned
+//! by \c UnPackView< std::string >; valid as long as the underlying buffer
+//! is.
+class StringView {
+public:
+    StringView() : data_(nullptr), size_(0) {}
+    StringView(const void* data, size_t size)
+        : data_(static_cast< const char* >(data)), size_(size) {}
+    StringView(const std::string& s) : data_(s.data()), size_(s.size()) {}
+    const char* Data() const {
+        return data_;
+    }
+    size_t Size() const {
+        return size_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    char operator[](size_t i) const {
+        return data_[i];
+    }
+    const char* begin() const {
+        return data_;
+    }
+    const char* end() const {
+        return data_ + size_;
+    }
+    std::string ToString() const {
+        return std::string(data_, size_);
+    }
+    operator std::string() const {
+        return ToString();
+    }
+private:
+    const char* data_;
+    size_t size_;
+};
+
+inline bool operator==(const StringView& s1, const StringView& s2) {
+    return s1.Size() == s2.Size()
+           && (!s1.Size() || !memcmp(s1.Data(), s2.Data(), s1.Size()));
+}
+
+inline bool operator!=(const StringView& s1, const StringView& s2) {
+    return !(s1 == s2);
+}
+
+namespace detail {
+//! \defgroup Varints
+//! LEB128: 7 bits per byte, least significant first, high bit set on all
+//! bytes but the last one.
+//! @{
+inline size_t VarintSize(std::uint64_t u) {
+    size_t n = 1;
+    for(; u >= 0x80; u >>= 7) ++n;
+    return n;
+}
+
+inline Byte* VarintPack(std::uint64_t u, Byte* p) {
+    for(; u >= 0x80; u >>= 7) *p++ = Byte(u | 0x80);
+    *p++ = Byte(u);
+    return p;
+}
+
+inline ConstByteIterator VarintUnPack(ConstByteIterator i, std::uint64_t& u) {
+    u = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        const unsigned char b = *i++;
+        u |= std::uint64_t(b & 0x7F) << shift;
+        if(!(b & 0x80)) break;
+    }
+    return i;
+}
+
+//! Only the shortest encoding of values fitting in 64 bits is accepted.
+inline UnPackStatus VarintUnPack(ByteView& v, std::uint64_t& u) {
+    u = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        unsigned char b = 0;
+        if(!v.Read(&b, 1)) return UNPACK_TRUNCATED;
+        const std::uint64_t d = b & 0x7F;
+        //bits shifted out of 64 bits
+        if(shift && (d >> (64 - shift))) return UNPACK_INVALID;
+        u |= d << shift;
+        if(!(b & 0x80)) return shift && !d ? UNPACK_INVALID : UNPACK_OK;
+    }
+    return UNPACK_INVALID;
+}
+
+inline std::uint64_t ZigZag(std::int64_t i) {
+    return (std::uint64_t(i) << 1) ^ std::uint64_t(i >> 63);
+}
+
+inline std::int64_t UnZigZag(std::uint64_t u) {
+    return std::int64_t(u >> 1) ^ -std::int64_t(u & 1);
+}
+//! @}
+}
+
+//! \defgroup Length encodings
+//! Encodings of string lengths and container sizes.
+//! \c RawLength writes a \c size_t as is, same layout as \c vector< char >:
+//! it is the default, existing peers keep working unchanged.
+//! \c VarintLength writes LEB128 varints, one byte for lengths up to 127,
+//! opt-in.
+//! The formats cannot be told apart from the data: messages exchanged
+//! between peers carry the format of their encoding in a header, so that
+//! readers reject messages written with another encoding, see
+//! \c PackMessageWith.
+//! @{
+struct RawLength {
+    static constexpr size_t Size(size_t) {
+        return sizeof(size_t);
+    }
+    static Byte* Pack(size_t s, Byte* p) {
+        memmove(p, &s, sizeof(s));
+        return p + sizeof(s);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, size_t& s) {
+        memmove(&s, &*i, sizeof(s));
+        return i + sizeof(s);
+    }
+    static UnPackStatus UnPack(ByteView& v, size_t& s) {
+        return v.Read(&s, sizeof(s)) ? UNPACK_OK : UNPACK_TRUNCATED;
+    }
+};
+
+struct VarintLength {
+    static size_t Size(size_t s) {
+        return detail::VarintSize(s);
+    }
+    static Byte* Pack(size_t s, Byte* p) {
+        return detail::VarintPack(s, p);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, size_t& s) {
+        std::uint64_t u = 0;
+        i = detail::VarintUnPack(i, u);
+        s = size_t(u);
+        return i;
+    }
+    static UnPackStatus UnPack(ByteView& v, size_t& s) {
+        std::uint64_t u = 0;
+        const UnPackStatus st = detail::VarintUnPack(v, u);
+        if(st != UNPACK_OK) return st;
+        if(u > std::numeric_limits< size_t >::max()) return UNPACK_INVALID;
+        s = size_t(u);
+        return UNPACK_OK;
+    }
+};
+
+//! 64 bit little-endian length, independent of the host.
+struct PortableLength {
+    static constexpr size_t Size(size_t) {
+        return sizeof(std::uint64_t);
+    }
+    static Byte* Pack(size_t s, Byte* p) {
+        const std::uint64_t u = s;
+        detail::CopyLittleEndian< sizeof(u) >(p, &u, 1);
+        return p + sizeof(u);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, size_t& s) {
+        std::uint64_t u = 0;
+        detail::CopyLittleEndian< sizeof(u) >(&u, &*i, 1);
+        s = size_t(u);
+        return i + sizeof(u);
+    }
+    static UnPackStatus UnPack(ByteView& v, size_t& s) {
+        std::uint64_t u = 0;
+        if(v.Size() < sizeof(u)) return UNPACK_TRUNCATED;
+        detail::CopyLittleEndian< sizeof(u) >(&u, v.Data(), 1);
+        v.Consume(sizeof(u));
+        if(u > std::numeric_limits< size_t >::max()) return UNPACK_INVALID;
+        s = size_t(u);
+        return UNPACK_OK;
+    }
+};
+//! @}
+
+//! \defgroup Encodings
+//! Wire encoding policies, selected through the second parameter of
+//! \c GetSerializer and through the \c *With functions:
+//! - \c RawEncoding: data written as laid out in memory, default;
+//! - \c CompactEncoding: string lengths and container sizes written as
+//!   varints;
+//! - \c CompactZigZagEncoding: as \c CompactEncoding, and integers wider
+//!   than one byte written as varints, zig-zag encoded if signed, so that
+//!   small negative values are also written in few bytes;
+//! - \c PortableEncoding: arithmetic and enum types, also as elements of
+//!   containers and tuples, and sizes written in little-endian byte order,
+//!   sizes as 64 bit integers, so that data can be exchanged between hosts
+//!   with different byte order or word size; on little-endian hosts
+//!   vectors are still copied with \c memcpy.
+//!   Other POD types are copied as laid out in memory.
+//! - \c TaggedEncoding: as \c CompactZigZagEncoding with arithmetic and
+//!   enum types in little-endian byte order; in addition types declared
+//!   with \c ZRF_SERIALIZABLE are written as length delimited messages in
+//!   which each field is preceded by its number and wire type, so that
+//!   readers skip fields they do not know and leave missing fields to
+//!   their default value, see \c SerializeTaggedFields.
+//! Peers must use the same encoding; \c FORMAT identifies the encoding in
+//! message headers.
+//! @{
+struct RawEncoding {
+    using Length = RawLength;
+    static const Byte FORMAT = 0;
+    static const bool VARINT_INTEGERS = false;
+    static const bool LITTLE_ENDIAN_DATA = false;
+    static const bool TAGGED_FIELDS = false;
+};
+
+template< bool VARINT_INTEGERS_ >
+struct BasicCompactEncoding {
+    using Length = VarintLength;
+    static const Byte FORMAT = VARINT_INTEGERS_ ? 2 : 1;
+    static const bool VARINT_INTEGERS = VARINT_INTEGERS_;
+    static const bool LITTLE_ENDIAN_DATA = false;
+    static const bool TAGGED_FIELDS = false;
+};
+
+using CompactEncoding = BasicCompactEncoding< false >;
+using CompactZigZagEncoding = BasicCompactEncoding< true >;
+
+struct PortableEncoding {
+    using Length = PortableLength;
+    static const Byte FORMAT = 3;
+    static const bool VARINT_INTEGERS = false;
+    static const bool LITTLE_ENDIAN_DATA = true;
+    static const bool TAGGED_FIELDS = false;
+};
+
+struct TaggedEncoding {
+    using Length = VarintLength;
+    static const Byte FORMAT = 4;
+    static const bool VARINT_INTEGERS = true;
+    static const bool LITTLE_ENDIAN_DATA = true;
+    static const bool TAGGED_FIELDS = true;
+};
+
+//! Wire type of fields written with \c TaggedEncoding: tells readers how
+//! to skip unknown fields.
+enum WireType {
+    WIRE_VARINT = 0,
+    WIRE_FIXED64 = 1,
+    WIRE_LENGTH = 2, //!< varint byte length followed by data
+    WIRE_FIXED8 = 3,
+    WIRE_FIXED16 = 4,
+    WIRE_FIXED32 = 5
+};
+//! @}
+
+template< typename T, typename E = RawEncoding >
 struct GetSerializer;
 
 //Serializer definitions
@@ -66,299 +479,1363 @@ struct GetSerializer;
 //! Use \c memmove to copy data into buffer.
 template< typename T >
 struct SerializePOD {
+    static constexpr size_t Size(const T&) {
+        return sizeof(T);
+    }
     static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
         const size_t sz = buf.size();
         buf.resize(buf.size() + sizeof(d));
-        memmove(buf.data() + sz, &d, sizeof(d));
+        Pack(d, buf.data() + sz);
         return buf;
     }
-    static ByteIterator Pack(const T& d, ByteIterator i) {
-        memmove(i, &d, sizeof(d));
-        return i + sizeof(d);
+    static Byte* Pack(const T& d, Byte* p) {
+        memmove(p, &d, sizeof(d));
+        return p + sizeof(d);
     }
     static ConstByteIterator UnPack(ConstByteIterator i, T& d) {
         memmove(&d, &*i, sizeof(T));
         return i + sizeof(T);
     }
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        return v.Read(&d, sizeof(T)) ? UNPACK_OK : UNPACK_TRUNCATED;
+    }
+};
+
+//! Serialize integers as LEB128 varints, zig-zag encoded if signed.
+template< typename T >
+struct SerializeVarint {
+    static_assert(std::is_integral< T >::value, "Varint of non-integer type");
+    static size_t Size(const T& d) {
+        return detail::VarintSize(Encode(d));
+    }
+    static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const T& d, Byte* p) {
+        return detail::VarintPack(Encode(d), p);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, T& d) {
+        std::uint64_t u = 0;
+        i = detail::VarintUnPack(i, u);
+        Decode(u, d, std::is_signed< T >());
+        return i;
+    }
+    //! values out of range for \c T are reported as \c UNPACK_INVALID
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        std::uint64_t u = 0;
+        const UnPackStatus st = detail::VarintUnPack(v, u);
+        if(st != UNPACK_OK) return st;
+        return Decode(u, d, std::is_signed< T >()) ? UNPACK_OK
+                                                   : UNPACK_INVALID;
+    }
+private:
+    static std::uint64_t Encode(T d) {
+        return std::is_signed< T >::value ? detail::ZigZag(std::int64_t(d))
+                                          : std::uint64_t(d);
+    }
+    static bool Decode(std::uint64_t u, T& d, std::true_type) {
+        const std::int64_t i = detail::UnZigZag(u);
+        d = T(i);
+        return i >= std::int64_t(std::numeric_limits< T >::min())
+               && i <= std::int64_t(std::numeric_limits< T >::max());
+    }
+    static bool Decode(std::uint64_t u, T& d, std::false_type) {
+        d = T(u);
+        return u <= std::uint64_t(std::numeric_limits< T >::max());
+    }
+};
+
+//! Serialize arithmetic and enum types in little-endian byte order.
+template< typename T >
+struct SerializePortable {
+    static constexpr size_t Size(const T&) {
+        return sizeof(T);
+    }
+    static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + sizeof(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const T& d, Byte* p) {
+        detail::CopyLittleEndian< sizeof(T) >(p, &d, 1);
+        return p + sizeof(d);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, T& d) {
+        detail::CopyLittleEndian< sizeof(T) >(&d, &*i, 1);
+        return i + sizeof(T);
+    }
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        if(v.Size() < sizeof(T)) return UNPACK_TRUNCATED;
+        detail::CopyLittleEndian< sizeof(T) >(&d, v.Data(), 1);
+        v.Consume(sizeof(T));
+        return UNPACK_OK;
+    }
 };
 
 //! Serialize copy constructible objects.
 //! Placement \c new and copy constructors are used to copy data into buffer
 template< typename T >
 struct Serialize {
+    static constexpr size_t Size(const T&) {
+        return sizeof(T);
+    }
     static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
         const size_t sz = buf.size();
         buf.resize(buf.size() + sizeof(d));
-        new(buf.data() + sz) T(d); //copy constructor
+        Pack(d, buf.data() + sz);
         return buf;
     }
-    static ByteIterator Pack(const T& d, ByteIterator i) {
-        new(i) T(d); //copy constructor
-        return i + sizeof(d);
+    static Byte* Pack(const T& d, Byte* p) {
+        new(p) T(d); //copy constructor
+        return p + sizeof(d);
     }
     static ConstByteIterator UnPack(ConstByteIterator i, T& d) {
         d = *reinterpret_cast< const T* >(&*i); //assignment operator
         return i + sizeof(T);
     }
+    //! only the size is checked: the object representation itself is
+    //! trusted, do not use with data received from untrusted sources
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        if(v.Size() < sizeof(T)) return UNPACK_TRUNCATED;
+        d = *reinterpret_cast< const T* >(v.Data()); //assignment operator
+        v.Consume(sizeof(T));
+        return UNPACK_OK;
+    }
 };
 
 //! Specialization for \c vector of POD types.
-template< typename T >
+template< typename T, typename E = RawEncoding >
 struct SerializeVectorPOD {
-    using ST = typename std::vector< T >::size_type;
+    using LS = typename E::Length;
+    static size_t Size(const std::vector< T >& d) {
+        return LS::Size(d.size()) + sizeof(T) * d.size();
+    }
     static ByteArray Pack(const std::vector< T >& d,
                           ByteArray buf = ByteArray()) {
         const size_t sz = buf.size();
-        const ST s = d.size();
-        buf.resize(buf.size() + sizeof(T) * d.size() + sizeof(ST));
-        memmove(buf.data() + sz, &s, sizeof(s));
-        memmove(buf.data() + sz + sizeof(s), d.data(), sizeof(T) * d.size());
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
         return buf;
     }
-    static ByteIterator Pack(const std::vector< T >& d, ByteIterator i) {
-        const ST s = d.size();
-        memmove(&*i, &s, sizeof(s));
-        memmove(&*i + sizeof(s), d.data(), d.size() * sizeof(T));
-        return i + sizeof(T) * d.size() + sizeof(s);
+    static Byte* Pack(const std::vector< T >& d, Byte* p) {
+        const size_t s = d.size();
+        p = LS::Pack(s, p);
+        if(s) memmove(p, d.data(), sizeof(T) * s);
+        return p + sizeof(T) * s;
     }
     static ConstByteIterator UnPack(ConstByteIterator i, std::vector< T >& d) {
-        ST s = 0;
-        memmove(&s, &*i, sizeof(s));
+        size_t s = 0;
+        i = LS::UnPack(i, s);
+        d.resize(s);
+        if(s) memmove(d.data(), &*i, s * sizeof(T));
+        return i + sizeof(T) * s;
+    }
+    static UnPackStatus UnPack(ByteView& v, std::vector< T >& d) {
+        size_t s = 0;
+        const UnPackStatus st = LS::UnPack(v, s);
+        if(st != UNPACK_OK) return st;
+        if(s > v.Size() / sizeof(T)) return UNPACK_TRUNCATED;
+        d.resize(s);
+        v.Read(d.data(), sizeof(T) * s);
+        return UNPACK_OK;
+    }
+};
+
+//! Specialization for \c vector of arithmetic and enum types with
+//! little-endian encodings: elements are converted in bulk.
+template< typename T, typename E = PortableEncoding >
+struct SerializeVectorPortable {
+    using LS = typename E::Length;
+    static size_t Size(const std::vector< T >& d) {
+        return LS::Size(d.size()) + sizeof(T) * d.size();
+    }
+    static ByteArray Pack(const std::vector< T >& d,
+                          ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const std::vector< T >& d, Byte* p) {
+        const size_t s = d.size();
+        p = LS::Pack(s, p);
+        detail::CopyLittleEndian< sizeof(T) >(p, d.data(), s);
+        return p + sizeof(T) * s;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, std::vector< T >& d) {
+        size_t s = 0;
+        i = LS::UnPack(i, s);
         d.resize(s);
-        memmove(d.data(), &*(i + sizeof(s)), s * sizeof(T));
-        return i + sizeof(s) + sizeof(T) * s;
+        if(s) detail::CopyLittleEndian< sizeof(T) >(d.data(), &*i, s);
+        return i + sizeof(T) * s;
+    }
+    static UnPackStatus UnPack(ByteView& v, std::vector< T >& d) {
+        size_t s = 0;
+        const UnPackStatus st = LS::UnPack(v, s);
+        if(st != UNPACK_OK) return st;
+        if(s > v.Size() / sizeof(T)) return UNPACK_TRUNCATED;
+        d.resize(s);
+        detail::CopyLittleEndian< sizeof(T) >(d.data(), v.Data(), s);
+        v.Consume(sizeof(T) * s);
+        return UNPACK_OK;
     }
 };
 
 //! Specialization for \c vector of non-POD types.
-template< typename T >
+//! The packed size is computed first so that the buffer is allocated once,
+//! elements are then written in place.
+template< typename T, typename E = RawEncoding >
 struct SerializeVector {
     using ST = typename std::vector<
         typename std::remove_cv< T >::type >::size_type;
     using TS = typename GetSerializer<
-        typename std::remove_cv< T >::type >::Type;
+        typename std::remove_cv< T >::type, E >::Type;
+    using LS = typename E::Length;
+    static size_t Size(const std::vector< T >& d) {
+        size_t sz = LS::Size(d.size());
+        for(decltype(d.cbegin()) i = d.cbegin(); i != d.cend(); ++i)
+            sz += TS::Size(*i);
+        return sz;
+    }
     static ByteArray Pack(const std::vector< T >& d,
                           ByteArray buf = ByteArray()) {
         const size_t sz = buf.size();
-        const size_t s = d.size();
-        buf.resize(buf.size() + sizeof(s));
-        memmove(buf.data() + sz, &s, sizeof(s));
-        for (decltype(d.cbegin()) i = d.cbegin(); i != d.cend(); ++i) {
-            buf = TS::Pack(*i, buf);
-        }
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const std::vector< T >& d, Byte* p) {
+        p = LS::Pack(d.size(), p);
+        for(decltype(d.cbegin()) i = d.cbegin(); i != d.cend(); ++i)
+            p = TS::Pack(*i, p);
+        return p;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, std::vector< T >& d) {
+        size_t s = 0;
+        bi = LS::UnPack(bi, s);
+        d.reserve(s);
+        for (ST i = 0; i != s; ++i) {
+            T data;
+            bi = TS::UnPack(bi, data);
+            d.push_back(std::move(data));
+        }
+        return bi;
+    }
+    static UnPackStatus UnPack(ByteView& v, std::vector< T >& d) {
+        size_t s = 0;
+        const UnPackStatus sst = LS::UnPack(v, s);
+        if(sst != UNPACK_OK) return sst;
+        d.clear();
+        //do not trust the element count for preallocation
+        d.reserve(std::min(s, ST(v.Size())));
+        for(ST i = 0; i != s; ++i) {
+            T data;
+            const UnPackStatus st = TS::UnPack(v, data);
+            if(st != UNPACK_OK) return st;
+            d.push_back(std::move(data));
+        }
+        return UNPACK_OK;
+    }
+};
+
+
+
+//! \c std::string serialization: length followed by characters, written
+//! and read directly from the string data.
+template< typename LengthT >
+struct SerializeBasicString {
+    static size_t Size(const std::string& d) {
+        return LengthT::Size(d.size()) + d.size();
+    }
+    static ByteArray Pack(const std::string& d,
+                          ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const std::string& d, Byte* p) {
+        p = LengthT::Pack(d.size(), p);
+        if(d.size()) memmove(p, d.data(), d.size());
+        return p + d.size();
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, std::string& d) {
+        size_t s = 0;
+        bi = LengthT::UnPack(bi, s);
+        d.assign(bi, bi + s);
+        return bi + s;
+    }
+    static UnPackStatus UnPack(ByteView& v, std::string& d) {
+        size_t s = 0;
+        const UnPackStatus st = LengthT::UnPack(v, s);
+        if(st != UNPACK_OK) return st;
+        if(s > v.Size()) return UNPACK_TRUNCATED;
+        d.assign(v.Data(), s);
+        v.Consume(s);
+        return UNPACK_OK;
+    }
+};
+
+//! Default \c std::string serialization, same layout as \c vector< char >.
+using SerializeString = SerializeBasicString< RawLength >;
+//! Compact \c std::string serialization with varint length.
+using SerializeVarintString = SerializeBasicString< VarintLength >;
+
+//! Zero-copy serialization of \c ArrayView, same layout as \c vector< T >:
+//! unpacking sets the view to point to the serialized data.
+template< typename T, typename E = RawEncoding >
+struct SerializeArrayView {
+    using LS = typename E::Length;
+    static size_t Size(const ArrayView< T >& d) {
+        return LS::Size(d.Size()) + sizeof(T) * d.Size();
+    }
+    static ByteArray Pack(const ArrayView< T >& d,
+                          ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const ArrayView< T >& d, Byte* p) {
+        const size_t s = d.Size();
+        p = LS::Pack(s, p);
+        if(s) memmove(p, d.Data(), sizeof(T) * s);
+        return p + sizeof(T) * s;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator i, ArrayView< T >& d) {
+        size_t s = 0;
+        i = LS::UnPack(i, s);
+        d = ArrayView< T >(s ? &*i : nullptr, s);
+        return i + sizeof(T) * s;
+    }
+    static UnPackStatus UnPack(ByteView& v, ArrayView< T >& d) {
+        size_t s = 0;
+        const UnPackStatus st = LS::UnPack(v, s);
+        if(st != UNPACK_OK) return st;
+        if(s > v.Size() / sizeof(T)) return UNPACK_TRUNCATED;
+        d = ArrayView< T >(v.Data(), s);
+        v.Consume(sizeof(T) * s);
+        return UNPACK_OK;
+    }
+};
+
+//! Zero-copy serialization of \c StringView, same layout as \c std::string
+//! serialized with the same length encoding.
+template< typename LengthT >
+struct SerializeBasicStringView {
+    static size_t Size(const StringView& d) {
+        return LengthT::Size(d.Size()) + d.Size();
+    }
+    static ByteArray Pack(const StringView& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const StringView& d, Byte* p) {
+        p = LengthT::Pack(d.Size(), p);
+        if(d.Size()) memmove(p, d.Data(), d.Size());
+        return p + d.Size();
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, StringView& d) {
+        size_t s = 0;
+        bi = LengthT::UnPack(bi, s);
+        d = StringView(s ? &*bi : nullptr, s);
+        return bi + s;
+    }
+    static UnPackStatus UnPack(ByteView& v, StringView& d) {
+        size_t s = 0;
+        const UnPackStatus st = LengthT::UnPack(v, s);
+        if(st != UNPACK_OK) return st;
+        if(s > v.Size()) return UNPACK_TRUNCATED;
+        d = StringView(v.Data(), s);
+        v.Consume(s);
+        return UNPACK_OK;
+    }
+};
+
+using SerializeStringView = SerializeBasicStringView< RawLength >;
+using SerializeVarintStringView = SerializeBasicStringView< VarintLength >;
+
+namespace detail {
+//! Preallocate room for \c n elements in containers supporting it.
+template< typename C >
+void Reserve(C&, size_t) {}
+
+template< typename K, typename T, typename H, typename P, typename A >
+void Reserve(std::unordered_map< K, T, H, P, A >& c, size_t n) {
+    c.reserve(n);
+}
+
+template< typename K, typename H, typename P, typename A >
+void Reserve(std::unordered_set< K, H, P, A >& c, size_t n) {
+    c.reserve(n);
+}
+}
+
+//! Specialization for \c std::map and \c std::unordered_map; elements are
+//! inserted with an end hint, constant time for \c map elements unpacked
+//! in order, and hash tables are sized once.
+template< typename M, typename E = RawEncoding >
+struct SerializeBasicMap {
+    using K = typename M::key_type;
+    using T = typename M::mapped_type;
+    using KS = typename GetSerializer< K, E >::Type;
+    using VS = typename GetSerializer< T, E >::Type;
+    using SS = typename E::Length;
+    static size_t Size(const M& m) {
+        size_t sz = SS::Size(m.size());
+        for(auto& mi: m)
+            sz += KS::Size(mi.first) + VS::Size(mi.second);
+        return sz;
+    }
+    static ByteArray Pack(const M& m, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(m));
+        Pack(m, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const M& m, Byte* p) {
+        p = SS::Pack(m.size(), p);
+        for(auto& mi: m) {
+            p = KS::Pack(mi.first, p);
+            p = VS::Pack(mi.second, p);
+        }
+        return p;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, M& d) {
+
+        size_t size = 0;
+        bi = SS::UnPack(bi, size);
+        detail::Reserve(d, d.size() + size);
+        for(size_t i = 0; i != size; ++i) {
+            K key;
+            T value;
+            bi = KS::UnPack(bi, key);
+            bi = VS::UnPack(bi, value);
+            d.emplace_hint(d.end(), std::move(key), std::move(value));
+        }
+        return bi;
+    }
+    static UnPackStatus UnPack(ByteView& v, M& d) {
+        size_t size = 0;
+        UnPackStatus st = SS::UnPack(v, size);
+        if(st != UNPACK_OK) return st;
+        d.clear();
+        //do not trust the element count for preallocation
+        detail::Reserve(d, std::min(size, v.Size()));
+        for(size_t i = 0; i != size; ++i) {
+            K key;
+            T value;
+            if((st = KS::UnPack(v, key)) != UNPACK_OK
+               || (st = VS::UnPack(v, value)) != UNPACK_OK)
+                return st;
+            d.emplace_hint(d.end(), std::move(key), std::move(value));
+        }
+        return UNPACK_OK;
+    }
+};
+
+template< typename K, typename T, typename E = RawEncoding >
+using SerializeMap = SerializeBasicMap< std::map< K, T >, E >;
+
+//! Specialization for \c std::deque, \c std::list, \c std::set and
+//! \c std::unordered_set: size followed by elements; elements are
+//! inserted at the end, with the same complexity as for maps.
+template< typename C, typename E = RawEncoding >
+struct SerializeContainer {
+    using T = typename C::value_type;
+    using TS = typename GetSerializer< T, E >::Type;
+    using SS = typename E::Length;
+    static size_t Size(const C& c) {
+        size_t sz = SS::Size(c.size());
+        for(auto& e: c) sz += TS::Size(e);
+        return sz;
+    }
+    static ByteArray Pack(const C& c, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(c));
+        Pack(c, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const C& c, Byte* p) {
+        p = SS::Pack(c.size(), p);
+        for(auto& e: c) p = TS::Pack(e, p);
+        return p;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, C& d) {
+        size_t size = 0;
+        bi = SS::UnPack(bi, size);
+        d.clear();
+        detail::Reserve(d, size);
+        for(size_t i = 0; i != size; ++i) {
+            T e;
+            bi = TS::UnPack(bi, e);
+            d.insert(d.end(), std::move(e));
+        }
+        return bi;
+    }
+    static UnPackStatus UnPack(ByteView& v, C& d) {
+        size_t size = 0;
+        UnPackStatus st = SS::UnPack(v, size);
+        if(st != UNPACK_OK) return st;
+        d.clear();
+        //do not trust the element count for preallocation
+        detail::Reserve(d, std::min(size, v.Size()));
+        for(size_t i = 0; i != size; ++i) {
+            T e;
+            if((st = TS::UnPack(v, e)) != UNPACK_OK) return st;
+            d.insert(d.end(), std::move(e));
+        }
+        return UNPACK_OK;
+    }
+};
+
+//! Specialization for \c std::array of elements not copied as is: elements
+//! only, the size is part of the type.
+template< typename T, size_t N, typename E = RawEncoding >
+struct SerializeArray {
+    using TS = typename GetSerializer< T, E >::Type;
+    static size_t Size(const std::array< T, N >& a) {
+        size_t sz = 0;
+        for(auto& e: a) sz += TS::Size(e);
+        return sz;
+    }
+    static ByteArray Pack(const std::array< T, N >& a,
+                          ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(a));
+        Pack(a, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const std::array< T, N >& a, Byte* p) {
+        for(auto& e: a) p = TS::Pack(e, p);
+        return p;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi,
+                                    std::array< T, N >& d) {
+        for(auto& e: d) bi = TS::UnPack(bi, e);
+        return bi;
+    }
+    static UnPackStatus UnPack(ByteView& v, std::array< T, N >& d) {
+        for(auto& e: d) {
+            const UnPackStatus st = TS::UnPack(v, e);
+            if(st != UNPACK_OK) return st;
+        }
+        return UNPACK_OK;
+    }
+};
+
+//! Specialization for \c std::pair: first then second element, without
+//! padding.
+template< typename T1, typename T2, typename E = RawEncoding >
+struct SerializePair {
+    using S1 = typename GetSerializer< T1, E >::Type;
+    using S2 = typename GetSerializer< T2, E >::Type;
+    static size_t Size(const std::pair< T1, T2 >& d) {
+        return S1::Size(d.first) + S2::Size(d.second);
+    }
+    static ByteArray Pack(const std::pair< T1, T2 >& d,
+                          ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const std::pair< T1, T2 >& d, Byte* p) {
+        return S2::Pack(d.second, S1::Pack(d.first, p));
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi,
+                                    std::pair< T1, T2 >& d) {
+        return S2::UnPack(S1::UnPack(bi, d.first), d.second);
+    }
+    static UnPackStatus UnPack(ByteView& v, std::pair< T1, T2 >& d) {
+        const UnPackStatus st = S1::UnPack(v, d.first);
+        return st != UNPACK_OK ? st : S2::UnPack(v, d.second);
+    }
+};
+
+namespace detail {
+template< typename T >
+struct HasFields;
+
+template< typename T, typename E >
+struct IsVarint;
+
+//! Serialize in order the elements of a tuple of values or references,
+//! from element \c I to \c N - 1.
+template< typename E, typename TupleT, size_t I = 0,
+          size_t N = std::tuple_size< TupleT >::value >
+struct ElementsSerializer {
+private:
+    using ES = typename GetSerializer< typename std::remove_reference<
+        typename std::tuple_element< I, TupleT >::type >::type, E >::Type;
+    using Next = ElementsSerializer< E, TupleT, I + 1, N >;
+public:
+    static size_t Size(const TupleT& d) {
+        return ES::Size(std::get< I >(d)) + Next::Size(d);
+    }
+    static Byte* Pack(const TupleT& d, Byte* p) {
+        return Next::Pack(d, ES::Pack(std::get< I >(d), p));
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, TupleT& d) {
+        return Next::UnPack(ES::UnPack(bi, std::get< I >(d)), d);
+    }
+    static UnPackStatus UnPack(ByteView& v, TupleT& d) {
+        const UnPackStatus st = ES::UnPack(v, std::get< I >(d));
+        return st != UNPACK_OK ? st : Next::UnPack(v, d);
+    }
+};
+
+//! Serialize elements of tuple - end of iteration case.
+template< typename E, typename TupleT, size_t N >
+struct ElementsSerializer< E, TupleT, N, N > {
+    static size_t Size(const TupleT&) {
+        return 0;
+    }
+    static Byte* Pack(const TupleT&, Byte* p) {
+        return p;
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, TupleT&) {
+        return bi;
+    }
+    static UnPackStatus UnPack(ByteView&, TupleT&) {
+        return UNPACK_OK;
+    }
+};
+}
+
+//! Specialization for \c tuple of non-POD types: elements are serialized
+//! in order, with the same layout as \c Pack(elements...).
+template< typename E, typename... ArgsT >
+struct SerializeBasicTuple {
+private:
+    using T = std::tuple< ArgsT... >;
+    using ES = detail::ElementsSerializer< E, T >;
+public:
+    static size_t Size(const T& d) {
+        return ES::Size(d);
+    }
+    static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const T& d, Byte* p) {
+        return ES::Pack(d, p);
+    }
+    static ConstByteIterator UnPack(ConstByteIterator bi, T& d) {
+        return ES::UnPack(bi, d);
+    }
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        return ES::UnPack(v, d);
+    }
+};
+
+template< typename... ArgsT >
+using SerializeTuple = SerializeBasicTuple< RawEncoding, ArgsT... >;
+
+//! Specialization for types declared with \c ZRF_SERIALIZABLE: fields are
+//! serialized in the order in which they are listed, with the same layout
+//! as \c Pack(fields...), padding is not transmitted.
+//! Selected only when the type cannot be copied as a single block, see
+//! \c detail::IsFlat.
+template< typename T, typename E = RawEncoding >
+struct SerializeFields {
+private:
+    using Fields = decltype(ZrfFields(std::declval< T& >()));
+    using ConstFields = decltype(ZrfFields(std::declval< const T& >()));
+public:
+    static size_t Size(const T& d) {
+        return detail::ElementsSerializer< E, ConstFields >::Size(
+            ZrfFields(d));
+    }
+    static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
         return buf;
     }
-    static ByteIterator Pack(const std::vector< T >& d, ByteIterator bi) {
-        const ST s = d.size();
-        memmove(bi, &s, sizeof(s));
-        for (decltype(cbegin(d)) i = cbegin(d); i != cend(d); ++i) {
-            bi = TS::Pack(*i, bi);
-        }
-        return bi;
+    static Byte* Pack(const T& d, Byte* p) {
+        return detail::ElementsSerializer< E, ConstFields >::Pack(
+            ZrfFields(d), p);
     }
-    static ConstByteIterator UnPack(ConstByteIterator bi, std::vector< T >& d) {
-        ST s = 0;
-        memmove(&s, &*bi, sizeof(s));
-        bi += sizeof(s);
-        d.reserve(s);
-        for (ST i = 0; i != s; ++i) {
-            T data;
-            bi = TS::UnPack(bi, data);
-            d.push_back(std::move(data));
-        }
-        return bi;
+    static ConstByteIterator UnPack(ConstByteIterator bi, T& d) {
+        Fields f = ZrfFields(d);
+        return detail::ElementsSerializer< E, Fields >::UnPack(bi, f);
+    }
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        Fields f = ZrfFields(d);
+        return detail::ElementsSerializer< E, Fields >::UnPack(v, f);
     }
 };
 
+namespace detail {
+//! Wire type of \c T written with encoding \c E.
+template< typename T, typename E >
+struct GetWireType {
+    static const size_t FIXED =
+        std::is_arithmetic< T >::value || std::is_enum< T >::value
+        ? sizeof(T) : 0;
+    static const WireType value =
+        IsVarint< T, E >::value ? WIRE_VARINT
+        : FIXED == 1 ? WIRE_FIXED8
+        : FIXED == 2 ? WIRE_FIXED16
+        : FIXED == 4 ? WIRE_FIXED32
+        : FIXED == 8 ? WIRE_FIXED64
+        : WIRE_LENGTH;
+};
 
+//! True if the serializer of \c T with encoding \c E already writes the
+//! byte length first: no additional length is written for
+//! \c WIRE_LENGTH fields.
+template< typename T, typename E >
+struct IsDelimited : std::integral_constant< bool,
+    std::is_same< typename E::Length, VarintLength >::value
+    && (std::is_same< T, std::string >::value
+        || std::is_same< T, StringView >::value
+        || (HasFields< T >::value && E::TAGGED_FIELDS)) > {};
 
-//! \c std::string serialization.
-struct SerializeString {
-    using T = std::string::value_type;
-    using V = std::vector< T >;
-    static ByteArray Pack(const std::string& d,
-                          ByteArray buf = ByteArray()) {
-        return SerializeVectorPOD< T >::Pack(V(d.begin(), d.end()), buf);
+//! Skip field of unknown number or wire type.
+inline UnPackStatus SkipField(ByteView& v, std::uint64_t wireType) {
+    std::uint64_t u = 0;
+    switch(wireType) {
+    case WIRE_VARINT:
+        return VarintUnPack(v, u);
+    case WIRE_FIXED8:
+        return v.Consume(1) ? UNPACK_OK : UNPACK_TRUNCATED;
+    case WIRE_FIXED16:
+        return v.Consume(2) ? UNPACK_OK : UNPACK_TRUNCATED;
+    case WIRE_FIXED32:
+        return v.Consume(4) ? UNPACK_OK : UNPACK_TRUNCATED;
+    case WIRE_FIXED64:
+        return v.Consume(8) ? UNPACK_OK : UNPACK_TRUNCATED;
+    case WIRE_LENGTH: {
+        const UnPackStatus st = VarintUnPack(v, u);
+        if(st != UNPACK_OK) return st;
+        return u <= v.Size() && v.Consume(size_t(u)) ? UNPACK_OK
+                                                       : UNPACK_TRUNCATED;
     }
-    static ByteIterator Pack(const std::string& d, ByteIterator bi) {
-        return SerializeVectorPOD< T >::Pack(V(d.begin(), d.end()), bi);
+    default:
+        return UNPACK_INVALID;
     }
-    static ConstByteIterator UnPack(ConstByteIterator bi, std::string& d) {
-        V v;
-        bi = SerializeVectorPOD< T >::UnPack(bi, v);
-        d = std::string(v.begin(), v.end());
-        return bi;
+}
+
+//! Read field key, zero is not a valid key.
+inline UnPackStatus ReadKey(ByteView& v, std::uint64_t& key) {
+    const UnPackStatus st = VarintUnPack(v, key);
+    return st != UNPACK_OK ? st : key ? UNPACK_OK : UNPACK_INVALID;
+}
+
+//! Write and read in tagged format the fields of a tuple of references,
+//! from field \c I to \c N - 1; field numbers start from one.
+template< typename E, typename TupleT, size_t I = 0,
+          size_t N = std::tuple_size< TupleT >::value >
+struct TaggedSerializer {
+private:
+    using F = typename std::remove_cv< typename std::remove_reference<
+        typename std::tuple_element< I, TupleT >::type >::type >::type;
+    using ES = typename GetSerializer< F, E >::Type;
+    using Next = TaggedSerializer< E, TupleT, I + 1, N >;
+    static const WireType WIRE_TYPE = GetWireType< F, E >::value;
+    static const bool PREFIX = WIRE_TYPE == WIRE_LENGTH
+                               && !IsDelimited< F, E >::value;
+    static const std::uint64_t KEY = ((I + 1) << 3) | WIRE_TYPE;
+public:
+    static size_t Size(const TupleT& d) {
+        const size_t sz = ES::Size(std::get< I >(d));
+        return VarintSize(KEY) + (PREFIX ? VarintSize(sz) : 0) + sz
+               + Next::Size(d);
+    }
+    static Byte* Pack(const TupleT& d, Byte* p) {
+        p = VarintPack(KEY, p);
+        if(PREFIX) p = VarintPack(ES::Size(std::get< I >(d)), p);
+        return Next::Pack(d, ES::Pack(std::get< I >(d), p));
+    }
+    //! Read fields written in order by \c Pack, stop at the first field
+    //! with a different key and return its key in \c key
+    static UnPackStatus UnPackInOrder(ByteView& v, TupleT& d,
+                                      std::uint64_t& key) {
+        if(v.Empty()) return UNPACK_OK;
+        //keys of the first 15 fields are one byte long
+        if(KEY < 0x80 && (unsigned char)(*v.Data()) == KEY) {
+            v.Consume(1);
+        } else {
+            const UnPackStatus st = ReadKey(v, key);
+            if(st != UNPACK_OK || key != KEY) return st;
+        }
+        const UnPackStatus fst = UnPackField(v, d);
+        key = 0;
+        return fst != UNPACK_OK ? fst : Next::UnPackInOrder(v, d, key);
+    }
+    //! Read field of number \c number if it is a known one, skip it
+    //! otherwise
+    static UnPackStatus UnPack(ByteView& v, TupleT& d, std::uint64_t number,
+                               std::uint64_t wireType) {
+        if(number != I + 1 || wireType != WIRE_TYPE)
+            return Next::UnPack(v, d, number, wireType);
+        return UnPackField(v, d);
+    }
+private:
+    static UnPackStatus UnPackField(ByteView& v, TupleT& d) {
+        if(!PREFIX) return ES::UnPack(v, std::get< I >(d));
+        std::uint64_t sz = 0;
+        const UnPackStatus st = VarintUnPack(v, sz);
+        if(st != UNPACK_OK) return st;
+        if(sz > v.Size()) return UNPACK_TRUNCATED;
+        ByteView fv(v.Data(), size_t(sz));
+        v.Consume(size_t(sz));
+        return ES::UnPack(fv, std::get< I >(d));
     }
 };
 
-//! Specialization for \c std::map
-template< typename K, typename T >
-struct SerializeMap {
-    using KS = typename GetSerializer< K >::Type;
-    using VS = typename GetSerializer< T >::Type;
-    using SS = SerializePOD< size_t >;
-    static ByteArray Pack(const std::map< K, T >& m,
-                          ByteArray buf = ByteArray()) {
-        buf = SS::Pack(m.size(), buf);
-        for(auto& mi: m) {
-            buf = KS::Pack(mi.first, buf);
-            buf = VS::Pack(mi.second, buf);
-        }
-        return buf;
+//! Write and read fields in tagged format - end of iteration case.
+template< typename E, typename TupleT, size_t N >
+struct TaggedSerializer< E, TupleT, N, N > {
+    static size_t Size(const TupleT&) {
+        return 0;
     }
-    static ByteIterator Pack(const std::map< K, T >& m, ByteIterator bi) {
-        bi = SS::Pack(m.size(), bi);
-        for(auto& mi: m) {
-            bi = KS::Pack(mi.first, bi);
-            bi = VS::Pack(mi.second, bi);
-        }
-        return bi;
+    static Byte* Pack(const TupleT&, Byte* p) {
+        return p;
     }
-    static ConstByteIterator UnPack(ConstByteIterator bi,
-                                    std::map< K, T >& d) {
+    static UnPackStatus UnPackInOrder(ByteView& v, TupleT&,
+                                      std::uint64_t& key) {
+        return v.Empty() ? UNPACK_OK : ReadKey(v, key);
+    }
+    static UnPackStatus UnPack(ByteView& v, TupleT&, std::uint64_t,
+                               std::uint64_t wireType) {
+        return SkipField(v, wireType);
+    }
+};
+}
 
-        size_t size = 0;
-        bi = SS::UnPack(bi, size);
-        for(size_t i = 0; i != size; ++i) {
-            K key;
-            T value;
-            bi = KS::UnPack(bi, key);
-            bi = VS::UnPack(bi, value);
-            d.insert(std::make_pair(key, value));
+//! Specialization for types declared with \c ZRF_SERIALIZABLE, with
+//! \c TaggedEncoding: a message is written as the varint byte length of
+//! its fields followed by each field preceded by the varint key
+//! \code
+//! field number << 3 | wire type
+//! \endcode
+//! where the field number is the position in the \c ZRF_SERIALIZABLE
+//! list, starting from one; fields are read in any order, fields with
+//! unknown number or wire type are skipped and fields not found are left
+//! to their value in a default constructed \c T.
+//! To evolve a type add fields at the end of the list only and do not
+//! remove or reorder listed fields.
+template< typename T, typename E = TaggedEncoding >
+struct SerializeTaggedFields {
+private:
+    using Fields = decltype(ZrfFields(std::declval< T& >()));
+    using ConstFields = decltype(ZrfFields(std::declval< const T& >()));
+    using FS = detail::TaggedSerializer< E, Fields >;
+    using CFS = detail::TaggedSerializer< E, ConstFields >;
+public:
+    static size_t Size(const T& d) {
+        const size_t sz = CFS::Size(ZrfFields(d));
+        return detail::VarintSize(sz) + sz;
+    }
+    static ByteArray Pack(const T& d, ByteArray buf = ByteArray()) {
+        const size_t sz = buf.size();
+        buf.resize(buf.size() + Size(d));
+        Pack(d, buf.data() + sz);
+        return buf;
+    }
+    static Byte* Pack(const T& d, Byte* p) {
+        const ConstFields f = ZrfFields(d);
+        return CFS::Pack(f, detail::VarintPack(CFS::Size(f), p));
+    }
+    //! Data is checked also when unpacking through iterators, throws
+    //! \c std::runtime_error if invalid
+    static ConstByteIterator UnPack(ConstByteIterator bi, T& d) {
+        std::uint64_t sz = 0;
+        const ConstByteIterator fi = detail::VarintUnPack(bi, sz);
+        ByteView v(&*bi, size_t(fi - bi) + size_t(sz));
+        if(UnPack(v, d) != UNPACK_OK)
+            throw std::runtime_error("Invalid tagged message");
+        return fi + size_t(sz);
+    }
+    static UnPackStatus UnPack(ByteView& v, T& d) {
+        std::uint64_t sz = 0;
+        UnPackStatus st = detail::VarintUnPack(v, sz);
+        if(st != UNPACK_OK) return st;
+        if(sz > v.Size()) return UNPACK_TRUNCATED;
+        ByteView fv(v.Data(), size_t(sz));
+        v.Consume(size_t(sz));
+        d = T();
+        Fields f = ZrfFields(d);
+        //fast path for fields in the order written by Pack, then any order
+        std::uint64_t key = 0;
+        st = FS::UnPackInOrder(fv, f, key);
+        while(st == UNPACK_OK && key) {
+            st = FS::UnPack(fv, f, key >> 3, key & 7);
+            key = 0;
+            if(st == UNPACK_OK && !fv.Empty())
+                st = detail::ReadKey(fv, key);
         }
-        return bi;
+        return st;
     }
 };
 
+//! Declare the fields of a type serialized field by field, in the listed
+//! order; use at namespace scope in the namespace of \c Type:
+//! \code
+//! struct Particle {
+//!     double x, y, z;
+//!     std::string name;
+//! };
+//! ZRF_SERIALIZABLE(Particle, x, y, z, name)
+//! \endcode
+//! Types whose listed fields cover the whole object, are listed in
+//! declaration order and are copied as is with the selected encoding are
+//! packed with a single \c memcpy, see \c detail::IsFlat. Up to 32
+//! fields; \c Type must not contain commas, use an alias for template
+//! instances.
+//! \c ZrfFieldsOrdered is a template so that \c offsetof is only
+//! evaluated for standard layout types.
+#define ZRF_SERIALIZABLE(Type, ...) \
+    inline auto ZrfFields(Type& d) \
+        -> decltype(std::tie(ZRF_FIELDS_(d, __VA_ARGS__))) { \
+        return std::tie(ZRF_FIELDS_(d, __VA_ARGS__)); \
+    } \
+    inline auto ZrfFields(const Type& d) \
+        -> decltype(std::tie(ZRF_FIELDS_(d, __VA_ARGS__))) { \
+        return std::tie(ZRF_FIELDS_(d, __VA_ARGS__)); \
+    } \
+    template< typename ZrfT > \
+    constexpr bool ZrfFieldsOrdered(const Type*, const ZrfT*) { \
+        return ::srz::detail::Increasing(ZRF_OFFSETS_(ZrfT, __VA_ARGS__)); \
+    }
+
+//expand to d.f1, d.f2, ...
+#define ZRF_FIELDS_(d, ...) \
+    ZRF_CAT_(ZRF_FIELDS_, ZRF_NARGS_(__VA_ARGS__))(d, __VA_ARGS__)
+#define ZRF_CAT_(a, b) ZRF_CAT2_(a, b)
+#define ZRF_CAT2_(a, b) a##b
+#define ZRF_NARGS_(...) ZRF_NARGS2_(__VA_ARGS__, \
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, \
+    14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define ZRF_NARGS2_( \
+    _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+    _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, \
+    _31, _32, N, ...) N
+#define ZRF_FIELDS_1(d, f) d.f
+#define ZRF_FIELDS_2(d, f, ...) d.f, ZRF_FIELDS_1(d, __VA_ARGS__)
+#define ZRF_FIELDS_3(d, f, ...) d.f, ZRF_FIELDS_2(d, __VA_ARGS__)
+#define ZRF_FIELDS_4(d, f, ...) d.f, ZRF_FIELDS_3(d, __VA_ARGS__)
+#define ZRF_FIELDS_5(d, f, ...) d.f, ZRF_FIELDS_4(d, __VA_ARGS__)
+#define ZRF_FIELDS_6(d, f, ...) d.f, ZRF_FIELDS_5(d, __VA_ARGS__)
+#define ZRF_FIELDS_7(d, f, ...) d.f, ZRF_FIELDS_6(d, __VA_ARGS__)
+#define ZRF_FIELDS_8(d, f, ...) d.f, ZRF_FIELDS_7(d, __VA_ARGS__)
+#define ZRF_FIELDS_9(d, f, ...) d.f, ZRF_FIELDS_8(d, __VA_ARGS__)
+#define ZRF_FIELDS_10(d, f, ...) d.f, ZRF_FIELDS_9(d, __VA_ARGS__)
+#define ZRF_FIELDS_11(d, f, ...) d.f, ZRF_FIELDS_10(d, __VA_ARGS__)
+#define ZRF_FIELDS_12(d, f, ...) d.f, ZRF_FIELDS_11(d, __VA_ARGS__)
+#define ZRF_FIELDS_13(d, f, ...) d.f, ZRF_FIELDS_12(d, __VA_ARGS__)
+#define ZRF_FIELDS_14(d, f, ...) d.f, ZRF_FIELDS_13(d, __VA_ARGS__)
+#define ZRF_FIELDS_15(d, f, ...) d.f, ZRF_FIELDS_14(d, __VA_ARGS__)
+#define ZRF_FIELDS_16(d, f, ...) d.f, ZRF_FIELDS_15(d, __VA_ARGS__)
+#define ZRF_FIELDS_17(d, f, ...) d.f, ZRF_FIELDS_16(d, __VA_ARGS__)
+#define ZRF_FIELDS_18(d, f, ...) d.f, ZRF_FIELDS_17(d, __VA_ARGS__)
+#define ZRF_FIELDS_19(d, f, ...) d.f, ZRF_FIELDS_18(d, __VA_ARGS__)
+#define ZRF_FIELDS_20(d, f, ...) d.f, ZRF_FIELDS_19(d, __VA_ARGS__)
+#define ZRF_FIELDS_21(d, f, ...) d.f, ZRF_FIELDS_20(d, __VA_ARGS__)
+#define ZRF_FIELDS_22(d, f, ...) d.f, ZRF_FIELDS_21(d, __VA_ARGS__)
+#define ZRF_FIELDS_23(d, f, ...) d.f, ZRF_FIELDS_22(d, __VA_ARGS__)
+#define ZRF_FIELDS_24(d, f, ...) d.f, ZRF_FIELDS_23(d, __VA_ARGS__)
+#define ZRF_FIELDS_25(d, f, ...) d.f, ZRF_FIELDS_24(d, __VA_ARGS__)
+#define ZRF_FIELDS_26(d, f, ...) d.f, ZRF_FIELDS_25(d, __VA_ARGS__)
+#define ZRF_FIELDS_27(d, f, ...) d.f, ZRF_FIELDS_26(d, __VA_ARGS__)
+#define ZRF_FIELDS_28(d, f, ...) d.f, ZRF_FIELDS_27(d, __VA_ARGS__)
+#define ZRF_FIELDS_29(d, f, ...) d.f, ZRF_FIELDS_28(d, __VA_ARGS__)
+#define ZRF_FIELDS_30(d, f, ...) d.f, ZRF_FIELDS_29(d, __VA_ARGS__)
+#define ZRF_FIELDS_31(d, f, ...) d.f, ZRF_FIELDS_30(d, __VA_ARGS__)
+#define ZRF_FIELDS_32(d, f, ...) d.f, ZRF_FIELDS_31(d, __VA_ARGS__)
+
+//expand to offsetof(T, f1), offsetof(T, f2), ...
+#define ZRF_OFFSETS_(T, ...) \
+    ZRF_CAT_(ZRF_OFFSETS_, ZRF_NARGS_(__VA_ARGS__))(T, __VA_ARGS__)
+#define ZRF_OFFSETS_1(T, f) offsetof(T, f)
+#define ZRF_OFFSETS_2(T, f, ...) offsetof(T, f), ZRF_OFFSETS_1(T, __VA_ARGS__)
+#define ZRF_OFFSETS_3(T, f, ...) offsetof(T, f), ZRF_OFFSETS_2(T, __VA_ARGS__)
+#define ZRF_OFFSETS_4(T, f, ...) offsetof(T, f), ZRF_OFFSETS_3(T, __VA_ARGS__)
+#define ZRF_OFFSETS_5(T, f, ...) offsetof(T, f), ZRF_OFFSETS_4(T, __VA_ARGS__)
+#define ZRF_OFFSETS_6(T, f, ...) offsetof(T, f), ZRF_OFFSETS_5(T, __VA_ARGS__)
+#define ZRF_OFFSETS_7(T, f, ...) offsetof(T, f), ZRF_OFFSETS_6(T, __VA_ARGS__)
+#define ZRF_OFFSETS_8(T, f, ...) offsetof(T, f), ZRF_OFFSETS_7(T, __VA_ARGS__)
+#define ZRF_OFFSETS_9(T, f, ...) offsetof(T, f), ZRF_OFFSETS_8(T, __VA_ARGS__)
+#define ZRF_OFFSETS_10(T, f, ...) offsetof(T, f), ZRF_OFFSETS_9(T, __VA_ARGS__)
+#define ZRF_OFFSETS_11(T, f, ...) offsetof(T, f), ZRF_OFFSETS_10(T, __VA_ARGS__)
+#define ZRF_OFFSETS_12(T, f, ...) offsetof(T, f), ZRF_OFFSETS_11(T, __VA_ARGS__)
+#define ZRF_OFFSETS_13(T, f, ...) offsetof(T, f), ZRF_OFFSETS_12(T, __VA_ARGS__)
+#define ZRF_OFFSETS_14(T, f, ...) offsetof(T, f), ZRF_OFFSETS_13(T, __VA_ARGS__)
+#define ZRF_OFFSETS_15(T, f, ...) offsetof(T, f), ZRF_OFFSETS_14(T, __VA_ARGS__)
+#define ZRF_OFFSETS_16(T, f, ...) offsetof(T, f), ZRF_OFFSETS_15(T, __VA_ARGS__)
+#define ZRF_OFFSETS_17(T, f, ...) offsetof(T, f), ZRF_OFFSETS_16(T, __VA_ARGS__)
+#define ZRF_OFFSETS_18(T, f, ...) offsetof(T, f), ZRF_OFFSETS_17(T, __VA_ARGS__)
+#define ZRF_OFFSETS_19(T, f, ...) offsetof(T, f), ZRF_OFFSETS_18(T, __VA_ARGS__)
+#define ZRF_OFFSETS_20(T, f, ...) offsetof(T, f), ZRF_OFFSETS_19(T, __VA_ARGS__)
+#define ZRF_OFFSETS_21(T, f, ...) offsetof(T, f), ZRF_OFFSETS_20(T, __VA_ARGS__)
+#define ZRF_OFFSETS_22(T, f, ...) offsetof(T, f), ZRF_OFFSETS_21(T, __VA_ARGS__)
+#define ZRF_OFFSETS_23(T, f, ...) offsetof(T, f), ZRF_OFFSETS_22(T, __VA_ARGS__)
+#define ZRF_OFFSETS_24(T, f, ...) offsetof(T, f), ZRF_OFFSETS_23(T, __VA_ARGS__)
+#define ZRF_OFFSETS_25(T, f, ...) offsetof(T, f), ZRF_OFFSETS_24(T, __VA_ARGS__)
+#define ZRF_OFFSETS_26(T, f, ...) offsetof(T, f), ZRF_OFFSETS_25(T, __VA_ARGS__)
+#define ZRF_OFFSETS_27(T, f, ...) offsetof(T, f), ZRF_OFFSETS_26(T, __VA_ARGS__)
+#define ZRF_OFFSETS_28(T, f, ...) offsetof(T, f), ZRF_OFFSETS_27(T, __VA_ARGS__)
+#define ZRF_OFFSETS_29(T, f, ...) offsetof(T, f), ZRF_OFFSETS_28(T, __VA_ARGS__)
+#define ZRF_OFFSETS_30(T, f, ...) offsetof(T, f), ZRF_OFFSETS_29(T, __VA_ARGS__)
+#define ZRF_OFFSETS_31(T, f, ...) offsetof(T, f), ZRF_OFFSETS_30(T, __VA_ARGS__)
+#define ZRF_OFFSETS_32(T, f, ...) offsetof(T, f), ZRF_OFFSETS_31(T, __VA_ARGS__)
+
 
 
 //! @}
 
 //! \defgroup \code [Serializer selection]
-//! Return proper specialization from type.
+//! Return proper specialization from type and encoding.
 //! @{
+namespace detail {
+//! Logical compile-time AND condition.
+template< typename H, typename...T >
+struct And {
+    static const bool Value = H::value && And< T... >::Value;
+};
+
+//! Logical compile-time AND condition - end of iteration case.
+template< typename T >
+struct And< T > {
+    static const bool Value = T::value;
+};
+
+//! True if \c T is written as a varint with encoding \c E.
+template< typename T, typename E >
+struct IsVarint : std::integral_constant< bool,
+    E::VARINT_INTEGERS && std::is_integral< T >::value
+    && (sizeof(T) > 1) > {};
+
+//! True if \c T is written in little-endian byte order with encoding
+//! \c E.
+template< typename T, typename E >
+struct IsLittleEndian : std::integral_constant< bool,
+    E::LITTLE_ENDIAN_DATA
+    && (std::is_arithmetic< T >::value || std::is_enum< T >::value)
+    && (sizeof(T) > 1) && !IsVarint< T, E >::value > {};
+
+//! True if fields of \c T are declared with \c ZRF_SERIALIZABLE.
+template< typename T >
+struct HasFields {
+    template< typename U >
+    static auto Test(U* p) -> decltype(ZrfFields(*p), std::true_type());
+    template< typename U >
+    static std::false_type Test(...);
+    static const bool value = decltype(Test< T >(nullptr))::value;
+};
+
+//! Compile-time sum.
+template< size_t... S >
+struct Sum;
+
+template< size_t H, size_t... T >
+struct Sum< H, T... > {
+    static const size_t value = H + Sum< T... >::value;
+};
+
+template<>
+struct Sum<> {
+    static const size_t value = 0;
+};
+
+//! True if offsets are strictly increasing.
+constexpr bool Increasing(size_t) { return true; }
+
+template< typename... T >
+constexpr bool Increasing(size_t a, size_t b, T... t) {
+    return a < b && Increasing(b, t...);
+}
+
+//! True if fields of \c T are listed in declaration order; \c offsetof is
+//! only valid on standard layout types, others are never flat anyway.
+template< typename T, bool = std::is_standard_layout< T >::value >
+struct FieldsOrdered : std::false_type {};
+
+template< typename T >
+struct FieldsOrdered< T, true > : std::integral_constant< bool,
+    ZrfFieldsOrdered(static_cast< const T* >(nullptr),
+                     static_cast< const T* >(nullptr)) > {};
+
+template< typename T, typename E, bool = HasFields< T >::value >
+struct IsFlat;
+
+//! True if \c T is copied as is with encoding \c E.
+template< typename T, typename E >
+struct IsRaw : std::integral_constant< bool,
+    HasFields< T >::value ? IsFlat< T, E >::value
+    : std::is_pod< T >::value && !IsVarint< T, E >::value
+      && !IsLittleEndian< T, E >::value > {};
+
+template< typename E, typename FieldsT >
+struct FieldsFlat;
+
+//! True if listed fields cover the whole object, i.e. there is no padding
+//! and no field left out, and each field is copied as is.
+template< typename E, typename... F >
+struct FieldsFlat< E, std::tuple< F&... > > {
+    static const size_t SIZE = Sum< sizeof(F)... >::value;
+    static const bool value = And< IsRaw< F, E >... >::Value;
+};
+
+//! True if type declared with \c ZRF_SERIALIZABLE can be copied with a
+//! single \c memcpy instead of field by field; fields must be listed in
+//! declaration order so that the list always defines the wire layout.
+template< typename T, typename E >
+struct IsFlat< T, E, true > {
+private:
+    using FF = FieldsFlat< E, decltype(ZrfFields(std::declval< T& >())) >;
+public:
+    static const bool value = std::is_trivially_copyable< T >::value
+                              && FF::SIZE == sizeof(T) && FF::value
+                              && !E::TAGGED_FIELDS
+                              && FieldsOrdered< T >::value;
+};
+
+template< typename T, typename E >
+struct IsFlat< T, E, false > : std::false_type {};
+
+//! Select serializer for scalar types and types declared with
+//! \c ZRF_SERIALIZABLE.
+template< typename T, typename E, bool = HasFields< T >::value >
+struct GetScalarSerializer {
+    using Type = typename std::conditional<
+        IsVarint< T, E >::value,
+        SerializeVarint< T >,
+        typename std::conditional<
+            IsLittleEndian< T, E >::value,
+            SerializePortable< T >,
+            typename std::conditional< std::is_pod< T >::value,
+                                       SerializePOD< T >,
+                                       Serialize< T > >::type >::type
+        >::type;
+};
+
+template< typename T, typename E >
+struct GetScalarSerializer< T, E, true > {
+    using Type = typename std::conditional<
+        E::TAGGED_FIELDS,
+        SerializeTaggedFields< T, E >,
+        typename std::conditional< IsFlat< T, E >::value,
+                                   SerializePOD< T >,
+                                   SerializeFields< T, E > >::type >::type;
+};
+}
+
 //! Select serializer for \code [std::vector< T >] type, also removing
 //! \c cv qualifiers.
-template< typename T >
-struct GetSerializer< std::vector< T > > {
+template< typename T, typename E >
+struct GetSerializer< std::vector< T >, E > {
     using NCV = typename std::remove_cv< T >::type;
-    using Type = typename std::conditional< std::is_pod< NCV >::value,
-                                            SerializeVectorPOD< NCV >,
-                                            SerializeVector< NCV > >::type;
+    using Type = typename std::conditional<
+        detail::IsLittleEndian< NCV, E >::value,
+        SerializeVectorPortable< NCV, E >,
+        typename std::conditional< detail::IsRaw< NCV, E >::value,
+                                   SerializeVectorPOD< NCV, E >,
+                                   SerializeVector< NCV, E > >::type >::type;
 };
 
 //! Select serializer for \c [const std::vector].
-template< typename T >
-struct GetSerializer< const std::vector< T > > {
-    using Type = typename GetSerializer< std::vector< T > >::Type;
+template< typename T, typename E >
+struct GetSerializer< const std::vector< T >, E > {
+    using Type = typename GetSerializer< std::vector< T >, E >::Type;
 };
 
 //! Select serializer for \c [volatile std::vector].
-template< typename T >
-struct GetSerializer< volatile std::vector< T > > {
-    using Type = typename GetSerializer< std::vector< T > >::Type;
+template< typename T, typename E >
+struct GetSerializer< volatile std::vector< T >, E > {
+    using Type = typename GetSerializer< std::vector< T >, E >::Type;
 };
 
 //! Select serializer for scalar type; also removing \cv qualifiers.
-template< typename T >
+template< typename T, typename E >
 struct GetSerializer {
     using NCV = typename std::remove_cv< T >::type;
-    using Type = typename std::conditional< std::is_pod< NCV >::value,
-                                            SerializePOD< NCV >,
-                                            Serialize< NCV > >::type;
+    using Type = typename detail::GetScalarSerializer< NCV, E >::Type;
 };
 
 //! Select serializer for \c std::string.
-template<>
-struct GetSerializer< std::string > {
-    using Type = SerializeString;
+template< typename E >
+struct GetSerializer< std::string, E > {
+    using Type = SerializeBasicString< typename E::Length >;
 };
 
 //! Select serializer for \c [const std::string].
-template<>
-struct GetSerializer< const std::string > {
-    using Type = SerializeString;
+template< typename E >
+struct GetSerializer< const std::string, E > {
+    using Type = SerializeBasicString< typename E::Length >;
 };
 
 //! Select serializer for \c [volatile std::string].
-template<>
-struct GetSerializer< volatile std::string > {
-    using Type = SerializeString;
+template< typename E >
+struct GetSerializer< volatile std::string, E > {
+    using Type = SerializeBasicString< typename E::Length >;
 };
 
-namespace detail {
-//! Logical compile-time AND condition.
-template< typename H, typename...T >
-struct And {
-    static const bool Value = H::value && And< T... >::Value;
+//! Select serializer for \c ArrayView.
+template< typename T, typename E >
+struct GetSerializer< ArrayView< T >, E > {
+    static_assert(!detail::IsVarint< T, E >::value,
+                  "ArrayView elements are not fixed size with encoding");
+    static_assert(!detail::IsLittleEndian< T, E >::value
+                  || detail::HOST_LITTLE_ENDIAN,
+                  "ArrayView elements are not in host byte order");
+    using Type = SerializeArrayView< T, E >;
 };
 
-//! Logical compile-time AND condition - end of iteration case.
-template< typename T >
-struct And< T > {
-    static const bool Value = T::value;
+//! Select serializer for \c [const ArrayView].
+template< typename T, typename E >
+struct GetSerializer< const ArrayView< T >, E > {
+    using Type = typename GetSerializer< ArrayView< T >, E >::Type;
 };
-}
 
-//! Selection of \c tuple serializer: if \c tuple types are all POD then
-//! slect a POD serializer otherwise a generic serializer for copy
-//! constructible objects.
-template< typename...ArgsT >
-struct GetSerializer< std::tuple< ArgsT... > > {
+//! Select serializer for \c StringView.
+template< typename E >
+struct GetSerializer< StringView, E > {
+    using Type = SerializeBasicStringView< typename E::Length >;
+};
+
+//! Select serializer for \c [const StringView].
+template< typename E >
+struct GetSerializer< const StringView, E > {
+    using Type = SerializeBasicStringView< typename E::Length >;
+};
+
+//! Selection of \c tuple serializer: if \c tuple types are all POD copied
+//! as is then slect a POD serializer otherwise serialize elements one by
+//! one.
+template< typename E, typename...ArgsT >
+struct GetSerializer< std::tuple< ArgsT... >, E > {
     using Type =
     typename std::conditional<
-        detail::And< std::is_pod< ArgsT >... >::Value,
+        detail::And< detail::IsRaw< ArgsT, E >... >::Value,
         SerializePOD< std::tuple< ArgsT... > >,
-        Serialize< std::tuple< ArgsT... > > >::type;
+        SerializeBasicTuple< E, ArgsT... > >::type;
 };
 
 //! \code [const tuple] specialization.
-template< typename...ArgsT >
-struct GetSerializer< const std::tuple< ArgsT... > > {
-    using Type =
-    typename std::conditional< detail::And< std::is_pod< ArgsT >... >::Value,
-                               SerializePOD< std::tuple< ArgsT... > >,
-                               Serialize< std::tuple< ArgsT... > > >::type;
+template< typename E, typename...ArgsT >
+struct GetSerializer< const std::tuple< ArgsT... >, E > {
+    using Type = typename GetSerializer< std::tuple< ArgsT... >, E >::Type;
 };
 
 //! \code [\volatile tuple] specialization.
-template< typename...ArgsT >
-struct GetSerializer< volatile std::tuple< ArgsT... > > {
-    using Type =
-    typename std::conditional< detail::And< std::is_pod< ArgsT >... >::Value,
-                               SerializePOD< std::tuple< ArgsT... > >,
-                               Serialize< std::tuple< ArgsT... > > >::type;
+template< typename E, typename...ArgsT >
+struct GetSerializer< volatile std::tuple< ArgsT... >, E > {
+    using Type = typename GetSerializer< std::tuple< ArgsT... >, E >::Type;
+};
+
+
+//! Select serializer for \c std::pair: always element-wise, pairs are not
+//! trivially copyable (copy assignment is user provided) and their layout
+//! is not that of the tuple of the two types.
+template< typename T1, typename T2, typename E >
+struct GetSerializer< std::pair< T1, T2 >, E > {
+    using Type = SerializePair< T1, T2, E >;
+};
+
+//! Select serializer for \c std::array: POD serializer if elements are
+//! copied as is.
+template< typename T, size_t N, typename E >
+struct GetSerializer< std::array< T, N >, E > {
+    using Type = typename std::conditional<
+        detail::IsRaw< T, E >::value,
+        SerializePOD< std::array< T, N > >,
+        SerializeArray< T, N, E > >::type;
+};
+
+template < typename K, typename T, typename C, typename A, typename E >
+struct GetSerializer< std::map< K, T, C, A >, E > {
+    using Type = SerializeBasicMap< std::map< K, T, C, A >, E >;
+};
+
+template < typename K, typename T, typename H, typename P, typename A,
+           typename E >
+struct GetSerializer< std::unordered_map< K, T, H, P, A >, E > {
+    using Type = SerializeBasicMap< std::unordered_map< K, T, H, P, A >, E >;
 };
 
+template < typename K, typename C, typename A, typename E >
+struct GetSerializer< std::set< K, C, A >, E > {
+    using Type = SerializeContainer< std::set< K, C, A >, E >;
+};
+
+template < typename K, typename H, typename P, typename A, typename E >
+struct GetSerializer< std::unordered_set< K, H, P, A >, E > {
+    using Type = SerializeContainer< std::unordered_set< K, H, P, A >, E >;
+};
+
+template < typename T, typename A, typename E >
+struct GetSerializer< std::deque< T, A >, E > {
+    using Type = SerializeContainer< std::deque< T, A >, E >;
+};
 
-template < typename K, typename T >
-struct GetSerializer< std::map< K, T > > {
-    using Type = SerializeMap< K, T >;
+template < typename T, typename A, typename E >
+struct GetSerializer< std::list< T, A >, E > {
+    using Type = SerializeContainer< std::list< T, A >, E >;
 };
 
 //! \defgroup raw pointer serialization
 //! Prevent from automatically serializing raw pointers.
 //! @{
-template< typename T >
-struct GetSerializer< T* >;
-template< typename T >
-struct GetSerializer< const T* >;
-template< typename T >
-struct GetSerializer< volatile T* >;
+template< typename T, typename E >
+struct GetSerializer< T*, E >;
+template< typename T, typename E >
+struct GetSerializer< const T*, E >;
+template< typename T, typename E >
+struct GetSerializer< volatile T*, E >;
 //! @}
 //! @}
 
 
 //! \defgroup Packing/Unpacking
+//! Number of bytes required to serialize data: void specialization.
+inline size_t PackedSize() {
+    return 0;
+}
+
+//! Number of bytes required to serialize data; computed at compile time
+//! for POD types and in one pass over containers.
+template< typename T, typename... ArgsT >
+size_t PackedSize(const T& h, const ArgsT&... t) {
+    return GetSerializer< T >::Type::Size(h) + PackedSize(t...);
+}
+
+//! Serialize data to memory pointed by \c p, which must have room for
+//! \c PackedSize(args...) bytes: void specialization
+inline Byte* Pack(Byte* p) {
+    return p;
+}
+
+//! Serialize data to memory pointed by \c p, return pointer to the byte
+//! following the last written byte
+template< typename T, typename... ArgsT >
+Byte* Pack(Byte* p, const T& h, const ArgsT&... t) {
+    return Pack(GetSerializer< T >::Type::Pack(h, p), t...);
+};
+
 //! Serialize data to byte array: void specialization.
 inline ByteArray Pack(ByteArray ba) {
     return ba;
 }
 
-//! Serialize data to byte array.
+//! Serialize data to byte array, resized once to the packed size.
 template< typename T, typename... ArgsT >
 ByteArray Pack(ByteArray ba, const T& h, const ArgsT&... t) {
-    return Pack(GetSerializer< T >::Type::Pack(h, std::move(ba)), t...);
+    const size_t sz = ba.size();
+    ba.resize(sz + PackedSize(h, t...));
+    Pack(ba.data() + sz, h, t...);
+    return ba;
 };
 
 //! Serialize data into newly created byte array.
@@ -376,26 +1853,24 @@ inline ByteIterator Pack(ByteIterator bi) {
 //! Serialize data to byte array at position pointed by iterator
 template< typename T, typename... ArgsT >
 ByteIterator Pack(ByteIterator bi, const T& h, const ArgsT&... t) {
-    return Pack(GetSerializer< T >::Type::Pack(h, bi), t...);
+    Byte* p = &*bi;
+    return bi + (Pack(p, h, t...) - p);
 };
 
 
-//! Serialize data to byte array in place, termination condition
-inline size_t Pack(ByteArray&) {
-    return 0;
-}
-
-//! Serialize data to byte array in place
-template< typename T, typename... ArgsT >
-size_t Pack(ByteArray& ba, const T& h, const ArgsT&... t) {
+//! Serialize data to byte array in place: data is appended to the array,
+//! return number of bytes added
+template< typename... ArgsT >
+size_t PackAppend(ByteArray& ba, const ArgsT&... t) {
     const size_t sz = ba.size();
-    ba.resize(sz + sizeof(T));
-    GetSerializer< T >::Type::Pack(h, ba.begin() + sz);
-    return sizeof(T) + Pack(ba, t...);
+    const size_t n = PackedSize(t...);
+    ba.resize(sz + n);
+    Pack(ba.data() + sz, t...);
+    return n;
 };
 
 template< typename... ArgsT >
-ByteArray PackArgs(ArgsT...args) {
+ByteArray PackArgs(const ArgsT&...args) {
     return Pack(ByteArray(), args...);
 };
 
@@ -509,4 +1984,235 @@ std::tuple< ArgsT... > UnPackTuple(const ByteArray& ba) {
     return detail::UnpackTHelper< ArgsT... >::Unpack(bi);
 }
 
-}
\ No newline at end of file
+//! \defgroup Checked unpacking
+//! De-serialize data from view, consuming the unpacked bytes; does not
+//! read past the end of the view and does not throw on malformed data.
+//! @{
+template< typename T >
+UnPackStatus UnPack(ByteView& v, T& d) {
+    return GetSerializer< T >::Type::UnPack(v, d);
+}
+
+//! Unpack values packed with \c Pack(args...): void specialization.
+inline UnPackStatus UnPackArgs(ByteView&) {
+    return UNPACK_OK;
+}
+
+//! Unpack values packed with \c Pack(args...), stop at first error.
+template< typename T, typename... ArgsT >
+UnPackStatus UnPackArgs(ByteView& v, T& h, ArgsT&... t) {
+    const UnPackStatus st = UnPack(v, h);
+    return st != UNPACK_OK ? st : UnPackArgs(v, t...);
+}
+
+namespace detail {
+template< typename... ArgsT, size_t... Is >
+UnPackStatus UnPackTupleHelper(ByteView& v, std::tuple< ArgsT... >& t,
+                               const Seq< Is... >&) {
+    return UnPackArgs(v, std::get< Is >(t)...);
+}
+}
+
+//! Unpack individual values packed with \c Pack(args...) into tuple.
+template< typename... ArgsT >
+UnPackStatus UnPackTuple(ByteView& v, std::tuple< ArgsT... >& t) {
+    return detail::UnPackTupleHelper(
+        v, t, typename detail::GenSeq< sizeof...(ArgsT) >::Type());
+}
+//! @}
+
+//! \defgroup Packing/Unpacking with encoding
+//! Same as the functions above, with data serialized through
+//! \c GetSerializer< T, E > e.g.
+//! \code
+//! ByteArray ba = PackWith< CompactEncoding >(1, std::string("one"));
+//! ByteView v(ba);
+//! int i;
+//! std::string s;
+//! UnPackArgsWith< CompactEncoding >(v, i, s);
+//! \endcode
+//! @{
+namespace detail {
+//! Serialization of argument lists with encoding \c E.
+template< typename E >
+struct Args {
+    static size_t Size() {
+        return 0;
+    }
+    template< typename T, typename... ArgsT >
+    static size_t Size(const T& h, const ArgsT&... t) {
+        return GetSerializer< T, E >::Type::Size(h) + Size(t...);
+    }
+    static Byte* Pack(Byte* p) {
+        return p;
+    }
+    template< typename T, typename... ArgsT >
+    static Byte* Pack(Byte* p, const T& h, const ArgsT&... t) {
+        return Pack(GetSerializer< T, E >::Type::Pack(h, p), t...);
+    }
+    static UnPackStatus UnPack(ByteView&) {
+        return UNPACK_OK;
+    }
+    template< typename T, typename... ArgsT >
+    static UnPackStatus UnPack(ByteView& v, T& h, ArgsT&... t) {
+        const UnPackStatus st = GetSerializer< T, E >::Type::UnPack(v, h);
+        return st != UNPACK_OK ? st : UnPack(v, t...);
+    }
+    template< typename... ArgsT, size_t... Is >
+    static UnPackStatus UnPackTuple(ByteView& v, std::tuple< ArgsT... >& t,
+                                    const Seq< Is... >&) {
+        return UnPack(v, std::get< Is >(t)...);
+    }
+};
+}
+
+template< typename E, typename... ArgsT >
+size_t PackedSizeWith(const ArgsT&... t) {
+    return detail::Args< E >::Size(t...);
+}
+
+//! Serialize data into newly created byte array.
+template< typename E, typename... ArgsT >
+ByteArray PackWith(const ArgsT&... t) {
+    ByteArray ba(PackedSizeWith< E >(t...));
+    detail::Args< E >::Pack(ba.data(), t...);
+    return ba;
+}
+
+//! Append serialized data to byte array, return number of bytes added.
+template< typename E, typename... ArgsT >
+size_t PackAppendWith(ByteArray& ba, const ArgsT&... t) {
+    const size_t sz = ba.size();
+    const size_t n = PackedSizeWith< E >(t...);
+    ba.resize(sz + n);
+    detail::Args< E >::Pack(ba.data() + sz, t...);
+    return n;
+}
+
+template< typename E, typename T >
+ConstByteIterator UnPackWith(ConstByteIterator bi, T& d) {
+    return GetSerializer< T, E >::Type::UnPack(bi, d);
+}
+
+template< typename E, typename T >
+UnPackStatus UnPackWith(ByteView& v, T& d) {
+    return GetSerializer< T, E >::Type::UnPack(v, d);
+}
+
+template< typename E, typename... ArgsT >
+UnPackStatus UnPackArgsWith(ByteView& v, ArgsT&... t) {
+    return detail::Args< E >::UnPack(v, t...);
+}
+
+template< typename E, typename... ArgsT >
+UnPackStatus UnPackTupleWith(ByteView& v, std::tuple< ArgsT... >& t) {
+    return detail::Args< E >::UnPackTuple(
+        v, t, typename detail::GenSeq< sizeof...(ArgsT) >::Type());
+}
+//! @}
+
+//! \defgroup Messages
+//! Data exchanged between peers, e.g. through \c RAWOutStream::SendArgs,
+//! starts with a header identifying the encoding, so that a reader
+//! configured with another encoding rejects the message with
+//! \c UNPACK_FORMAT_MISMATCH instead of misreading lengths and data:
+//! \code
+//! | FORMAT_MAGIC | E::FORMAT | data |
+//! \endcode
+//! \c RawEncoding messages have no header and are laid out exactly as
+//! written by peers predating it, which keep working with new peers as
+//! long as both use the default encoding; raw data starting with the magic
+//! bytes followed by a known format is rejected by raw readers.
+//! @{
+static const Byte FORMAT_MAGIC[] = {0x7f, 'z', 'r', 'f'};
+
+//! Size of the header of messages written with encoding \c E.
+template< typename E >
+constexpr size_t FormatHeaderSize() {
+    return E::FORMAT ? sizeof(FORMAT_MAGIC) + 1 : 0;
+}
+
+//! Format of the encoding of a message, \c RawEncoding::FORMAT if there is
+//! no header.
+inline Byte MessageFormat(const ByteView& v) {
+    if(v.Size() <= sizeof(FORMAT_MAGIC)
+       || memcmp(v.Data(), FORMAT_MAGIC, sizeof(FORMAT_MAGIC)))
+        return RawEncoding::FORMAT;
+    const Byte f = v.Data()[sizeof(FORMAT_MAGIC)];
+    return f > RawEncoding::FORMAT && f <= TaggedEncoding::FORMAT
+           ? f : RawEncoding::FORMAT;
+}
+
+//! Skip header of message written with encoding \c E; returns
+//! \c UNPACK_FORMAT_MISMATCH if the message was written with another
+//! encoding.
+template< typename E >
+UnPackStatus UnPackFormatHeader(ByteView& v) {
+    if(MessageFormat(v) != E::FORMAT) return UNPACK_FORMAT_MISMATCH;
+    v.Consume(FormatHeaderSize< E >());
+    return UNPACK_OK;
+}
+
+//! Serialize data into newly created byte array, preceded by the header
+//! of encoding \c E.
+template< typename E, typename... ArgsT >
+ByteArray PackMessageWith(const ArgsT&... t) {
+    const size_t h = FormatHeaderSize< E >();
+    ByteArray ba(h + PackedSizeWith< E >(t...));
+    if(h) {
+        memcpy(ba.data(), FORMAT_MAGIC, sizeof(FORMAT_MAGIC));
+        ba[sizeof(FORMAT_MAGIC)] = E::FORMAT;
+    }
+    detail::Args< E >::Pack(ba.data() + h, t...);
+    return ba;
+}
+
+template< typename E, typename... ArgsT >
+UnPackStatus UnPackMessageWith(ByteView& v, ArgsT&... t) {
+    const UnPackStatus st = UnPackFormatHeader< E >(v);
+    return st != UNPACK_OK ? st : UnPackArgsWith< E >(v, t...);
+}
+
+template< typename E, typename... ArgsT >
+UnPackStatus UnPackMessageTupleWith(ByteView& v,
+                                    std::tuple< ArgsT... >& t) {
+    const UnPackStatus st = UnPackFormatHeader< E >(v);
+    return st != UNPACK_OK ? st : UnPackTupleWith< E >(v, t);
+}
+//! @}
+
+//! \defgroup Zero-copy unpacking
+//! Unpack \c vector of POD types and \c std::string as non-owning views
+//! into the serialized data, with no allocation or copy; the returned views
+//! are valid as long as the buffer holding the data is.
+//! @{
+//! View type returned by \c UnPackView< T >
+template< typename T >
+struct ViewOf;
+
+template< typename T >
+struct ViewOf< std::vector< T > > {
+    using Type = ArrayView< T >;
+};
+
+template<>
+struct ViewOf< std::string > {
+    using Type = StringView;
+};
+
+//! Return view over data serialized as \c T from byte array iterator.
+template< typename T >
+typename ViewOf< T >::Type UnPackView(ConstByteIterator bi) {
+    typename ViewOf< T >::Type d;
+    UnPack(bi, d);
+    return d;
+}
+
+//! Checked unpacking of view over data serialized as \c T.
+template< typename T >
+UnPackStatus UnPackView(ByteView& v, typename ViewOf< T >::Type& d) {
+    return UnPack(v, d);
+}
+//! @}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace zrf {
+
+//==============================================================================
+//Batch statistics of an I/O loop: number of non-empty batches, number of
+//messages and largest batch size, for both receive and send.
+//Use to tune the batch budget: a maximum batch size equal to the budget
+//means the loop had more data available than it was allowed to process
+struct BatchStats {
+    std::uint64_t recvBatches;
+    std::uint64_t recvMessages;
+    std::uint64_t maxRecvBatch;
+    std::uint64_t sendBatches;
+    std::uint64_t sendMessages;
+    std::uint64_t maxSendBatch;
+    double AverageRecvBatch() const {
+        return recvBatches ? double(recvMessages) / recvBatches : 0.;
+    }
+    double AverageSendBatch() const {
+        return sendBatches ? double(sendMessages) / sendBatches : 0.;
+    }
+};
+
+//Counters updated by the I/O thread only, readable from any thread
+class BatchCounters {
+public:
+    BatchCounters() : recvBatches_(0), recvMessages_(0), maxRecvBatch_(0),
+                      sendBatches_(0), sendMessages_(0), maxSendBatch_(0) {}
+    void AddRecv(size_t n) {
+        Add(n, recvBatches_, recvMessages_, maxRecvBatch_);
+    }
+    void AddSend(size_t n) {
+        Add(n, sendBatches_, sendMessages_, maxSendBatch_);
+    }
+    BatchStats Get() const {
+        return {recvBatches_.load(), recvMessages_.load(),
+                maxRecvBatch_.load(), sendBatches_.load(),
+                sendMessages_.load(), maxSendBatch_.load()};
+    }
+private:
+    using Counter = std::atomic< std::uint64_t >;
+    //single writer: no read-modify-write operation required
+    static void Add(size_t n, Counter& batches, Counter& messages,
+                    Counter& maxBatch) {
+        if(!n) return;
+        const std::memory_order mo = std::memory_order_relaxed;
+        batches.store(batches.load(mo) + 1, mo);
+        messages.store(messages.load(mo) + n, mo);
+        if(n > maxBatch.load(mo)) maxBatch.store(n, mo);
+    }
+private:
+    Counter recvBatches_;
+    Counter recvMessages_;
+    Counter maxRecvBatch_;
+    Counter sendBatches_;
+    Counter sendMessages_;
+    Counter maxSendBatch_;
+};
+
+//==============================================================================
+//Request window of a client: requests waiting for a reply and request bytes
+//queued for sending, number of sends which waited for the window to open
+//and total time spent waiting, number of sends rejected because the window
+//was full
+struct WindowStats {
+    std::uint64_t inFlight;
+    std::uint64_t queuedBytes;
+    std::uint64_t blockedSends;
+    std::uint64_t blockedNs;
+    std::uint64_t rejectedSends;
+    double AverageBlockedNs() const {
+        return blockedSends ? double(blockedNs) / blockedSends : 0.;
+    }
+};
+
+//Counters updated by any sending thread, readable from any thread
+class WindowCounters {
+public:
+    WindowCounters() : blockedSends_(0), blockedNs_(0), rejectedSends_(0) {}
+    void AddBlocked(std::uint64_t ns) {
+        blockedSends_.fetch_add(1, std::memory_order_relaxed);
+        blockedNs_.fetch_add(ns, std::memory_order_relaxed);
+    }
+    void AddRejected() {
+        rejectedSends_.fetch_add(1, std::memory_order_relaxed);
+    }
+    WindowStats Get(std::uint64_t inFlight, std::uint64_t queuedBytes) const {
+        return {inFlight, queuedBytes, blockedSends_.load(),
+                blockedNs_.load(), rejectedSends_.load()};
+    }
+private:
+    using Counter = std::atomic< std::uint64_t >;
+    Counter blockedSends_;
+    Counter blockedNs_;
+    Counter rejectedSends_;
+};
+
+}
@@ -0,0 +1,147 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace zrf {
+
+//==============================================================================
+//TimerWheel:
+// hashed timing wheel: timers are stored in the slot of their expiration
+// tick, adding a timer and expiring it are O(1); timers expiring after
+// more than one rotation stay in their slot until their tick is reached.
+// Timers cannot be removed: owners of values whose timer is no longer
+// needed must ignore the expiration, e.g. request ids of completed
+// requests. Not thread safe, memory of slots is reused once allocated.
+//usage:
+//TimerWheel< ReqId > timers;
+//timers.Add(rid, Clock::now() + std::chrono::milliseconds(100));
+//...
+//timers.Advance(Clock::now(), [](ReqId rid) { Fail(rid); });
+//reactor.Wait(socket, timers.NextTimeout(Clock::now()));
+template < typename T >
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    ///@param numSlots number of slots, rounded up to a power of two
+    ///@param tick resolution
+    explicit TimerWheel(size_t numSlots = 1024,
+                        Clock::duration tick = std::chrono::milliseconds(1))
+        : start_(Clock::now()), tick_(tick), current_(0), size_(0),
+          next_(NONE) {
+        size_t n = 1;
+        while(n < numSlots) n *= 2;
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+    size_t Size() const {
+        return size_;
+    }
+    bool Empty() const {
+        return size_ == 0;
+    }
+    ///Add timer expiring at deadline, rounded up to the next tick; timers
+    ///already expired fire at the next tick
+    void Add(const T& v, Clock::time_point deadline) {
+        std::uint64_t t = Tick(deadline + tick_ - Clock::duration(1));
+        if(t < current_) t = current_;
+        slots_[t & mask_].push_back(Entry{v, t});
+        ++size_;
+        if(next_ != UNKNOWN && t < next_) next_ = t;
+    }
+    ///Invoke expired(v) for all timers expired at time now, in no
+    ///particular order; returns number of expired timers
+    template < typename F >
+    size_t Advance(Clock::time_point now, const F& expired) {
+        const std::uint64_t t = Tick(now);
+        if(t < current_) return 0;
+        //nothing to expire
+        if(!size_ || (next_ != UNKNOWN && t < next_)) {
+            if(!size_) current_ = t + 1;
+            return 0;
+        }
+        //visit each slot at most once
+        const std::uint64_t end =
+            t - current_ < mask_ ? t + 1 : current_ + mask_ + 1;
+        size_t n = 0;
+        for(std::uint64_t c = current_; c != end; ++c) {
+            std::vector< Entry >& s = slots_[c & mask_];
+            for(size_t i = 0; i < s.size();) {
+                if(s[i].tick > t) {
+                    ++i;
+                    continue;
+                }
+                const T v = s[i].value;
+                s[i] = s.back();
+                s.pop_back();
+                --size_;
+                ++n;
+                expired(v);
+            }
+        }
+        current_ = t + 1;
+        next_ = size_ ? UNKNOWN : NONE;
+        return n;
+    }
+    ///Milliseconds until the next timer expires, rounded up, -1 if there
+    ///are no timers: use as timeout when waiting for events
+    int NextTimeout(Clock::time_point now) {
+        if(!size_) return -1;
+        if(next_ == UNKNOWN) next_ = FindNext();
+        const Clock::time_point d = start_ + tick_ * next_;
+        if(d <= now) return 0;
+        using namespace std::chrono;
+        return int(duration_cast< milliseconds >(d - now
+                                                 + milliseconds(1)
+                                                 - nanoseconds(1)).count());
+    }
+private:
+    struct Entry {
+        T value;
+        std::uint64_t tick;
+    };
+    static const std::uint64_t NONE = ~std::uint64_t(0);
+    static const std::uint64_t UNKNOWN = NONE - 1;
+    //number of ticks elapsed at tp
+    std::uint64_t Tick(Clock::time_point tp) const {
+        if(tp <= start_) return 0;
+        return std::uint64_t((tp - start_) / tick_);
+    }
+    //first tick with timers: scan one rotation, timers in later rotations
+    //are found by scanning again after the rotation
+    std::uint64_t FindNext() const {
+        for(std::uint64_t c = current_; c != current_ + mask_ + 1; ++c) {
+            const std::vector< Entry >& s = slots_[c & mask_];
+            for(size_t i = 0; i != s.size(); ++i)
+                if(s[i].tick <= c) return c;
+        }
+        return current_ + mask_;
+    }
+private:
+    std::vector< std::vector< Entry > > slots_;
+    std::uint64_t mask_;
+    Clock::time_point start_;
+    Clock::duration tick_;
+    //first tick not yet expired
+    std::uint64_t current_;
+    size_t size_;
+    //first tick with timers, UNKNOWN if not computed, NONE if no timers
+    std::uint64_t next_;
+};
+
+}
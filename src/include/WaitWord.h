@@ -0,0 +1,154 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <climits>
+#include <chrono>
+
+#ifdef __linux__
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace zrf {
+
+//==============================================================================
+//WaitWord:
+// blocking wait for lock-free data structures; threads sleep on a futex
+// (mutex + condition variable on non-Linux systems) until woken up by
+// another thread.
+// Wake() does not write any shared memory location unless threads are
+// waiting, so signalling is only a memory fence in the common case.
+//usage:
+//consumer:
+//T d;
+//notEmpty.Wait([&]() { return queue.TryPop(d); });
+//producer:
+//queue.TryPush(d);
+//notEmpty.Wake();
+class WaitWord {
+public:
+    WaitWord() : epoch_(0), waiters_(0) {}
+    WaitWord(const WaitWord&) = delete;
+    WaitWord& operator=(const WaitWord&) = delete;
+    ///Block until ready() returns true; ready() is evaluated again every
+    ///time the thread is woken up
+    template < typename PredicateT >
+    void Wait(const PredicateT& ready) {
+        while(true) {
+            //register as waiter before reading epoch: a Wake() issued
+            //after the read is guaranteed to see the waiter and to change
+            //the epoch, preventing the thread from sleeping
+            waiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int e = epoch_.load();
+            if(ready()) {
+                waiters_.fetch_sub(1);
+                return;
+            }
+            Sleep(e);
+            waiters_.fetch_sub(1);
+        }
+    }
+    ///Block until ready() returns true or the timeout expires; returns
+    ///false on timeout
+    template < typename PredicateT, typename RepT, typename PeriodT >
+    bool WaitFor(const PredicateT& ready,
+                 const std::chrono::duration< RepT, PeriodT >& timeout) {
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point deadline = Clock::now()
+            + std::chrono::duration_cast< Clock::duration >(timeout);
+        while(true) {
+            waiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int e = epoch_.load();
+            if(ready()) {
+                waiters_.fetch_sub(1);
+                return true;
+            }
+            const Clock::time_point now = Clock::now();
+            if(now >= deadline) {
+                waiters_.fetch_sub(1);
+                return false;
+            }
+            SleepFor(e, deadline - now);
+            waiters_.fetch_sub(1);
+        }
+    }
+    ///Wake up one (default) or all waiting threads
+    void Wake(bool all = false) {
+        //order the caller's update of the wait condition before reading
+        //waiters_: either the waiter is seen here or it sees the update
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!waiters_.load(std::memory_order_relaxed)) return;
+        epoch_.fetch_add(1);
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast< int* >(&epoch_),
+                FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+        {
+            std::lock_guard< std::mutex > lg(mutex_);
+        }
+        if(all) cond_.notify_all();
+        else cond_.notify_one();
+#endif
+    }
+private:
+    //sleep until epoch changes
+    void Sleep(int e) {
+#ifdef __linux__
+        static_assert(sizeof(epoch_) == sizeof(int),
+                      "futex requires int sized atomic");
+        syscall(SYS_futex, reinterpret_cast< int* >(&epoch_),
+                FUTEX_WAIT_PRIVATE, e, nullptr, nullptr, 0);
+#else
+        std::unique_lock< std::mutex > lock(mutex_);
+        cond_.wait(lock, [this, e]() { return epoch_.load() != e; });
+#endif
+    }
+    //sleep until epoch changes or timeout expires
+    void SleepFor(int e, std::chrono::steady_clock::duration timeout) {
+#ifdef __linux__
+        using namespace std::chrono;
+        const nanoseconds ns = duration_cast< nanoseconds >(timeout);
+        timespec ts;
+        ts.tv_sec = time_t(ns.count() / 1000000000);
+        ts.tv_nsec = long(ns.count() % 1000000000);
+        //relative timeout
+        syscall(SYS_futex, reinterpret_cast< int* >(&epoch_),
+                FUTEX_WAIT_PRIVATE, e, &ts, nullptr, 0);
+#else
+        std::unique_lock< std::mutex > lock(mutex_);
+        cond_.wait_for(lock, timeout,
+                       [this, e]() { return epoch_.load() != e; });
+#endif
+    }
+private:
+    std::atomic< int > epoch_;
+    std::atomic< int > waiters_;
+#ifndef __linux__
+    std::mutex mutex_;
+    std::condition_variable cond_;
+#endif
+};
+
+}
@@ -0,0 +1,156 @@
+#pragma once
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "WaitWord.h"
+
+namespace zrf {
+
+//==============================================================================
+//WorkStealingQueue:
+// one deque per worker; the dispatching thread pushes each element into the
+// deque of a specific worker, workers pop from their own deque and, when
+// stealing is enabled, take elements from the other workers' deques when
+// their own is empty.
+// Elements are always taken from the front: the order in which elements
+// pushed into the same deque are processed is preserved when stealing is
+// disabled, and the oldest elements are served first when it is enabled.
+// Locks are per deque, so workers only contend when stealing.
+// Deques can be bounded: Push never blocks, the dispatching thread checks
+// Full before pushing and stops dispatching while any deque is full.
+//usage:
+//WorkStealingQueue< Request > q;
+//q.Reset(numWorkers, true, 4096);
+//dispatching thread:
+//if(!q.Full()) q.Push(q.Next(), std::move(request)); //round robin
+//worker i:
+//Request r;
+//while(q.Pop(i, r)) Process(r);
+//any thread:
+//q.Stop(); //Pop returns false
+template < typename T >
+class WorkStealingQueue {
+public:
+    WorkStealingQueue()
+        : stealing_(true), stop_(false), next_(0), capacity_(0) {}
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+    ///Create one deque per worker and discard any queued element;
+    ///not thread safe: call before starting the workers
+    ///@param capacity maximum number of elements per deque checked by
+    ///       Full, 0 for unbounded deques
+    void Reset(size_t numWorkers, bool stealing, size_t capacity = 0) {
+        lanes_.clear();
+        for(size_t i = 0; i != numWorkers; ++i)
+            lanes_.push_back(std::unique_ptr< Lane >(new Lane));
+        //with stealing enabled any worker can process any element: all
+        //the workers sleep on the same word and one is woken up per push
+        words_.reset(new WaitWord[stealing ? 1 : numWorkers]);
+        stealing_ = stealing;
+        stop_ = false;
+        next_ = 0;
+        capacity_ = capacity;
+    }
+    size_t NumWorkers() const {
+        return lanes_.size();
+    }
+    ///True if any deque is bounded and full: the next element might not
+    ///fit in the deque it is pushed into; exact when called from the
+    ///dispatching thread, the only one increasing sizes
+    bool Full() const {
+        if(!capacity_) return false;
+        for(size_t i = 0; i != lanes_.size(); ++i)
+            if(lanes_[i]->size.load(std::memory_order_relaxed) >= capacity_)
+                return true;
+        return false;
+    }
+    ///Next worker index in round robin order, call from dispatching thread
+    size_t Next() {
+        const size_t i = next_;
+        next_ = (next_ + 1) % lanes_.size();
+        return i;
+    }
+    void Push(size_t worker, T&& e) {
+        Lane& l = *lanes_[worker];
+        {
+            std::lock_guard< std::mutex > lg(l.mutex);
+            l.queue.push_back(std::move(e));
+            l.size.store(l.queue.size(), std::memory_order_relaxed);
+        }
+        Word(worker).Wake();
+    }
+    ///Block until an element is available to worker or Stop is called
+    ///@return false if stopped
+    bool Pop(size_t worker, T& e) {
+        bool ok = false;
+        Word(worker).Wait([this, worker, &e, &ok]() {
+            if(stop_) return true;
+            ok = TryPop(worker, e) || (stealing_ && Steal(worker, e));
+            return ok;
+        });
+        return ok;
+    }
+    ///Unblock all workers, thread safe
+    void Stop() {
+        stop_ = true;
+        for(size_t i = 0; i != (stealing_ ? 1 : lanes_.size()); ++i)
+            words_[i].Wake(true);
+    }
+private:
+    struct Lane {
+        Lane() : size(0) {}
+        std::mutex mutex;
+        std::deque< T > queue;
+        //number of elements, readable without locking
+        std::atomic< size_t > size;
+    };
+    WaitWord& Word(size_t worker) {
+        return words_[stealing_ ? 0 : worker];
+    }
+    bool TryPop(size_t worker, T& e) {
+        Lane& l = *lanes_[worker];
+        if(!l.size.load(std::memory_order_relaxed)) return false;
+        std::lock_guard< std::mutex > lg(l.mutex);
+        if(l.queue.empty()) return false;
+        e = std::move(l.queue.front());
+        l.queue.pop_front();
+        l.size.store(l.queue.size(), std::memory_order_relaxed);
+        return true;
+    }
+    //visit other workers' deques starting from the next one
+    bool Steal(size_t worker, T& e) {
+        for(size_t k = 1; k < lanes_.size(); ++k)
+            if(TryPop((worker + k) % lanes_.size(), e)) return true;
+        return false;
+    }
+private:
+    std::vector< std::unique_ptr< Lane > > lanes_;
+    std::unique_ptr< WaitWord[] > words_;
+    bool stealing_;
+    std::atomic< bool > stop_;
+    size_t next_;
+    //maximum number of elements per deque, 0 if unbounded
+    size_t capacity_;
+};
+
+}
@@ -18,7 +18,11 @@
 #include <iostream>
 #include <stdexcept>
 #include <cstring>
+#include <cerrno>
 #include <vector>
+#include <string>
+#include <tuple>
+#include <functional>
 
 
 namespace zrf {
@@ -40,15 +44,18 @@ struct MakeIndexSequence< 0, Ints... > {
     using Type = IndexSequence< Ints... >;
 };
 
+//callables are passed by reference: calling must not copy the
+//std::function or the functor
+
 template< typename R, int...Ints, typename...ArgsT >
-R CallHelper(std::function< R(ArgsT...) > f,
+R CallHelper(const std::function< R(ArgsT...) >& f,
              std::tuple< ArgsT... > args,
              const IndexSequence< Ints... >&) {
     return f(std::get< Ints >(args)...);
 };
 
 template< typename R, int...Ints, typename...ArgsT >
-R Call(std::function< R(ArgsT...) > f,
+R Call(const std::function< R(ArgsT...) >& f,
        std::tuple< ArgsT... > args) {
     return CallHelper(f, args,
                       typename MakeIndexSequence< sizeof...(ArgsT) >::Type());
@@ -64,32 +71,70 @@ R CallFHelper(const F& f,
 template< typename R, typename F, int...Ints, typename...ArgsT >
 R CallF(const F& f,
         std::tuple< ArgsT... > args) {
-    return CallHelper< R >(f, args,
+    return CallFHelper< R >(f, args,
                       typename MakeIndexSequence< sizeof...(ArgsT) >::Type());
 };
 
 
 template< typename R, int...Ints, typename...ArgsT >
-R MoveCallHelper(std::function< R(ArgsT...) > f,
+R MoveCallHelper(const std::function< R(ArgsT...) >& f,
                  std::tuple< ArgsT... >&& args,
                  const IndexSequence< Ints... >&) {
     return f(std::move(std::get< Ints >(args))...);
 };
 
 template< typename R, int...Ints, typename...ArgsT >
-R MoveCall(std::function< R(ArgsT...) > f,
+R MoveCall(const std::function< R(ArgsT...) >& f,
            std::tuple< ArgsT... >&& args) {
     return MoveCallHelper(f, std::move(args),
                           typename
                           MakeIndexSequence< sizeof...(ArgsT) >::Type());
 };
 
+//any callable, including mutable lambdas
+template< typename R, typename F, int...Ints, typename...ArgsT >
+R MoveCallFHelper(F& f,
+                  std::tuple< ArgsT... >&& args,
+                  const IndexSequence< Ints... >&) {
+    return f(std::move(std::get< Ints >(args))...);
+};
+
+template< typename R, typename F, typename...ArgsT >
+R MoveCallF(F& f, std::tuple< ArgsT... >&& args) {
+    return MoveCallFHelper< R >(f, std::move(args),
+                                typename
+                                MakeIndexSequence< sizeof...(ArgsT) >::Type());
+};
+
 template< typename T >
 struct RemoveAll {
     using Type = typename std::remove_cv<
         typename std::remove_reference< T >::type >::type;
 };
 
+//return type and argument types of lambdas, functors with a single
+//operator() and function pointers; reference and cv qualifiers are removed
+//from the argument types
+template< typename F >
+struct CallableTraits : CallableTraits< decltype(&F::operator()) > {};
+
+template< typename R, typename...ArgsT >
+struct CallableTraits< R (*)(ArgsT...) > {
+    using Return = R;
+    using Args = std::tuple< typename RemoveAll< ArgsT >::Type... >;
+};
+
+template< typename R, typename...ArgsT >
+struct CallableTraits< R (ArgsT...) > : CallableTraits< R (*)(ArgsT...) > {};
+
+template< typename C, typename R, typename...ArgsT >
+struct CallableTraits< R (C::*)(ArgsT...) >
+    : CallableTraits< R (*)(ArgsT...) > {};
+
+template< typename C, typename R, typename...ArgsT >
+struct CallableTraits< R (C::*)(ArgsT...) const >
+    : CallableTraits< R (*)(ArgsT...) > {};
+
 namespace {
 
 void Log() {
@@ -122,12 +167,47 @@ void ZCleanup(void* context, void* zmqsocket) {
     ZCheck(zmq_ctx_destroy(context));
 }
 
+//zmq deallocation callback of buffers sent with SendNoCopy
+void FreeByteArray(void*, void* hint) {
+    delete static_cast< ByteArray* >(hint);
+}
+
+//buffers smaller than this are copied by SendNoCopy: cheaper than
+//allocating the owner of the data
+const size_t NO_COPY_MIN_SIZE = 0x400;
+
+//send buffer without copying its data: the zmq message takes ownership of
+//the buffer and releases it once sent
+void SendNoCopy(void* sock, ByteArray&& buffer, int flags) {
+    if(buffer.size() < NO_COPY_MIN_SIZE) {
+        ZCheck(zmq_send(sock, buffer.data(), buffer.size(), flags));
+        return;
+    }
+    ByteArray* owner = new ByteArray(std::move(buffer));
+    zmq_msg_t msg;
+    if(zmq_msg_init_data(&msg, owner->data(), owner->size(),
+                         FreeByteArray, owner)) {
+        delete owner;
+        ZCheck(-1);
+    }
+    if(zmq_msg_send(&msg, sock, flags) < 0) {
+        const int err = errno;
+        zmq_msg_close(&msg); //releases owner
+        errno = err;
+        ZCheck(-1);
+    }
+}
+
 }
 
 struct NoSizeInfoTransmissionPolicy {
     static void SendBuffer(void* sock, const ByteArray& buffer) {
         ZCheck(zmq_send(sock, buffer.data(), buffer.size(), 0));
     }
+    //send moved buffer, data is not copied
+    static void SendBuffer(void* sock, ByteArray&& buffer) {
+        SendNoCopy(sock, std::move(buffer), 0);
+    }
     static const bool RESIZE_BUFFER = false;
     static bool ReceiveBuffer(void* sock, ByteArray& buffer, bool block) {
         const int b = block ? 0 : ZMQ_NOBLOCK;
@@ -136,6 +216,11 @@ struct NoSizeInfoTransmissionPolicy {
         buffer.resize(rc);
         return true;
     }
+    //receive into zmq owned message: no size limit, no copy
+    static bool ReceiveMessage(void* sock, zmq_msg_t* msg, bool block) {
+        const int b = block ? 0 : ZMQ_NOBLOCK;
+        return zmq_msg_recv(msg, sock, b) >= 0;
+    }
 };
 
 struct SizeInfoTransmissionPolicy {
@@ -144,6 +229,11 @@ struct SizeInfoTransmissionPolicy {
         ZCheck(zmq_send(sock, &sz, sizeof(sz), ZMQ_SNDMORE));
         ZCheck(zmq_send(sock, buffer.data(), buffer.size(), 0));
     }
+    static void SendBuffer(void* sock, ByteArray&& buffer) {
+        const size_t sz = buffer.size();
+        ZCheck(zmq_send(sock, &sz, sizeof(sz), ZMQ_SNDMORE));
+        SendNoCopy(sock, std::move(buffer), 0);
+    }
     static const bool RESIZE_BUFFER = true;
     static bool ReceiveBuffer(void* sock, ByteArray& buffer, bool block) {
         const int b = block ? 0 : ZMQ_NOBLOCK;
@@ -160,10 +250,36 @@ struct SizeInfoTransmissionPolicy {
         ZCheck(zmq_recv(sock, buffer.data(), buffer.size(), b));
         return true;
     }
+    static bool ReceiveMessage(void* sock, zmq_msg_t* msg, bool block) {
+        const int b = block ? 0 : ZMQ_NOBLOCK;
+        size_t sz;
+        if(zmq_recv(sock, &sz, sizeof(sz), b) < 0) return false;
+        int64_t more = 0;
+        size_t moreSize = sizeof(more);
+        ZCheck(zmq_getsockopt(sock, ZMQ_RCVMORE, &more, &moreSize));
+        if(!more)
+            throw std::logic_error(
+                "Wrong packet format: "
+                    "Receive policy requires <size, data> packet format");
+        ZCheck(zmq_msg_recv(msg, sock, 0));
+        if(zmq_msg_size(msg) != sz)
+            throw std::logic_error("Wrong packet format: size mismatch");
+        return true;
+    }
 };
 
 using ReqId = int;
 
+//reply not received before the request deadline
+struct TimeoutError : std::runtime_error {
+    TimeoutError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+//request cancelled by the client before the reply was received
+struct CancelledError : std::runtime_error {
+    CancelledError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
 
 struct TRUE_TYPE {};
 struct FALSE_TYPE {};
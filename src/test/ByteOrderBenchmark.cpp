@@ -0,0 +1,92 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Measure throughput in GB/s of byte order conversion of arrays from 1 kB
+//to 64 MB: memcpy, which is what portable encoding does on little-endian
+//hosts, byte swapping one element at a time and with the SIMD kernel
+//enabled at compile time (e.g. -mavx2), which big-endian hosts use;
+//also compare packing vector< double > with raw and portable encoding
+//usage: byteorder-benchmark [max size in MB] [bytes moved per test in MB]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Serialize.h"
+
+using namespace std;
+using namespace srz;
+
+template < typename F >
+double GBs(size_t bytes, size_t totalBytes, const F& f) {
+    using namespace chrono;
+    const size_t numIterations = max(size_t(3), totalBytes / bytes);
+    f(); //warm up
+    const auto start = steady_clock::now();
+    for(size_t i = 0; i != numIterations; ++i) f();
+    const double s =
+        duration_cast< nanoseconds >(steady_clock::now() - start).count()
+        / 1E9;
+    return bytes * numIterations / s / 1E9;
+}
+
+template < size_t N >
+void Run(size_t maxBytes, size_t totalBytes) {
+    vector< char > in(maxBytes + 1);
+    vector< char > out(maxBytes + 1);
+    for(size_t i = 0; i != in.size(); ++i) in[i] = char(i);
+    cout << N << " byte elements" << endl
+         << "  size        memcpy   scalar   " << detail::ByteSwapISA()
+         << " (GB/s)" << endl;
+    for(size_t bytes = 1024; bytes <= maxBytes; bytes *= 4) {
+        const size_t n = bytes / N;
+        //unaligned buffers, as in received messages
+        char* d = out.data() + 1;
+        const char* s = in.data() + 1;
+        const string size = bytes < 0x100000
+                            ? to_string(bytes / 1024) + " kB"
+                            : to_string(bytes / 0x100000) + " MB";
+        cout << "  " << size << string(12 - size.size(), ' ')
+             << GBs(bytes, totalBytes, [=]() { memcpy(d, s, bytes); })
+             << "   "
+             << GBs(bytes, totalBytes, [=]() {
+                    detail::ByteSwapKernel< N >::CopyScalar(d, s, n); })
+             << "   "
+             << GBs(bytes, totalBytes, [=]() {
+                    detail::ByteSwapKernel< N >::Copy(d, s, n); })
+             << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t maxBytes = (argc > 1 ? atoi(argv[1]) : 64) * 0x100000;
+    const size_t totalBytes = (argc > 2 ? atoi(argv[2]) : 1024) * 0x100000;
+    Run< 2 >(maxBytes, totalBytes);
+    Run< 4 >(maxBytes, totalBytes);
+    Run< 8 >(maxBytes, totalBytes);
+    const vector< double > v(0x100000 / sizeof(double), 1.0);
+    size_t check = 0;
+    cout << "pack 1 MB vector< double >" << endl
+         << "  raw:      " << GBs(0x100000, totalBytes, [&]() {
+                check += Pack(v).size(); }) << " GB/s" << endl
+         << "  portable: " << GBs(0x100000, totalBytes, [&]() {
+                check += PackWith< PortableEncoding >(v).size(); })
+         << " GB/s" << endl;
+    return check ? EXIT_SUCCESS : EXIT_FAILURE;
+}
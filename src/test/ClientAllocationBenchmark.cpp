@@ -0,0 +1,92 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Count heap allocations per request/reply round trip through AsyncClient
+//and AsyncServer, all threads included, sending and receiving payloads
+//through copies or by moving buffers and frames
+//usage: client-allocation-benchmark [round trips] [payload size]
+
+#include <cstdlib>
+#include <iostream>
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <future>
+
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+
+using namespace std;
+using namespace zrf;
+
+namespace {
+atomic< size_t > allocations(0);
+}
+
+//not inlined: once inlined g++ sees free() releasing memory obtained
+//through a new expression and warns about a mismatch
+__attribute__((noinline)) void* operator new(size_t n) {
+    ++allocations;
+    if(void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+template < typename F >
+void Report(const string& label, int numRoundTrips, const F& f) {
+    using namespace chrono;
+    const size_t a = allocations;
+    const auto start = steady_clock::now();
+    for(int i = 0; i != numRoundTrips; ++i) f();
+    const double us =
+        duration_cast< nanoseconds >(steady_clock::now() - start).count()
+        / 1E3 / numRoundTrips;
+    cout << label << endl
+         << "  allocations per round trip: "
+         << double(allocations - a) / numRoundTrips << endl
+         << "  time per round trip:        " << us << " us" << endl;
+}
+
+int main(int argc, char** argv) {
+    const int numRoundTrips = argc > 1 ? atoi(argv[1]) : 10000;
+    const size_t size = argc > 2 ? atoi(argv[2]) : 0x10000;
+    const char* URI = "ipc://client-allocation-benchmark";
+    AsyncServer<> server;
+    //echo: the reply is the only buffer allocated by the service
+    auto service = [](Message&& req) { return req.ToByteArray(); };
+    future< void > f = async(launch::async, [&server, service, URI]() {
+        server.Start(URI, service);
+    });
+    AsyncClient<> client(URI);
+    size_t check = 0;
+    for(int i = 0; i != 100; ++i)
+        check += client.Send(ByteArray(size)).Get().size();
+    cout << size << " bytes payload" << endl;
+    Report("copy: Send(const ByteArray&), Get()", numRoundTrips, [&]() {
+        const ByteArray req(size);
+        check += client.Send(req).Get().size();
+    });
+    Report("move: Send(ByteArray&&), GetMessage()", numRoundTrips, [&]() {
+        check += client.Send(ByteArray(size)).GetMessage().Size();
+    });
+    client.Stop();
+    server.Stop();
+    f.wait();
+    return check ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//Request window of AsyncClient: with the server stalled, requests beyond
+//the window are rejected or wait until a reply is retrieved
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+
+using namespace std;
+using namespace zrf;
+using namespace srz;
+
+int main(int, char**) {
+    const char* URI = "ipc://client-window-test";
+    using Client = AsyncClient<>;
+    using Server = AsyncServer<>;
+    using Rep = Client::ReplyType;
+    const size_t WINDOW = 4;
+
+    //SERVER: echo, replies are only sent after the gate is opened
+    Server server;
+    atomic< bool > gate(false);
+    auto service = [&gate](Message&& req) {
+        while(!gate) this_thread::sleep_for(chrono::milliseconds(1));
+        return req.ToByteArray();
+    };
+    future< void > f = async(launch::async,
+          [&server, service, URI](){server.Start(URI, service);});
+
+    //CLIENT
+    Client client(URI);
+    client.SetWindow(WINDOW, ~size_t(0), Client::WOULD_BLOCK);
+    vector< Rep > replies;
+    for(size_t i = 0; i != WINDOW; ++i)
+        replies.push_back(client.SendArgs(int(i)));
+    assert(client.Window().inFlight == WINDOW);
+    //window full: the request is not consumed
+    ByteArray req = Pack(int(WINDOW));
+    Rep rejected = client.Send(move(req));
+    assert(!rejected.Valid() && !req.empty());
+    assert(client.Window().rejectedSends == 1);
+
+    client.SetWindow(WINDOW, ~size_t(0), Client::FAIL_FAST);
+    bool thrown = false;
+    try {
+        client.Send(req);
+    } catch(const runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && client.Window().rejectedSends == 2);
+
+    //retrieve first reply from another thread: the blocked Send resumes
+    client.SetWindow(WINDOW, ~size_t(0), Client::BLOCK);
+    thread consumer([&gate, &replies]() {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        gate = true;
+        const int first = replies.front();
+        assert(first == 0);
+    });
+    Rep blocked = client.Send(move(req));
+    consumer.join();
+    const WindowStats ws = client.Window();
+    assert(ws.blockedSends == 1 && ws.blockedNs > 0);
+    const int last = blocked;
+    assert(last == int(WINDOW));
+    for(size_t i = 1; i != WINDOW; ++i) {
+        const int r = replies[i];
+        assert(r == int(i));
+    }
+    assert(client.Window().inFlight == 0);
+    cout << "blocked for " << ws.blockedNs / 1E6 << " ms" << endl;
+    client.Stop();
+    server.Stop();
+    f.wait();
+    cout << "PASSED" << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Compare the pending request table of AsyncClient with the former map
+//guarded by a mutex, with many outstanding requests: all requests are
+//added, then completed in random order, then retrieved and removed; then
+//client threads acquire and release requests completed by an I/O thread,
+//waiting for replies or passing them to callbacks
+//usage: pendingtable-benchmark [outstanding requests] [iterations]
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <future>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+#include "PendingTable.h"
+#include "RingQueue.h"
+
+using namespace std;
+using namespace zrf;
+
+template < typename F >
+double Time(int numIterations, const F& f) {
+    using namespace chrono;
+    const auto start = steady_clock::now();
+    for(int i = 0; i != numIterations; ++i) f();
+    return duration_cast< nanoseconds >(steady_clock::now() - start).count()
+           / double(numIterations);
+}
+
+int main(int argc, char** argv) {
+    const int n = argc > 1 ? atoi(argv[1]) : 100000;
+    const int numIterations = argc > 2 ? atoi(argv[2]) : 10;
+    mt19937 rng(1);
+    vector< int > order(n);
+    for(int i = 0; i != n; ++i) order[i] = i;
+    shuffle(order.begin(), order.end(), rng);
+    size_t check = 0;
+    //former implementation
+    map< ReqId, promise< ByteArray > > waitList;
+    mutex waitListMutex;
+    const double mapns = Time(numIterations, [&]() {
+        vector< future< ByteArray > > futures(n);
+        for(int i = 0; i != n; ++i) {
+            promise< ByteArray > p;
+            futures[i] = p.get_future();
+            lock_guard< mutex > lg(waitListMutex);
+            waitList[i + 1] = move(p);
+        }
+        for(int i: order) {
+            lock_guard< mutex > lg(waitListMutex);
+            waitList[i + 1].set_value(ByteArray(1));
+        }
+        for(int i = 0; i != n; ++i) {
+            check += futures[i].get().size();
+            lock_guard< mutex > lg(waitListMutex);
+            if(waitList.find(i + 1) == waitList.end()) abort();
+            waitList.erase(i + 1);
+        }
+    }) / n;
+    PendingTable< ByteArray > table(n);
+    const double tablens = Time(numIterations, [&]() {
+        vector< Completion< ByteArray > > completions(n);
+        for(int i = 0; i != n; ++i) completions[i] = table.Acquire();
+        for(int i: order)
+            table.Complete(completions[i].Id(), ByteArray(1));
+        for(int i = 0; i != n; ++i) check += completions[i].Get().size();
+    }) / n;
+    cout << n << " outstanding requests, ns per request" << endl
+         << "  map + mutex:   " << mapns << endl
+         << "  pending table: " << tablens << endl;
+    //replies to released requests are dropped, also after the slot is
+    //reused
+    Completion< ByteArray > c = table.Acquire();
+    const ReqId rid = c.Id();
+    c.Reset();
+    assert(!table.Complete(rid, ByteArray()));
+    vector< Completion< ByteArray > > cs(n);
+    for(int i = 0; i != n; ++i) {
+        cs[i] = table.Acquire();
+        assert(cs[i].Id() != rid);
+    }
+    assert(!table.Complete(rid, ByteArray()));
+    cs.clear();
+    assert(table.Size() == 0);
+    //timeouts and polling
+    c = table.Acquire();
+    assert(!c.Poll() && !c.WaitFor(chrono::milliseconds(1)));
+    table.Complete(c.Id(), ByteArray(2));
+    assert(c.Poll() && c.WaitFor(chrono::milliseconds(1)));
+    const ByteArray r = c.Get();
+    assert(r.size() == 2 && !c.Valid());
+    //callbacks set after the reply is received are invoked immediately
+    size_t received = 0;
+    c = table.Acquire();
+    table.Complete(c.Id(), ByteArray(3));
+    c.Then([&received](ByteArray&& r) { received = r.size(); });
+    assert(received == 3 && table.Size() == 0);
+    //concurrent clients, replies set by one I/O thread
+    const int numClients = 4;
+    const int requestsPerClient = 100000;
+    MPSCRingQueue< ReqId > queue;
+    atomic< int > callbacks(0);
+    atomic< int > continuations(0);
+    const auto start = chrono::steady_clock::now();
+    thread io([&]() {
+        //request id 0 stops the thread
+        for(ReqId r = queue.Pop(); r; r = queue.Pop())
+            table.Complete(r, ByteArray(1));
+    });
+    vector< thread > clients;
+    for(int c = 0; c != numClients; ++c) {
+        clients.push_back(thread([&, c]() {
+            for(int i = 0; i != requestsPerClient; ++i) {
+                Completion< ByteArray > rc = table.Acquire();
+                if(!rc.Valid()) abort();
+                queue.Push(rc.Id());
+                //abandon some requests before the reply is received
+                if((i + c) % 7 == 0) continue;
+                //reply handled by I/O thread
+                if((i + c) % 7 == 1) {
+                    ++continuations;
+                    rc.Then([&callbacks](ByteArray&& r) {
+                        if(r.size() != 1) abort();
+                        ++callbacks;
+                    });
+                    continue;
+                }
+                if(rc.Get().size() != 1) abort();
+            }
+        }));
+    }
+    for(auto& t: clients) t.join();
+    queue.Push(ReqId(0));
+    io.join();
+    assert(table.Size() == 0);
+    assert(callbacks == continuations);
+    cout << numClients << " client threads, round trips through the "
+         << "table: "
+         << chrono::duration_cast< chrono::nanoseconds >(
+                chrono::steady_clock::now() - start).count()
+            / double(numClients * requestsPerClient)
+         << " ns per request" << endl;
+    return check ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Compare throughput of SyncQueue and lock-free ring queues under contention:
+//- many producers, one consumer: replies pushed by workers and popped by
+//  the I/O thread
+//- one producer, many consumers: requests pushed by the I/O thread and
+//  popped by workers
+
+#include <cstdlib>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "QueuePolicy.h"
+
+using namespace std;
+using namespace zrf;
+
+//element with the same size as the queued replies
+struct Item {
+    long value = 0;
+    char payload[56];
+};
+
+//push numItems elements from each producer, pop all of them from the
+//consumers; returns millions of elements per second
+template < typename QueueT >
+double Run(int numProducers, int numConsumers, long numItems) {
+    using namespace chrono;
+    QueueT q;
+    atomic< long > checksum(0);
+    vector< thread > threads;
+    const auto start = steady_clock::now();
+    for(int p = 0; p != numProducers; ++p)
+        threads.push_back(thread([&q, numItems]() {
+            Item it;
+            for(long i = 1; i <= numItems; ++i) {
+                it.value = i;
+                q.Push(it);
+            }
+        }));
+    const long total = numItems * numProducers;
+    for(int c = 0; c != numConsumers; ++c) {
+        //split work among consumers, first one pops the remainder
+        const long n = total / numConsumers
+                       + (c == 0 ? total % numConsumers : 0);
+        threads.push_back(thread([&q, &checksum, n]() {
+            long sum = 0;
+            for(long i = 0; i != n; ++i) sum += q.Pop().value;
+            checksum += sum;
+        }));
+    }
+    for(auto& t : threads) t.join();
+    const double s =
+        duration_cast< nanoseconds >(steady_clock::now() - start).count()
+        / 1E9;
+    assert(checksum == numProducers * (numItems * (numItems + 1) / 2));
+    (void) checksum;
+    return total / s / 1E6;
+}
+
+template < typename SyncT, typename RingT >
+void Compare(const string& label, int numProducers, int numConsumers,
+             long numItems) {
+    cout << label << " " << numProducers << " producer(s), " << numConsumers
+         << " consumer(s)" << endl
+         << "  SyncQueue: "
+         << Run< SyncT >(numProducers, numConsumers, numItems)
+         << " M items/s" << endl
+         << "  RingQueue: "
+         << Run< RingT >(numProducers, numConsumers, numItems)
+         << " M items/s" << endl;
+}
+
+int main(int argc, char** argv) {
+    const long numItems = argc > 1 ? atol(argv[1]) : 1000000;
+    const int numThreads = argc > 2 ? atoi(argv[2]) : 8;
+    using S = SyncQueuePolicy;
+    using R = RingQueuePolicy;
+    Compare< S::MPSCQueue< Item >, R::MPSCQueue< Item > >(
+        "MPSC", numThreads, 1, numItems);
+    Compare< S::MPMCQueue< Item >, R::MPMCQueue< Item > >(
+        "MPMC", 1, numThreads, numItems);
+    Compare< S::MPMCQueue< Item >, R::MPMCQueue< Item > >(
+        "MPMC", numThreads, numThreads, numItems);
+    return EXIT_SUCCESS;
+}
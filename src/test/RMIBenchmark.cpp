@@ -0,0 +1,160 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//In-process dispatch of the SUM method of RMITest: the former MethodImpl,
+//which calls a virtual IMethod::Invoke which copies the std::function into
+//MoveCall, compared with std::function and lambda registration through
+//the type erased invoker; dispatch through the method table used by
+//Service and copy of methods, as done when services are copied, are also
+//measured
+//usage: rmi-benchmark [calls]
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <map>
+#include <tuple>
+
+#include "RMI.h"
+
+using namespace std;
+using namespace zrf;
+
+//former implementation: callable copied at each call
+namespace legacy {
+
+template< typename R, int...Ints, typename...ArgsT >
+R MoveCallHelper(std::function< R(ArgsT...) > f,
+                 std::tuple< ArgsT... >&& args,
+                 const IndexSequence< Ints... >&) {
+    return f(std::move(std::get< Ints >(args))...);
+};
+
+template< typename R, typename...ArgsT >
+R MoveCall(std::function< R(ArgsT...) > f,
+           std::tuple< ArgsT... >&& args) {
+    using Indices = typename MakeIndexSequence< sizeof...(ArgsT) >::Type;
+    return legacy::MoveCallHelper(f, std::move(args), Indices());
+};
+
+template < typename R, typename...ArgsT >
+class Method : public IMethod {
+public:
+    Method(const std::function< R (ArgsT...) >& f) : f_(f) {}
+    Method* Clone() const { return new Method< R, ArgsT... >(*this); }
+    using IMethod::Invoke;
+    ByteArray Invoke(const ByteArray& args) {
+        return Invoke(srz::ByteView(args));
+    }
+    ByteArray Invoke(srz::ByteView args) {
+        std::tuple< ArgsT... > params;
+        if(srz::UnPack(args, params) != srz::UNPACK_OK)
+            throw std::invalid_argument("Malformed method arguments");
+        R ret = legacy::MoveCall(f_, std::move(params));
+        return srz::Pack(ret);
+    }
+private:
+    std::function< R (ArgsT...) > f_;
+};
+
+//method cloned when copied
+class MethodImpl {
+public:
+    MethodImpl(IMethod* pm) : method_(pm) {}
+    MethodImpl(const MethodImpl& mi) : method_(mi.method_->Clone()) {}
+    MethodImpl& operator=(const MethodImpl& mi) {
+        method_.reset(mi.method_->Clone());
+        return *this;
+    }
+    ByteArray Invoke(srz::ByteView args) {
+        return method_->Invoke(args);
+    }
+private:
+    std::unique_ptr< IMethod > method_;
+};
+
+}
+
+template < typename F >
+double Time(int numCalls, const F& f) {
+    using namespace chrono;
+    const auto start = steady_clock::now();
+    for(int i = 0; i != numCalls; ++i) f();
+    return double(duration_cast< nanoseconds >(
+        steady_clock::now() - start).count()) / numCalls;
+}
+
+int main(int argc, char** argv) {
+    const int numCalls = argc > 1 ? atoi(argv[1]) : 2000000;
+    enum {FS_LS = 1, SUM, EXCEPTIONAL, PI, SCALE, SLEEP};
+    const function< int (const int&, const int&) > sumf =
+        [](const int& i1, const int& i2) -> int { return i1 + i2;};
+    //former registration: Method< int, int, int > wrapping sumf
+    legacy::MethodImpl lm(new legacy::Method< int, int, int >(sumf));
+    MethodImpl fm(sumf);
+    MethodImpl bm = MethodImpl::Bind(
+        [](const int& i1, const int& i2) { return i1 + i2; });
+    const ByteArray args = srz::Pack(make_tuple(5, 4));
+    const srz::ByteView view(args);
+    assert(srz::To< int >(lm.Invoke(view)) == 9);
+    assert(srz::To< int >(fm.Invoke(view)) == 9);
+    assert(srz::To< int >(bm.Invoke(view)) == 9);
+    size_t check = 0;
+    cout << "SUM, " << numCalls << " calls" << endl;
+    cout << "  legacy IMethod:       " << Time(numCalls, [&]() {
+        check += lm.Invoke(view).size();
+    }) << " ns/call" << endl;
+    cout << "  std::function:        " << Time(numCalls, [&]() {
+        check += fm.Invoke(view).size();
+    }) << " ns/call" << endl;
+    cout << "  lambda:               " << Time(numCalls, [&]() {
+        check += bm.Invoke(view).size();
+    }) << " ns/call" << endl;
+    //lookup as done by Service: map and frozen table
+    map< int, MethodImpl > methods;
+    methods[FS_LS] = MethodImpl();
+    methods[SUM] = bm;
+    methods[PI] = MethodImpl::Bind([]() { return 3.14; });
+    methods[SLEEP] = MethodImpl();
+    MethodTable table;
+    table.Build(methods, map< int, int >());
+    cout << "  map lookup + lambda:  " << Time(numCalls, [&]() {
+        check += methods.find(SUM)->second.Invoke(view).size();
+    }) << " ns/call" << endl;
+    cout << "  table + lambda:       " << Time(numCalls, [&]() {
+        check += table[table.Find(SUM)].method->Invoke(view).size();
+    }) << " ns/call" << endl;
+    //copies, as done when a Service is copied into a ServiceManager
+    const int numCopies = numCalls / 10;
+    legacy::MethodImpl lc(lm);
+    MethodImpl c;
+    cout << "copy method, " << numCopies << " copies" << endl;
+    cout << "  legacy IMethod:       " << Time(numCopies, [&]() {
+        lc = lm;
+    }) << " ns/copy" << endl;
+    cout << "  std::function:        " << Time(numCopies, [&]() {
+        c = fm;
+    }) << " ns/copy" << endl;
+    cout << "  lambda:               " << Time(numCopies, [&]() {
+        c = bm;
+    }) << " ns/copy" << endl;
+    check += lc.Invoke(view).size() + c.Invoke(view).size();
+    cout << check << endl;
+    return EXIT_SUCCESS;
+}
@@ -59,6 +59,10 @@
 #include <stdexcept>
 #include <vector>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <chrono>
 
 #include "RMI.h"
 #include "Serialize.h"
@@ -114,7 +118,7 @@ int main(int, char**) {
 
     //Add service
     Service service("ipc://file-service");
-    enum {FS_LS = 1, SUM, EXCEPTIONAL, PI};
+    enum {FS_LS = 1, SUM, EXCEPTIONAL, PI, SCALE, SLEEP, TAU};
     service.Add(FS_LS, MethodImpl(new FSMethod));
     //si.Add(SUM, mi);
     service.Add(SUM, std::function< int (const int&, const int&) >(
@@ -123,9 +127,53 @@ int main(int, char**) {
             [](){throw std::runtime_error("EXCEPTION");}));
     service.Add(PI, std::function< double () >(
             [](){ return 3.14159265358979323846; }));
+    //signature deduced from the lambda, no std::function
+    service.Add(TAU, []() { return 2 * 3.14159265358979323846; });
+    //arguments received as views into the request message, no copy
+    service.Add(SCALE, std::function< vector< double > (const StringView&,
+                                                       ArrayView< double >) >(
+            [](const StringView& op, ArrayView< double > v) {
+                const double s = op == string("negate") ? -1 : 1;
+                vector< double > r;
+                for(auto d: v) r.push_back(s * d);
+                return r;
+            }));
+    service.Add(SLEEP, std::function< int (const int&) >(
+            [](const int& ms) {
+                this_thread::sleep_for(chrono::milliseconds(ms));
+                return ms;
+            }));
+    //Service invoking methods in four worker threads
+    Service workerService("ipc://worker-service", 4);
+    enum {SERIAL = TAU + 1, TICK, SPARSE = 1 << 20};
+    workerService.Add(SUM, [](const int& i1, int i2) { return i1 + i2; });
+    workerService.Add(SLEEP, std::function< int (const int&) >(
+            [](const int& ms) {
+                this_thread::sleep_for(chrono::milliseconds(ms));
+                return ms;
+            }));
+    //sparse ids are looked up in a hash table instead of a flat array
+    workerService.Add(SPARSE, std::function< int () >([]() { return -1; }));
+    //not thread safe: never invoked concurrently
+    atomic< int > active(0);
+    atomic< int > maxActive(0);
+    workerService.Add(SERIAL, std::function< void () >(
+            [&active, &maxActive]() {
+                const int a = ++active;
+                if(a > maxActive) maxActive = a;
+                this_thread::sleep_for(chrono::milliseconds(5));
+                --active;
+            }), Service::SERIALIZED);
+    atomic< int > ticks(0);
+    workerService.Add(TICK, std::function< void () >(
+            [&ticks]() {
+                this_thread::sleep_for(chrono::milliseconds(50));
+                ++ticks;
+            }), Service::SERIALIZED);
     //Add to service manager
     ServiceManager sm;
     sm.Add("file service", service);
+    sm.Add("worker service", workerService);
     //Start service manager in separate thread
     auto s = async(launch::async, [&sm](){sm.Start("ipc://service-manager");});
 
@@ -147,6 +195,211 @@ int main(int, char**) {
     }
     const double MPI = sp[PI]();
     assert(MPI == 3.14159265358979323846);
+    const double tau = sp[TAU]();
+    assert(tau == 2 * MPI);
+
+    const vector< double > scaled =
+        sp[SCALE](string("negate"), vector< double >{1., 2.});
+    assert(scaled == vector< double >({-1., -2.}));
+
+    //pipelined calls: all the requests are sent before the first reply is
+    //received
+    vector< ServiceProxy::AsyncReply< int > > replies;
+    for(int i = 0; i != 1000; ++i)
+        replies.push_back(sp.AsyncRequest< int >(SUM, i, 1));
+    assert(sp.Pending() == 1000);
+    for(int i = 999; i >= 0; --i) assert(replies[i].Get() == i + 1);
+    assert(sp.Pending() == 0);
+    //callbacks are invoked by the thread receiving the replies
+    double pi = 0;
+    bool voidCalled = false;
+    string error;
+    sp.AsyncRequest< double >(PI).Then([&pi](double&& d) { pi = d; });
+    sp.AsyncRequest< void >(FS_LS + 100).Then(
+        [&voidCalled]() { voidCalled = true; },
+        [&error](exception_ptr ep) {
+            try {
+                rethrow_exception(ep);
+            } catch(const RemoteServiceException& e) {
+                error = e.what();
+            }
+        });
+    {
+        //abandoned: forgotten at once, the reply is discarded
+        auto r = sp.AsyncRequest< int >(SUM, 1, 1);
+        assert(sp.Pending() == 3);
+    }
+    assert(sp.Pending() == 2);
+    sp.WaitAll();
+    assert(pi == MPI);
+    assert(!voidCalled);
+    assert(error == "Service Error: Method not implemented");
+    //batches: several calls in one request and one reply, each call
+    //succeeds or fails independently
+    ServiceProxy::Batch batch;
+    const size_t bsum = batch.Add(SUM, 5, 4);
+    const size_t bpi = batch.Add(PI);
+    const size_t bexc = batch.Add(EXCEPTIONAL);
+    const size_t bunknown = batch.Add(FS_LS + 100);
+    const ServiceProxy::BatchReply br = sp.Request(batch);
+    assert(br.Size() == 4);
+    assert(br.Get< int >(bsum) == 9);
+    assert(br.Get< double >(bpi) == MPI);
+    assert(br.Failed(bexc) && br.Failed(bunknown));
+    try {
+        br.Check(bexc);
+        assert(false);
+    } catch(const RemoteServiceException& e) {
+        assert(e.what() == string("Service Error: EXCEPTION"));
+    }
+    assert(sp.Request(ServiceProxy::Batch()).Size() == 0);
+    size_t batchSize = 0;
+    sp.AsyncRequest(batch).Then(
+        [&batchSize](ServiceProxy::BatchReply&& r) { batchSize = r.Size(); });
+    sp.WaitAll();
+    assert(batchSize == 4);
+
+    //clients sending one request at a time through REQ sockets do not
+    //send call ids
+    {
+        void* ctx = zmq_ctx_new();
+        void* req = zmq_socket(ctx, ZMQ_REQ);
+        zmq_connect(req, "ipc://file-service");
+        const int method = SUM;
+        const ByteArray args = Pack(make_tuple(2, 2));
+        zmq_send(req, &method, sizeof(method), ZMQ_SNDMORE);
+        zmq_send(req, args.data(), args.size(), 0);
+        int status[2] = {-1, -1};
+        const int src = zmq_recv(req, status, sizeof(status), 0);
+        assert(src == sizeof(int));
+        assert(status[0] == SERVICE_NO_ERROR);
+        int r = 0;
+        const int rrc = zmq_recv(req, &r, sizeof(r), 0);
+        assert(rrc == sizeof(r));
+        assert(r == 4);
+        zmq_close(req);
+        zmq_ctx_destroy(ctx);
+    }
+
+    //requests not replied to in time throw TimeoutError, only the timed out
+    //call is dropped: its late reply is discarded and the proxy keeps its
+    //socket and can be used again
+    ServiceProxy tp("ipc://service-manager", "file service", 50);
+    try {
+        tp.Request< int >(SLEEP, 100);
+        assert(false);
+    } catch(const TimeoutError&) {}
+    this_thread::sleep_for(chrono::milliseconds(100));
+    const int tsum = tp[SUM](1, 2);
+    assert(tsum == 3);
+    auto late = tp.AsyncRequest< int >(SLEEP, 100);
+    try {
+        late.Get();
+        assert(false);
+    } catch(const TimeoutError&) {}
+    assert(tp.Pending() == 0);
+
+    //unknown methods
+    try {
+        sp[SPARSE]();
+        assert(false);
+    } catch(const RemoteServiceException& e) {
+        assert(e.what() == string("Service Error: Method not implemented"));
+    }
+
+    //slow methods do not block other clients of a service running worker
+    //threads
+    ServiceProxy slow("ipc://service-manager", "worker service");
+    auto sleeping = async(launch::async, [&slow]() -> int {
+        return slow[SLEEP](300);
+    });
+    this_thread::sleep_for(chrono::milliseconds(50));
+    ServiceProxy fast("ipc://service-manager", "worker service");
+    const auto start = chrono::steady_clock::now();
+    const int wsum = fast[SUM](2, 3);
+    assert(wsum == 5);
+    assert(chrono::steady_clock::now() - start < chrono::milliseconds(200));
+    assert(sleeping.get() == 300);
+    const int sparse = fast[SPARSE]();
+    assert(sparse == -1);
+    try {
+        fast[SPARSE + 1]();
+        assert(false);
+    } catch(const RemoteServiceException& e) {
+        assert(e.what() == string("Service Error: Method not implemented"));
+    }
+    vector< future< void > > serial;
+    for(int i = 0; i != 4; ++i) {
+        serial.push_back(async(launch::async, []() {
+            ServiceProxy p("ipc://service-manager", "worker service");
+            for(int c = 0; c != 5; ++c) p[SERIAL]();
+        }));
+    }
+    for(auto& f: serial) f.get();
+    //calls in parallel batches are executed concurrently, within the
+    //concurrency limits of each method
+    ServiceProxy::Batch sleeps;
+    ServiceProxy::Batch parallelSleeps(true);
+    for(int i = 0; i != 4; ++i) {
+        sleeps.Add(SLEEP, 50);
+        parallelSleeps.Add(SLEEP, 50);
+        parallelSleeps.Add(SERIAL);
+    }
+    auto bstart = chrono::steady_clock::now();
+    const ServiceProxy::BatchReply sr = fast.Request(sleeps);
+    assert(chrono::steady_clock::now() - bstart
+           >= chrono::milliseconds(200));
+    bstart = chrono::steady_clock::now();
+    const ServiceProxy::BatchReply pr = fast.Request(parallelSleeps);
+    assert(chrono::steady_clock::now() - bstart
+           < chrono::milliseconds(180));
+    for(int i = 0; i != 4; ++i) {
+        assert(sr.Get< int >(i) == 50);
+        assert(pr.Get< int >(2 * i) == 50);
+        pr.Check(2 * i + 1);
+    }
+    assert(maxActive == 1);
+
+    //calls carry their timeout: the service drops calls not started in
+    //time, at most two 50 ms calls start within 60 ms
+    vector< ServiceProxy::AsyncReply< void > > expiring;
+    for(int i = 0; i != 10; ++i)
+        expiring.push_back(fast.AsyncRequestTimeout< void >(60, TICK));
+    int timedOut = 0;
+    for(auto& r: expiring) {
+        try {
+            r.Get();
+        } catch(const TimeoutError&) {
+            ++timedOut;
+        }
+    }
+    assert(timedOut >= 5);
+    this_thread::sleep_for(chrono::milliseconds(600));
+    assert(ticks <= 5);
+    //timed out and cancelled calls fail through their callbacks too
+    bool expired = false;
+    fast.AsyncRequestTimeout< int >(20, SLEEP, 100).Then(
+        [](int&&) { assert(false); },
+        [&expired](exception_ptr ep) {
+            try {
+                rethrow_exception(ep);
+            } catch(const TimeoutError&) {
+                expired = true;
+            }
+        });
+    fast.WaitAll();
+    assert(expired);
+    auto cancelled = fast.AsyncRequest< int >(SLEEP, 50);
+    assert(cancelled.Cancel());
+    try {
+        cancelled.Get();
+        assert(false);
+    } catch(const CancelledError&) {}
+    auto replied = fast.AsyncRequest< int >(SUM, 1, 1);
+    fast.WaitAll();
+    assert(!replied.Cancel());
+    assert(replied.Get() == 2);
+    assert(fast.Pending() == 0);
 
     //stop services and service manager
     sm.Stop();
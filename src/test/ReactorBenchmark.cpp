@@ -0,0 +1,82 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Compare CPU usage of idle endpoints and request/reply latency between
+//I/O threads waking up periodically (as the former 1-2 ms zmq_poll loops
+//did) and I/O threads sleeping until activity is signalled by the reactor
+
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+
+using namespace std;
+using namespace zrf;
+
+//user + system CPU time of the process in milliseconds
+double CPUTimems() {
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1E3
+           + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1E3;
+}
+
+void Run(const char* URI, int timeoutms, int idleSeconds, int numRequests) {
+    using namespace chrono;
+    AsyncServer<> server;
+    auto service = [](const ByteArray& req) { return req; };
+    future< void > f = async(launch::async, [&server, service, URI,
+                                             timeoutms]() {
+        server.Start(URI, service, 0, timeoutms);
+    });
+    AsyncClient<> client;
+    client.Start(URI, 0, timeoutms);
+    //wait for connection
+    const ByteArray req(16, 'x');
+    client.Send(req).Get();
+    //idle
+    const double cpuStart = CPUTimems();
+    this_thread::sleep_for(seconds(idleSeconds));
+    const double idleCPU = (CPUTimems() - cpuStart) / idleSeconds;
+    //sequential round trips
+    const auto start = steady_clock::now();
+    for(int i = 0; i != numRequests; ++i)
+        client.Send(req).Get();
+    const double latency =
+        duration_cast< nanoseconds >(steady_clock::now() - start).count()
+        / 1E3 / numRequests;
+    cout << "timeout: " << timeoutms << " ms\t"
+         << "idle CPU: " << idleCPU << " ms/s\t"
+         << "round trip: " << latency << " us" << endl;
+    client.Stop();
+    server.Stop();
+    f.wait();
+}
+
+int main(int argc, char** argv) {
+    const int idleSeconds = argc > 1 ? atoi(argv[1]) : 2;
+    const int numRequests = argc > 2 ? atoi(argv[2]) : 10000;
+    //periodic wake up, equivalent to former polling loops
+    Run("ipc://reactor-benchmark-1", 1, idleSeconds, numRequests);
+    //sleep until activity
+    Run("ipc://reactor-benchmark-2", -1, idleSeconds, numRequests);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+
+//Request timeouts and cancellation: replies not received in time fail
+//with TimeoutError, the server discards requests whose client stopped
+//waiting instead of processing them
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+#include "PendingTable.h"
+
+using namespace std;
+using namespace zrf;
+using namespace srz;
+
+int main(int, char**) {
+    const char* URI = "ipc://request-timeout-test";
+    using Client = AsyncClient<>;
+    using Server = AsyncServer<>;
+    using Rep = Client::ReplyType;
+    using Clock = chrono::steady_clock;
+
+    //SERVER: echo, stalled until the gate is opened
+    Server server;
+    atomic< bool > gate(false);
+    atomic< int > processed(0);
+    auto service = [&gate, &processed](Message&& req) {
+        while(!gate) this_thread::sleep_for(chrono::milliseconds(1));
+        ++processed;
+        return req.ToByteArray();
+    };
+    future< void > f = async(launch::async,
+          [&server, service, URI](){server.Start(URI, service);});
+
+    //CLIENT
+    Client client(URI);
+    //first request keeps the worker busy, the others time out while
+    //queued in the server
+    Rep first = client.SendArgs(0);
+    const int NUM_EXPIRED = 10;
+    vector< Rep > expired;
+    const Clock::time_point start = Clock::now();
+    for(int i = 0; i != NUM_EXPIRED; ++i)
+        expired.push_back(client.SendArgsTimeout(50, i));
+    //error callback invoked by the client I/O thread
+    atomic< bool > timedOut(false);
+    client.SendArgsTimeout(50, -1).Then(
+        [](Message&&) { abort(); },
+        [&timedOut](exception_ptr e) {
+            try {
+                rethrow_exception(e);
+            } catch(const TimeoutError&) {
+                timedOut = true;
+            }
+        });
+    for(auto& r: expired) {
+        bool thrown = false;
+        try {
+            r.Get();
+        } catch(const TimeoutError&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    const double ms = chrono::duration_cast< chrono::microseconds >(
+                          Clock::now() - start).count() / 1E3;
+    assert(ms >= 50);
+    while(!timedOut) this_thread::sleep_for(chrono::milliseconds(1));
+
+    //cancelled requests fail with CancelledError
+    Rep cancelled = client.SendArgs(1);
+    assert(client.Cancel(cancelled.Id()));
+    assert(!client.Cancel(cancelled.Id()));
+    bool thrown = false;
+    try {
+        cancelled.Get();
+    } catch(const CancelledError&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    //expired requests are discarded by the server, the others processed
+    gate = true;
+    const int r = first;
+    assert(r == 0);
+    const int ok = client.SendArgsTimeout(1000, 2);
+    assert(ok == 2);
+    assert(server.ExpiredRequests() == NUM_EXPIRED + 1);
+    //first and last request; the cancelled request is only processed if
+    //sent before being cancelled
+    assert(processed == 2 || processed == 3);
+    cout << "timed out after " << ms << " ms, "
+         << server.ExpiredRequests() << " requests discarded by server"
+         << endl;
+    client.Stop();
+    server.Stop();
+    f.wait();
+
+    //a timer left over by a released request does not fail the request
+    //reusing its slot once the generation wraps around to the same id
+    PendingTable< int > table(0x8000);
+    const Clock::time_point d0 = Clock::now();
+    const ReqId stale = table.Acquire(d0).Id(); //released at once
+    Completion< int > reused;
+    size_t cycles = 0;
+    for(;; ++cycles) {
+        Completion< int > c = table.Acquire(d0 + chrono::seconds(1));
+        if(c.Id() == stale) {
+            reused = move(c);
+            break;
+        }
+    }
+    assert(cycles > 1 && table.Size() == 1);
+    const exception_ptr te =
+        make_exception_ptr(TimeoutError("Request timed out"));
+    assert(!table.Expire(stale, d0, te));
+    assert(table.Pending(stale));
+    assert(table.Expire(stale, d0 + chrono::seconds(1), te));
+    thrown = false;
+    try {
+        reused.Get();
+    } catch(const TimeoutError&) {
+        thrown = true;
+    }
+    assert(thrown);
+    cout << "slot reused after " << cycles << " generations" << endl;
+    cout << "PASSED" << endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Compare AsyncServer throughput with requests dispatched to workers through
+//a single shared queue and through per-worker work-stealing queues;
+//run with increasing number of workers to check scalability
+
+#include <cstdlib>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include "AsyncClient.h"
+#include "AsyncServer.h"
+
+using namespace std;
+using namespace zrf;
+
+using Server = AsyncServer<>;
+
+//requests per second
+double Run(const string& URI, Server::Scheduling scheduling,
+           int numWorkers, int numClients, int numRequests, int workus) {
+    using namespace chrono;
+    Server server;
+    //busy wait to simulate a CPU bound service
+    auto service = [workus](const ByteArray& req) {
+        const auto end = steady_clock::now() + microseconds(workus);
+        while(steady_clock::now() < end);
+        return req;
+    };
+    future< void > f = async(launch::async, [&]() {
+        server.Start(URI.c_str(), service, 0, -1, numWorkers, 64,
+                     scheduling);
+    });
+    vector< unique_ptr< AsyncClient<> > > clients;
+    for(int c = 0; c != numClients; ++c) {
+        clients.push_back(unique_ptr< AsyncClient<> >(new AsyncClient<>));
+        clients.back()->Start(URI.c_str());
+        //wait for connection
+        clients.back()->Send(ByteArray(1)).Get();
+    }
+    const auto start = steady_clock::now();
+    vector< thread > threads;
+    for(int c = 0; c != numClients; ++c) {
+        AsyncClient<>* client = clients[c].get();
+        threads.push_back(thread([client, numRequests]() {
+            vector< AsyncClient<>::ReplyType > replies;
+            for(int i = 0; i != numRequests; ++i)
+                replies.push_back(client->Send(ByteArray(64, char(i))));
+            for(int i = 0; i != numRequests; ++i) {
+                const ByteArray rep = replies[i].Get();
+                assert(rep == ByteArray(64, char(i)));
+                (void) rep;
+            }
+        }));
+    }
+    for(auto& t : threads) t.join();
+    const double s =
+        duration_cast< nanoseconds >(steady_clock::now() - start).count()
+        / 1E9;
+    for(auto& c : clients) c->Stop();
+    server.Stop();
+    f.wait();
+    return numClients * numRequests / s;
+}
+
+int main(int argc, char** argv) {
+    const int maxWorkers = argc > 1 ? atoi(argv[1])
+                                    : int(thread::hardware_concurrency());
+    const int numClients = argc > 2 ? atoi(argv[2]) : 8;
+    const int numRequests = argc > 3 ? atoi(argv[3]) : 2000;
+    const int workus = argc > 4 ? atoi(argv[4]) : 10;
+    const char* names[] = {"shared queue", "round robin", "client affinity",
+                           "client ordered"};
+    const Server::Scheduling modes[] = {
+        Server::SHARED_QUEUE, Server::ROUND_ROBIN, Server::CLIENT_AFFINITY,
+        Server::CLIENT_ORDERED};
+    int port = 0;
+    for(int w = 1; w <= maxWorkers; w *= 2) {
+        cout << w << " worker(s)" << endl;
+        for(int m = 0; m != 4; ++m) {
+            const string URI = "ipc://scheduling-benchmark-"
+                               + to_string(port++);
+            cout << "  " << names[m] << ": "
+                 << Run(URI, modes[m], w, numClients, numRequests, workus)
+                 << " requests/s" << endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
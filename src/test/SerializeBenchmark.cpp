@@ -0,0 +1,347 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Compare packing time of the former serializers, which grow the buffer
+//once per packed element, with the current ones, which compute the packed
+//size first and allocate the buffer once; strings are also packed and
+//unpacked with varint lengths; hash maps are unpacked with and without
+//reserving buckets up front
+
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+
+#include "Serialize.h"
+
+using namespace std;
+using namespace srz;
+
+//former implementation: buffers are passed by value and resized at each
+//element
+namespace legacy {
+
+ByteArray PackSize(size_t s, ByteArray buf) {
+    const size_t sz = buf.size();
+    buf.resize(buf.size() + sizeof(s));
+    memmove(buf.data() + sz, &s, sizeof(s));
+    return buf;
+}
+
+template < typename T >
+ByteArray PackPOD(const T& d, ByteArray buf) {
+    const size_t sz = buf.size();
+    buf.resize(buf.size() + sizeof(d));
+    memmove(buf.data() + sz, &d, sizeof(d));
+    return buf;
+}
+
+template < typename T >
+ByteArray PackVectorPOD(const vector< T >& d, ByteArray buf) {
+    const size_t sz = buf.size();
+    const size_t s = d.size();
+    buf.resize(buf.size() + sizeof(T) * d.size() + sizeof(s));
+    memmove(buf.data() + sz, &s, sizeof(s));
+    memmove(buf.data() + sz + sizeof(s), d.data(), sizeof(T) * d.size());
+    return buf;
+}
+
+ByteArray PackString(const string& d, ByteArray buf) {
+    return PackVectorPOD(vector< char >(d.begin(), d.end()), buf);
+}
+
+//intermediate vector< char > in both directions
+Byte* PackString(const string& d, Byte* p) {
+    const vector< char > v(d.begin(), d.end());
+    const size_t s = v.size();
+    memmove(p, &s, sizeof(s));
+    memmove(p + sizeof(s), v.data(), s);
+    return p + sizeof(s) + s;
+}
+
+ConstByteIterator UnPackString(ConstByteIterator bi, string& d) {
+    size_t s = 0;
+    memmove(&s, &*bi, sizeof(s));
+    bi += sizeof(s);
+    vector< char > v(bi, bi + s);
+    d = string(v.begin(), v.end());
+    return bi + s;
+}
+
+ByteArray PackVectorString(const vector< string >& d, ByteArray buf) {
+    buf = PackSize(d.size(), buf);
+    for(auto i = d.cbegin(); i != d.cend(); ++i)
+        buf = PackString(*i, buf);
+    return buf;
+}
+
+ByteArray PackMap(const map< string, vector< double > >& m, ByteArray buf) {
+    buf = PackSize(m.size(), buf);
+    for(auto& mi: m) {
+        buf = PackString(mi.first, buf);
+        buf = PackVectorPOD(mi.second, buf);
+    }
+    return buf;
+}
+
+//insert elements one by one, rehashing as the map grows
+template < typename K, typename T >
+void UnPackHashMap(ByteView v, unordered_map< K, T >& d) {
+    size_t size = 0;
+    UnPack(v, size);
+    d.clear();
+    for(size_t i = 0; i != size; ++i) {
+        K key;
+        T value;
+        UnPack(v, key);
+        UnPack(v, value);
+        d.insert(make_pair(key, value));
+    }
+}
+
+inline ByteArray Pack(ByteArray ba) {
+    return ba;
+}
+
+//one resize per argument
+template < typename T, typename...ArgsT >
+ByteArray Pack(ByteArray ba, const T& h, const ArgsT&...t) {
+    return Pack(PackPOD(h, std::move(ba)), t...);
+}
+
+}
+
+//padded struct copied as is, with padding bytes
+struct RawParticle {
+    double x, y, z;
+    int id;
+};
+
+//same struct serialized field by field
+struct Particle {
+    double x, y, z;
+    int id;
+};
+ZRF_SERIALIZABLE(Particle, x, y, z, id)
+
+//message with fields of each wire type
+struct Quote {
+    int id;
+    string symbol;
+    double bid, ask;
+    float rate;
+    long volume;
+    char side;
+};
+ZRF_SERIALIZABLE(Quote, id, symbol, bid, ask, rate, volume, side)
+
+template < typename F >
+double Time(int numIterations, const F& f) {
+    using namespace chrono;
+    const auto start = steady_clock::now();
+    for(int i = 0; i != numIterations; ++i) f();
+    return duration_cast< nanoseconds >(steady_clock::now() - start).count()
+           / 1E3 / numIterations;
+}
+
+void Report(const string& label, double legacyus, double us) {
+    cout << label << endl
+         << "  legacy:  " << legacyus << " us" << endl
+         << "  current: " << us << " us" << endl;
+}
+
+//pack and unpack strings one after the other in a preallocated buffer
+struct LegacyString {
+    static Byte* Pack(const string& d, Byte* p) {
+        return legacy::PackString(d, p);
+    }
+};
+
+template < typename S >
+size_t PackStrings(const vector< string >& strings, ByteArray& buf) {
+    Byte* p = buf.data();
+    for(auto& s: strings) p = S::Pack(s, p);
+    return p - buf.data();
+}
+
+template < typename S >
+size_t UnPackStrings(const ByteArray& buf, size_t n, vector< string >& out) {
+    ByteView v(buf);
+    for(size_t i = 0; i != n; ++i) S::UnPack(v, out[i]);
+    return buf.size() - v.Size();
+}
+
+size_t LegacyUnPackStrings(const ByteArray& buf, size_t n,
+                           vector< string >& out) {
+    ConstByteIterator bi = buf.begin();
+    for(size_t i = 0; i != n; ++i) bi = legacy::UnPackString(bi, out[i]);
+    return bi - buf.begin();
+}
+
+void StringReport(const string& label, const vector< string >& strings,
+                  int numIterations, size_t& check) {
+    ByteArray buf(PackedSize(strings) - sizeof(size_t));
+    PackStrings< LegacyString >(strings, buf);
+    ByteArray out(buf.size());
+    vector< string > in(strings.size());
+    const size_t n = strings.size();
+    size_t varintSize = 0;
+    for(auto& s: strings) varintSize += SerializeVarintString::Size(s);
+    cout << label << ", raw " << buf.size() << " bytes, varint "
+         << varintSize << " bytes" << endl;
+    cout << "  pack legacy:    " << Time(numIterations, [&]() {
+        check += PackStrings< LegacyString >(strings, out);
+    }) << " us" << endl;
+    cout << "  pack raw:       " << Time(numIterations, [&]() {
+        check += PackStrings< SerializeString >(strings, out);
+    }) << " us" << endl;
+    cout << "  pack varint:    " << Time(numIterations, [&]() {
+        check += PackStrings< SerializeVarintString >(strings, out);
+    }) << " us" << endl;
+    cout << "  unpack legacy:  " << Time(numIterations, [&]() {
+        check += LegacyUnPackStrings(buf, n, in);
+    }) << " us" << endl;
+    cout << "  unpack raw:     " << Time(numIterations, [&]() {
+        check += UnPackStrings< SerializeString >(buf, n, in);
+    }) << " us" << endl;
+    assert(in == strings);
+    PackStrings< SerializeVarintString >(strings, out);
+    out.resize(varintSize);
+    cout << "  unpack varint:  " << Time(numIterations, [&]() {
+        check += UnPackStrings< SerializeVarintString >(out, n, in);
+    }) << " us" << endl;
+    assert(in == strings);
+}
+
+int main(int argc, char** argv) {
+    const int numElements = argc > 1 ? atoi(argv[1]) : 5000;
+    const int numIterations = argc > 2 ? atoi(argv[2]) : 3;
+    size_t check = 0;
+    //vector< string >
+    vector< string > vs;
+    for(int i = 0; i != numElements; ++i)
+        vs.push_back("element " + to_string(i));
+    assert(legacy::PackVectorString(vs, ByteArray()) == Pack(vs));
+    Report("vector< string >, " + to_string(numElements) + " elements",
+           Time(numIterations, [&]() {
+               check += legacy::PackVectorString(vs, ByteArray()).size();
+           }),
+           Time(numIterations, [&]() {
+               check += Pack(vs).size();
+           }));
+    //map< string, vector< double > >
+    map< string, vector< double > > m;
+    for(int i = 0; i != numElements; ++i)
+        m["key " + to_string(i)] = vector< double >(16, i);
+    assert(legacy::PackMap(m, ByteArray()) == Pack(m));
+    Report("map< string, vector< double > >, " + to_string(numElements)
+           + " elements",
+           Time(numIterations, [&]() {
+               check += legacy::PackMap(m, ByteArray()).size();
+           }),
+           Time(numIterations, [&]() {
+               check += Pack(m).size();
+           }));
+    //strings: up to 32 bytes and 4 kB
+    vector< string > shorts;
+    vector< string > longs;
+    for(int i = 0; i != numElements; ++i) {
+        shorts.push_back(string(i % 33, 's'));
+        longs.push_back(string(4096, 'l'));
+    }
+    StringReport("short strings, " + to_string(numElements) + " elements",
+                 shorts, numIterations, check);
+    StringReport("long strings, " + to_string(numElements) + " elements",
+                 longs, numIterations, check);
+    //unordered_map< int, int >: 100 times the number of elements
+    unordered_map< int, int > um;
+    for(int i = 0; i != 100 * numElements; ++i) um[i] = i;
+    const ByteArray umba = Pack(um);
+    unordered_map< int, int > umin;
+    legacy::UnPackHashMap(umba, umin);
+    assert(umin == um);
+    Report("unpack unordered_map< int, int >, " + to_string(um.size())
+           + " elements",
+           Time(numIterations, [&]() {
+               unordered_map< int, int > d;
+               legacy::UnPackHashMap(umba, d);
+               check += d.size();
+           }),
+           Time(numIterations, [&]() {
+               unordered_map< int, int > d;
+               ByteView v(umba);
+               UnPack(v, d);
+               check += d.size();
+           }));
+    //argument lists of POD tuples, as packed by RMI proxies
+    const auto t = make_tuple(1, 2.0, '3', 4.f, 5L);
+    assert(legacy::Pack(ByteArray(), t, t, t, 8, 9.0)
+           == Pack(t, t, t, 8, 9.0));
+    const int numPacks = numElements * numIterations;
+    Report("POD tuples, 5 arguments",
+           Time(numPacks, [&]() {
+               check += legacy::Pack(ByteArray(), t, t, t, 8, 9.0).size();
+           }),
+           Time(numPacks, [&]() {
+               check += Pack(t, t, t, 8, 9.0).size();
+           }));
+    //vector of padded structs: raw copy vs field by field
+    const vector< RawParticle > rps(100 * numElements,
+                                    RawParticle{1., 2., 3., 4});
+    const vector< Particle > ps(rps.size(), Particle{1., 2., 3., 4});
+    const ByteArray rpsba = Pack(rps);
+    const ByteArray psba = Pack(ps);
+    cout << "vector of padded structs, " << ps.size() << " elements: "
+         << rpsba.size() << " vs " << psba.size() << " bytes" << endl;
+    Report("pack and unpack",
+           Time(numIterations, [&]() {
+               check += UnPack< vector< RawParticle > >(Pack(rps)).size();
+           }),
+           Time(numIterations, [&]() {
+               check += UnPack< vector< Particle > >(Pack(ps)).size();
+           }));
+    //positional and tagged encoding of the same messages, checked
+    //unpacking as done with received data
+    const vector< Quote > qs(100 * numElements,
+                             Quote{1, "ABCD", 1.5, 1.6, 0.5f, 1000, 'b'});
+    const ByteArray posba = PackWith< CompactZigZagEncoding >(qs);
+    const ByteArray tagba = PackWith< TaggedEncoding >(qs);
+    const double posus = Time(numIterations, [&]() {
+        vector< Quote > d;
+        ByteView v(posba);
+        UnPackWith< CompactZigZagEncoding >(v, d);
+        check += d.size();
+    });
+    const double tagus = Time(numIterations, [&]() {
+        vector< Quote > d;
+        ByteView v(tagba);
+        UnPackWith< TaggedEncoding >(v, d);
+        check += d.size();
+    });
+    cout << "unpack vector of messages, " << qs.size() << " elements" << endl
+         << "  positional: " << posus << " us, " << posba.size() << " bytes"
+         << endl
+         << "  tagged:     " << tagus << " us, " << tagba.size() << " bytes"
+         << endl
+         << "  ratio:      " << tagus / posus << endl;
+    return check ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+//Author: Ugo Varetto
+//
+// This file is part of zrf - zeromq remoting framework.
+//zrf is free software: you can redistribute it and/or modify
+//it under the terms of the GNU General Public License as published by
+//the Free Software Foundation, either version 3 of the License, or
+//(at your option) any later version.
+//
+//zrf is distributed in the hope that it will be useful,
+//but WITHOUT ANY WARRANTY; without even the implied warranty of
+//MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//GNU General Public License for more details.
+//
+//You should have received a copy of the GNU General Public License
+//along with zrf.  If not, see <http://www.gnu.org/licenses/>.
+
+//Fuzz targets for checked unpacking: the first input byte selects the
+//serializer, the rest of the input is unpacked through a ByteView.
+//Data successfully unpacked is packed again and compared with the input.
+//Build with libFuzzer, as a single command:
+//  clang++ -std=c++11 -g -fsanitize=fuzzer,address -DZRF_LIBFUZZER
+//          -Isrc/include src/test/SerializeFuzz.cpp -o serialize-fuzz
+//without libFuzzer a standalone driver runs random and mutated inputs:
+//  serialize-fuzz [iterations] [seed]
+//The copy constructor based Serialize< T > fallback is not covered: it
+//trusts the object representation and must not be used with untrusted data.
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <deque>
+#include <list>
+#include <array>
+#include <tuple>
+
+#include "Serialize.h"
+
+using namespace std;
+using namespace srz;
+
+namespace {
+
+//abort on failure also in release builds
+void Check(bool c, const char* msg) {
+    if(c) return;
+    cerr << "FAILED: " << msg << endl;
+    abort();
+}
+
+//unpack T from view then verify that packing it again reproduces the
+//consumed bytes
+template < typename T, typename E = RawEncoding >
+void Fuzz(ByteView v, bool compareBytes = true) {
+    const ByteView in = v;
+    T d;
+    if(UnPackWith< E >(v, d) != UNPACK_OK) return;
+    Check(v.Size() <= in.Size(), "view grown");
+    const size_t consumed = in.Size() - v.Size();
+    const ByteArray out = PackWith< E >(d);
+    if(!compareBytes) return;
+    Check(PackedSizeWith< E >(d) == consumed, "packed size mismatch");
+    Check(out.size() == consumed
+          && equal(out.begin(), out.end(), in.Data()), "round trip");
+}
+
+using PODTuple = tuple< int, double, float >;
+using Tuple = tuple< int, string, vector< double > >;
+
+using Compact = CompactZigZagEncoding;
+
+struct Flat {
+    int i;
+    float f;
+};
+
+struct Record {
+    char c;
+    double d;
+    string s;
+    vector< Flat > v;
+};
+
+ZRF_SERIALIZABLE(Flat, i, f)
+ZRF_SERIALIZABLE(Record, c, d, s, v)
+
+const int NUM_TARGETS = 28;
+
+void FuzzOne(const uint8_t* data, size_t size) {
+    if(!size) return;
+    const ByteView v(data + 1, size - 1);
+    switch(data[0] % NUM_TARGETS) {
+    case 0: Fuzz< int >(v); break;
+    case 1: Fuzz< double >(v); break;
+    case 2: Fuzz< PODTuple >(v, false); break; //padding bytes
+    case 3: Fuzz< vector< int > >(v); break;
+    case 4: Fuzz< vector< double > >(v); break;
+    case 5: Fuzz< string >(v); break;
+    case 6: Fuzz< vector< string > >(v); break;
+    case 7: Fuzz< vector< vector< int > > >(v); break;
+    //duplicate keys are merged: sizes differ from input
+    case 8: Fuzz< map< string, string > >(v, false); break;
+    case 9: Fuzz< map< int, vector< double > > >(v, false); break;
+    case 10: Fuzz< ArrayView< double > >(v); break;
+    case 11: Fuzz< StringView >(v); break;
+    case 12: Fuzz< Tuple >(v); break;
+    case 13: Fuzz< string, Compact >(v); break;
+    case 14: Fuzz< vector< int >, Compact >(v); break;
+    case 15: Fuzz< short, Compact >(v); break;
+    case 16: Fuzz< Tuple, Compact >(v); break;
+    case 17: Fuzz< map< string, string >, Compact >(v, false); break;
+    case 18: Fuzz< vector< double >, PortableEncoding >(v); break;
+    case 19: Fuzz< Tuple, PortableEncoding >(v); break;
+    //sets and hash maps reorder and merge elements
+    case 20: Fuzz< set< string > >(v, false); break;
+    case 21: Fuzz< unordered_map< int, string >, Compact >(v, false); break;
+    case 22: Fuzz< deque< string > >(v); break;
+    case 23: Fuzz< list< pair< string, int > > >(v); break;
+    case 24: Fuzz< array< string, 2 >, Compact >(v); break;
+    case 25: Fuzz< Record >(v); break;
+    case 26: Fuzz< Record, Compact >(v); break;
+    //unknown fields are skipped, fields can be repeated
+    case 27: Fuzz< Record, TaggedEncoding >(v, false); break;
+    default: break;
+    }
+    //multiple arguments as packed by Pack(args...)
+    ByteView a = v;
+    int i = 0;
+    string s;
+    vector< float > vf;
+    UnPackArgs(a, i, s, vf);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    FuzzOne(data, size);
+    return 0;
+}
+
+#ifndef ZRF_LIBFUZZER
+//valid encodings used as seeds for mutation
+vector< ByteArray > Seeds() {
+    vector< ByteArray > seeds;
+    seeds.push_back(Pack(char(0), 42));
+    seeds.push_back(Pack(char(1), 4.2));
+    seeds.push_back(Pack(char(2), PODTuple(1, 2.0, 3.f)));
+    seeds.push_back(Pack(char(3), vector< int >{1, 2, 3}));
+    seeds.push_back(Pack(char(4), vector< double >{1., 2.}));
+    seeds.push_back(Pack(char(5), string("seed")));
+    seeds.push_back(Pack(char(6), vector< string >{"a", "", "bc"}));
+    seeds.push_back(Pack(char(7), vector< vector< int > >{{1}, {}, {2, 3}}));
+    seeds.push_back(Pack(char(8), map< string, string >{{"k", "v"}}));
+    seeds.push_back(Pack(char(9),
+                         map< int, vector< double > >{{1, {1., 2.}}}));
+    seeds.push_back(Pack(char(10), vector< double >{1., 2.}));
+    seeds.push_back(Pack(char(11), string("view")));
+    seeds.push_back(Pack(char(12), Tuple(1, "a", {2.})));
+    seeds.push_back(PackWith< Compact >(char(13), string(200, 'v')));
+    seeds.push_back(PackWith< Compact >(char(14), vector< int >{-1, 300}));
+    seeds.push_back(PackWith< Compact >(char(15), short(-1000)));
+    seeds.push_back(PackWith< Compact >(char(16), Tuple(-1, "a", {2.})));
+    seeds.push_back(PackWith< Compact >(char(17),
+                                        map< string, string >{{"k", "v"}}));
+    seeds.push_back(PackWith< PortableEncoding >(char(18),
+                                                 vector< double >{1., 2.}));
+    seeds.push_back(PackWith< PortableEncoding >(char(19),
+                                                 Tuple(-1, "a", {2.})));
+    seeds.push_back(Pack(char(20), set< string >{"a", "b"}));
+    seeds.push_back(PackWith< Compact >(
+        char(21), unordered_map< int, string >{{1, "a"}}));
+    seeds.push_back(Pack(char(22), deque< string >{"a", ""}));
+    seeds.push_back(Pack(char(23), list< pair< string, int > >{{"a", 1}}));
+    seeds.push_back(PackWith< Compact >(char(24),
+                                        array< string, 2 >{{"a", "b"}}));
+    const Record r = {'r', 1.5, "rec", {{1, 2.f}}};
+    seeds.push_back(Pack(char(25), r));
+    seeds.push_back(PackWith< Compact >(char(26), r));
+    seeds.push_back(PackWith< TaggedEncoding >(char(27), r));
+    return seeds;
+}
+
+int main(int argc, char** argv) {
+    const long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    mt19937 rng(argc > 2 ? atoi(argv[2]) : 1);
+    const vector< ByteArray > seeds = Seeds();
+    ByteArray buf;
+    for(long it = 0; it != iterations; ++it) {
+        if(it % 2) {
+            //random bytes
+            buf.resize(rng() % 64);
+            for(auto& b: buf) b = Byte(rng());
+        } else {
+            //mutated valid encoding: flip, truncate or extend
+            buf = seeds[rng() % seeds.size()];
+            const int mutations = 1 + rng() % 4;
+            for(int m = 0; m != mutations && !buf.empty(); ++m) {
+                switch(rng() % 3) {
+                case 0: buf[rng() % buf.size()] = Byte(rng()); break;
+                case 1: buf.resize(rng() % buf.size()); break;
+                case 2: buf.push_back(Byte(rng())); break;
+                }
+            }
+        }
+        FuzzOne(reinterpret_cast< const uint8_t* >(buf.data()), buf.size());
+    }
+    cout << "PASSED" << endl;
+    return EXIT_SUCCESS;
+}
+#endif
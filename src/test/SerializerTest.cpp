@@ -20,9 +20,16 @@
 #include <vector>
 #include <iostream>
 #include <tuple>
+#include <map>
+#include <unordered_map>
+#include <set>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <array>
 
-#ifdef LOG__
 #include <algorithm>
+#ifdef LOG__
 #include <iterator>
 #endif
 
@@ -31,6 +38,74 @@
 using namespace std;
 using namespace srz;
 
+//compare byte swap kernel with scalar loop, with unaligned buffers and
+//sizes not multiple of vector registers
+template < size_t N >
+bool CheckByteSwap() {
+    vector< char > in(1001);
+    for(size_t i = 0; i != in.size(); ++i) in[i] = char(i * 7);
+    for(size_t off = 0; off != 3; ++off) {
+        vector< char > out(in.size()), ref(in.size());
+        const size_t n = (in.size() - off) / N;
+        detail::ByteSwapKernel< N >::Copy(&out[off], &in[off], n);
+        detail::ByteSwapKernel< N >::CopyScalar(&ref[off], &in[off], n);
+        if(out != ref) return false;
+        detail::ByteSwapKernel< N >::Copy(&out[off], &out[off], n);
+        if(!equal(in.begin() + off, in.begin() + off + n * N,
+                  out.begin() + off)) return false;
+    }
+    return true;
+}
+
+//types serialized field by field
+struct Flat {
+    int a;
+    float b;
+    char key[8];
+};
+ZRF_SERIALIZABLE(Flat, a, b, key)
+
+struct Padded {
+    char c;
+    double d;
+    short s;
+};
+ZRF_SERIALIZABLE(Padded, c, d, s)
+
+//fields not listed in declaration order: written in list order
+struct Swapped {
+    int a;
+    int b;
+};
+ZRF_SERIALIZABLE(Swapped, b, a)
+
+struct Record {
+    string name;
+    Padded p;
+    vector< Flat > flats;
+};
+ZRF_SERIALIZABLE(Record, name, p, flats)
+
+//two versions of the same message
+struct MessageV1 {
+    int id;
+    string name;
+};
+ZRF_SERIALIZABLE(MessageV1, id, name)
+
+struct MessageV2 {
+    int id = 0;
+    string name;
+    char c = 'c';
+    short s = -1;
+    float f = 1.f;
+    double scale = 1.0;
+    vector< double > values;
+    Padded p;
+    vector< MessageV1 > children;
+};
+ZRF_SERIALIZABLE(MessageV2, id, name, c, s, f, scale, values, p, children)
+
 int main(int, char**) {
     //POD
     const int intOut = 3;
@@ -65,10 +140,10 @@ int main(int, char**) {
     const tuple< int, double, string > outTuple = make_tuple(4, 4.0, "four");
     using TupleSerializer = GetSerializer< decltype(outTuple) >::Type;
     static_assert(std::is_same< TupleSerializer,
-                  Serialize< std::remove_cv< decltype(outTuple) >
-                  ::type > >::value,
-                  "Not Serialize< tuple< int, double, string > > type");
+                  SerializeTuple< int, double, string > >::value,
+                  "Not SerializeTuple< int, double, string > type");
     const ByteArray toutBuf = TupleSerializer::Pack(outTuple);
+    assert(toutBuf == Pack(4, 4.0, string("four")));
     tuple< int, double, string > inTuple;
     TupleSerializer::UnPack(begin(toutBuf), inTuple);
     assert(inTuple == outTuple);
@@ -118,6 +193,243 @@ int main(int, char**) {
     MapSerializer::UnPack(begin(mba), mapout);
     assert(mapin == mapout);
 
+    //packed size and single allocation packing
+    const vector< string > vs = {"", "one", "two", string(1000, 'x')};
+    const size_t vssz = PackedSize(vs, mapin, 1, 2.0);
+    ByteArray vsba = Pack(vs, mapin, 1, 2.0);
+    assert(vsba.size() == vssz);
+    ByteArray inplace(4, 'h');
+    assert(PackAppend(inplace, vs, mapin, 1, 2.0) == vssz);
+    assert(ByteArray(inplace.begin() + 4, inplace.end()) == vsba);
+    ByteArray raw(vssz);
+    assert(Pack(raw.data(), vs, mapin, 1, 2.0) == raw.data() + vssz);
+    assert(raw == vsba);
+
+    //checked unpacking from view
+    ByteView bv(vsba);
+    vector< string > vsc;
+    map< string, string > mapc;
+    int ic = 0;
+    double dc = 0;
+    assert(UnPackArgs(bv, vsc, mapc, ic, dc) == UNPACK_OK);
+    assert(bv.Empty() && vsc == vs && mapc == mapin && ic == 1 && dc == 2.0);
+    for(size_t i = 0; i != vsba.size(); ++i) {
+        ByteView tv(vsba.data(), i); //truncated
+        assert(UnPackArgs(tv, vsc, mapc, ic, dc) == UNPACK_TRUNCATED);
+    }
+
+    //zero-copy views
+    const vector< float > vf = {1.f, 2.f, 3.f};
+    const ByteArray vfba = Pack(1, vf, string("view"));
+    ByteView vv(vfba);
+    ArrayView< float > af;
+    StringView sv;
+    assert(UnPack(vv, ic) == UNPACK_OK);
+    assert(UnPackView< vector< float > >(vv, af) == UNPACK_OK);
+    assert(UnPackView< string >(vv, sv) == UNPACK_OK && vv.Empty());
+    assert(af.Size() == 3 && af[2] == 3.f && af.ToVector() == vf);
+    assert(af.Data() >= vfba.data() && af.Data() < vfba.data() + vfba.size());
+    assert(vector< float >(af.begin(), af.end()) == vf);
+    assert(sv == string("view") && sv.ToString() == "view");
+    assert(UnPackView< string >(vfba.begin() + sizeof(int)
+                                + PackedSize(vf)) == string("view"));
+    assert(Pack(1, af, sv) == vfba); //same layout as vector and string
+    tuple< int, ArrayView< float >, StringView > vt;
+    ByteView tvv(vfba);
+    assert(UnPack(tvv, vt) == UNPACK_OK && get< 2 >(vt) == string("view"));
+    ByteView shortv(vfba.data(), vfba.size() - 1);
+    assert(UnPack(shortv, vt) == UNPACK_TRUNCATED);
+
+    //varint string length
+    const string shorts(100, 's');
+    const string longs(300, 'l');
+    assert(SerializeVarintString::Size(shorts) == 1 + shorts.size());
+    assert(SerializeVarintString::Size(longs) == 2 + longs.size());
+    const ByteArray vls = SerializeVarintString::Pack(longs,
+                          SerializeVarintString::Pack(shorts));
+    ByteView vlv(vls);
+    string vlin;
+    StringView vlsv;
+    assert(SerializeVarintString::UnPack(vlv, vlin) == UNPACK_OK
+           && vlin == shorts);
+    assert(SerializeVarintStringView::UnPack(vlv, vlsv) == UNPACK_OK
+           && vlsv == longs && vlv.Empty());
+    SerializeVarintString::UnPack(vls.begin(), vlin);
+    assert(vlin == shorts);
+    const ByteArray overflow(11, char(0xFF));
+    ByteView ov(overflow);
+    assert(SerializeVarintString::UnPack(ov, vlin) == UNPACK_INVALID);
+
+    //compact encodings
+    const vector< int8_t > v8 = {1, 2, 3};
+    assert(Pack(v8).size() == 11);
+    assert(PackWith< CompactEncoding >(v8).size() == 4);
+    const ByteArray cba = PackWith< CompactZigZagEncoding >(
+        -1, 300u, string("compact"), vector< long >{-64, 63}, mapin);
+    assert(cba.size() == PackedSizeWith< CompactZigZagEncoding >(
+        -1, 300u, string("compact"), vector< long >{-64, 63}, mapin));
+    ByteView cv(cba);
+    int ci = 0;
+    unsigned cu = 0;
+    string cs;
+    vector< long > cvl;
+    map< string, string > cmap;
+    assert(UnPackArgsWith< CompactZigZagEncoding >(cv, ci, cu, cs, cvl, cmap)
+           == UNPACK_OK && cv.Empty());
+    assert(ci == -1 && cu == 300 && cs == "compact"
+           && cvl == vector< long >({-64, 63}) && cmap == mapin);
+    //1 + 2 + (1 + 7) + (1 + 1 + 1) bytes before the map
+    assert(cba.size() == 14 + PackedSizeWith< CompactEncoding >(mapin));
+    const ByteArray big = PackWith< CompactZigZagEncoding >(100000);
+    ByteView bigv(big);
+    short sh = 0;
+    assert(UnPackWith< CompactZigZagEncoding >(bigv, sh) == UNPACK_INVALID);
+
+    //message headers: raw messages are unchanged, readers reject messages
+    //written with another encoding
+    assert(PackMessageWith< RawEncoding >(7) == Pack(7));
+    const ByteArray cmsg = PackMessageWith< CompactEncoding >(string("m"), 2);
+    assert(cmsg.size() == FormatHeaderSize< CompactEncoding >()
+                          + PackedSizeWith< CompactEncoding >(string("m"), 2));
+    string ms;
+    int mi = 0;
+    ByteView cmv(cmsg);
+    assert(UnPackMessageWith< RawEncoding >(cmv, ms, mi)
+           == UNPACK_FORMAT_MISMATCH);
+    assert(UnPackMessageWith< CompactZigZagEncoding >(cmv, ms, mi)
+           == UNPACK_FORMAT_MISMATCH);
+    assert(UnPackMessageWith< CompactEncoding >(cmv, ms, mi) == UNPACK_OK
+           && cmv.Empty() && ms == "m" && mi == 2);
+    const ByteArray rmsg = PackMessageWith< RawEncoding >(string("m"), 2);
+    ByteView rmv(rmsg);
+    assert(UnPackMessageWith< TaggedEncoding >(rmv, ms, mi)
+           == UNPACK_FORMAT_MISMATCH);
+    assert(UnPackMessageWith< RawEncoding >(rmv, ms, mi) == UNPACK_OK
+           && rmv.Empty() && ms == "m" && mi == 2);
+
+    //portable encoding: little-endian data, 64 bit sizes
+    const ByteArray le = PackWith< PortableEncoding >(
+        uint32_t(0x01020304), vector< uint16_t >{0x0102});
+    assert(le == ByteArray({4, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 2, 1}));
+    assert(CheckByteSwap< 2 >() && CheckByteSwap< 4 >()
+           && CheckByteSwap< 8 >());
+    const vector< double > pvd = {1.5, -2.25, 1E300};
+    const ByteArray pba = PackWith< PortableEncoding >(
+        pvd, tuple< char, short, string >('c', -2, "portable"), mapin);
+    ByteView pv(pba);
+    vector< double > pvdin;
+    tuple< char, short, string > ptin;
+    map< string, string > pmap;
+    assert(UnPackArgsWith< PortableEncoding >(pv, pvdin, ptin, pmap)
+           == UNPACK_OK && pv.Empty());
+    assert(pvdin == pvd && get< 1 >(ptin) == -2 && pmap == mapin);
+    //no padding between tuple elements
+    assert(PackedSizeWith< PortableEncoding >(ptin) == 1 + 2 + 8 + 8);
+
+    //STL containers
+    const unordered_map< string, vector< int > > um = {{"a", {1}}, {"b", {}}};
+    const set< string > ss = {"x", "y", "z"};
+    const unordered_set< int > us = {1, 2, 3};
+    const deque< string > ds = {"d", "e"};
+    const list< pair< string, int > > lp = {{"l", 1}, {"m", 2}};
+    const array< string, 2 > as = {{"a", "b"}};
+    const array< int, 3 > ai = {{1, 2, 3}};
+    static_assert(is_same< GetSerializer< decltype(ai) >::Type,
+                           SerializePOD< array< int, 3 > > >::value,
+                  "Not SerializePOD< array< int, 3 > >");
+    //pairs are not trivially copyable: always element-wise, no padding
+    assert(Pack(make_pair(1, 2.)).size() == sizeof(int) + sizeof(double));
+    const ByteArray stl = Pack(um, ss, us, ds, lp, as, ai, make_pair(1, 2.));
+    ByteView stlv(stl);
+    unordered_map< string, vector< int > > umin;
+    set< string > ssin;
+    unordered_set< int > usin;
+    deque< string > dsin;
+    list< pair< string, int > > lpin;
+    array< string, 2 > asin;
+    array< int, 3 > aiin;
+    pair< int, double > pin;
+    assert(UnPackArgs(stlv, umin, ssin, usin, dsin, lpin, asin, aiin, pin)
+           == UNPACK_OK && stlv.Empty());
+    assert(umin == um && ssin == ss && usin == us && dsin == ds
+           && lpin == lp && asin == as && aiin == ai
+           && pin == make_pair(1, 2.));
+    //portable encoding of arrays of arithmetic types: element-wise
+    assert(PackWith< PortableEncoding >(ai)
+           == ByteArray({1, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0}));
+
+    //ZRF_SERIALIZABLE types: no padding, single memcpy when possible
+    static_assert(is_same< GetSerializer< Flat >::Type,
+                           SerializePOD< Flat > >::value,
+                  "Not SerializePOD< Flat >");
+    static_assert(is_same< GetSerializer< Padded >::Type,
+                           SerializeFields< Padded > >::value,
+                  "Not SerializeFields< Padded >");
+    static_assert(is_same< GetSerializer< vector< Flat > >::Type,
+                           SerializeVectorPOD< Flat > >::value,
+                  "Not SerializeVectorPOD< Flat >");
+    static_assert(is_same< GetSerializer< vector< Padded > >::Type,
+                           SerializeVector< Padded > >::value,
+                  "Not SerializeVector< Padded >");
+    static_assert(is_same< GetSerializer< Flat, PortableEncoding >::Type,
+                           SerializeFields< Flat, PortableEncoding > >::value,
+                  "Not SerializeFields< Flat, PortableEncoding >");
+    static_assert(is_same< GetSerializer< Swapped >::Type,
+                           SerializeFields< Swapped > >::value,
+                  "Not SerializeFields< Swapped >");
+    assert(Pack(Swapped{1, 2}) == Pack(2, 1));
+    const Record rec = {"rec", {'p', 1.5, -3}, {{1, 2.f, {"k"}}}};
+    assert(PackedSize(rec.p) == 1 + 8 + 2);
+    assert(PackedSize(rec) == PackedSize(rec.name, 'p', 1.5, short(-3),
+                                         rec.flats));
+    const ByteArray recba = PackWith< CompactEncoding >(rec);
+    ByteView recv(recba);
+    Record recin;
+    assert(UnPackWith< CompactEncoding >(recv, recin) == UNPACK_OK
+           && recv.Empty());
+    assert(recin.name == rec.name && recin.p.c == 'p' && recin.p.d == 1.5
+           && recin.p.s == -3 && recin.flats.size() == 1
+           && recin.flats[0].a == 1 && recin.flats[0].b == 2.f
+           && string(recin.flats[0].key) == "k");
+    const Record recin2 = UnPack< Record >(Pack(rec));
+    assert(recin2.name == rec.name && recin2.p.d == 1.5
+           && recin2.flats[0].a == 1);
+
+    //tagged encoding: unknown fields skipped, missing fields defaulted
+    const MessageV1 m1 = {-1, "m1"};
+    assert(PackWith< TaggedEncoding >(m1)
+           == ByteArray({6, 8, 1, 18, 2, 'm', '1'}));
+    MessageV2 m2;
+    m2.id = 2;
+    m2.name = "m2";
+    m2.c = 'x';
+    m2.s = 300;
+    m2.f = 2.5f;
+    m2.scale = 4.0;
+    m2.values = {1.0, 2.0};
+    m2.p = {'p', 1.5, 3};
+    m2.children = {m1, m1};
+    const ByteArray m2ba = PackWith< TaggedEncoding >(m2, m1);
+    ByteView m2v(m2ba);
+    MessageV1 m1in;
+    MessageV2 m2in;
+    assert(UnPackArgsWith< TaggedEncoding >(m2v, m1in, m2in) == UNPACK_OK
+           && m2v.Empty());
+    assert(m1in.id == 2 && m1in.name == "m2");
+    assert(m2in.id == -1 && m2in.name == "m1" && m2in.c == 'c'
+           && m2in.s == -1 && m2in.scale == 1.0 && m2in.values.empty()
+           && m2in.children.empty());
+    MessageV2 m2in2;
+    assert(UnPackWith< TaggedEncoding >(m2ba.begin(), m2in2)
+           == m2ba.begin() + PackedSizeWith< TaggedEncoding >(m2));
+    assert(m2in2.s == 300 && m2in2.f == 2.5f && m2in2.scale == 4.0
+           && m2in2.values == m2.values && m2in2.p.d == 1.5
+           && m2in2.children.size() == 2
+           && m2in2.children[1].name == "m1");
+    //truncated message
+    ByteView m2t(m2ba.data(), m2ba.size() / 2);
+    assert(UnPackWith< TaggedEncoding >(m2t, m2in) == UNPACK_TRUNCATED);
+
     //struct with embedded C array
     struct MouseEvent {
         int x;